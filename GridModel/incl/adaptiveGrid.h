@@ -0,0 +1,92 @@
+#ifndef ADAPTIVE_GRID_H
+#define ADAPTIVE_GRID_H
+
+#include "ionosphereGrid.h"
+
+//==========================================================
+// Representing struct for a node of an adaptive cell tree
+//==========================================================
+// Every cell of the base grid is the root of a quadtree. A node is split
+// first by the meridian plane of its middle longitude, then both halves
+// by the latitude plane of its middle latitude (through the origo and
+// the two vertexes of the half on that latitude), so the leaves of a
+// tree partition the base cell exactly.
+typedef struct AdaptiveGridNode
+{
+    //linear index of the leaf cell, -1 for split nodes
+    int cellId;
+    //0 for the cells of the base grid
+    int level;
+    //number of rays crossing the leaf since the last refinement
+    int rayCount;
+    //the node has been merged, it will not be split again
+    int isMerged;
+    //boundaries in radians
+    double northLatitude;
+    double southLatitude;
+    double westLongitude;
+    double eastLongitude;
+    //normals of the splitting planes (pointing east/north), valid if split
+    Vec3 meridianNormal;
+    Vec3 westLatitudeNormal;
+    Vec3 eastLatitudeNormal;
+    /*
+     * 0 for leaves, otherwise 4 children
+     * 0: northwestern
+     * 1: northeastern
+     * 2: southwestern
+     * 3: southeastern
+     */
+    struct AdaptiveGridNode* children;
+}AdaptiveGridNode;
+
+
+//=====================================================
+// Representing struct for an adaptive ionosphere grid
+//=====================================================
+typedef struct AdaptiveGrid
+{
+    //the base lattice, it is not owned by the adaptive grid
+    QuadraticGrid* baseGrid;
+    //one tree for every base cell, indexed by getSingleCellIDByIndexes()
+    AdaptiveGridNode* roots;
+    //the leaves indexed by their cellId
+    AdaptiveGridNode** cells;
+    int cellCount;
+}AdaptiveGrid;
+
+void initAdaptiveGrid(AdaptiveGrid* grid);
+void deleteAdaptiveGrid(AdaptiveGrid* grid);
+
+/*
+ * This function creates an adaptive grid over the base grid without any
+ * splitting. The cell ids are the same as getSingleCellIDByIndexes()
+ * gives until the first refinement.
+ */
+AdaptiveGrid createAdaptiveGrid(QuadraticGrid* baseGrid);
+
+/*
+ * This function splits the line sectors of the base grid (as returned by
+ * getLineSectorsFromModel()) along the leaves of the adaptive grid. The
+ * sectors keep the base cell indexes, the cellId is the leaf index. The
+ * base sectors are not modified.
+ */
+LineSectorList* splitLineSectorsByAdaptiveGrid(LineSectorList* baseSectors, AdaptiveGrid* grid);
+
+//Same as getLineSectorsFromModel() on the leaves of the adaptive grid
+LineSectorList* getLineSectorsFromAdaptiveGrid(Vector satPos, Vector recPos, AdaptiveGrid* grid);
+
+//Counts the ray of lineSectors (given by the adaptive grid) in its leaves
+void addAdaptiveGridRayCounts(LineSectorList* lineSectors, AdaptiveGrid* grid);
+
+/*
+ * This function refines the grid by the ray counts collected since the
+ * last refinement. Leaves crossed by more than splitRayCount rays are
+ * split if they are below maxLevel, and split nodes whose children are
+ * all leaves crossed by less than mergeRayCount rays are merged. The
+ * cells are renumbered and the ray counts are reset. Returns the number
+ * of split and merged nodes.
+ */
+int refineAdaptiveGrid(AdaptiveGrid* grid, int splitRayCount, int mergeRayCount, int maxLevel);
+
+#endif //ADAPTIVE_GRID_H
@@ -0,0 +1,67 @@
+#ifndef CELL_COVERAGE_H
+#define CELL_COVERAGE_H
+
+#include "ionosphereGrid.h"
+
+//===============================================
+// Representing struct for the coverage of a cell
+//===============================================
+typedef struct CellCoverage
+{
+    //number of rays crossing the cell
+    int rayCount;
+    //total length of the line sectors in the cell
+    double pathLength;
+    //sum of the unit directions of the crossing rays
+    Vec3 directionSum;
+}CellCoverage;
+
+//===================================================
+// Representing struct for the coverage of all cells
+//===================================================
+// Cells are indexed by the cellId of the line sectors.
+typedef struct GridCoverage
+{
+    int cellCount;
+    CellCoverage* cells;
+}GridCoverage;
+
+void initGridCoverage(GridCoverage* coverage, int cellCount);
+void deleteGridCoverage(GridCoverage* coverage);
+
+/*
+ * Adds the line sectors of one ray to the coverage. A ray is counted
+ * once in every cell it crosses.
+ */
+void addLineSectorsToCoverage(GridCoverage* coverage, CompactLineSectors* lineSectors);
+
+/*
+ * Angular diversity of the rays crossing the cell, 1 - |mean direction|.
+ * 0 means that every ray has the same direction (or there are no rays),
+ * the cell can not be separated from the cells along these rays.
+ */
+double getCellAngularDiversity(CellCoverage* cellCoverage);
+
+/*
+ * Writes a report of the coverage: a summary line, than one line for
+ * every crossed cell: cell id, ray count, path length in km and angular
+ * diversity. Returns 1 on success, 0 otherwise.
+ */
+int writeGridCoverageReport(GridCoverage* coverage, char* reportFile);
+
+/*
+ * Merges the cells of the grid crossed by less than minRayCount rays or
+ * having less angular diversity than minDiversity into an adjacent
+ * observable cell (vertical neighbors are preferred, than the one with
+ * the most rays, see getLineSectorCellNeighbors()). cellMapping[i] is set to the cell whose unknown is
+ * used for cell i (i if the cell is kept). Cells without any crossing
+ * ray and cells without an observable neighbor are kept. The coverage
+ * of the merged cells is added to their target. Returns the number of
+ * merged cells.
+ */
+int mergeUnobservableCells(GridCoverage* coverage, QuadraticGrid* grid, int minRayCount, double minDiversity, int* cellMapping);
+
+//replaces the cellId of the line sectors by cellMapping[cellId]
+void applyCellMapping(CompactLineSectors* lineSectors, int* cellMapping);
+
+#endif //CELL_COVERAGE_H
@@ -0,0 +1,36 @@
+#ifndef GEODETIC_CONVERSION_H
+#define GEODETIC_CONVERSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Conversions between earth centered (ECEF) cartesian and geodetic
+ * coordinates on an ellipsoid given by its semi-major axis a and its
+ * first eccentricity e. Angles are in radians, lengths in meters.
+ */
+
+void geodeticToECEF(double latitude, double longitude, double height, double a, double e, double* x, double* y, double* z);
+
+/*
+ * Closed form (non-iterative) conversion by Vermeille's method. The
+ * result is exact up to rounding for every point outside the evolute
+ * of the ellipsoid, i.e. farther than a few tens of kilometers from the
+ * center of the earth.
+ */
+void ecefToGeodetic(double x, double y, double z, double a, double e, double* latitude, double* longitude, double* height);
+
+/*
+ * Batch variant of ecefToGeodetic() for "count" points given by the
+ * x[i], y[i], z[i] arrays. AVX2 is used if the processor supports it,
+ * the results differ from the scalar ones only by rounding.
+ */
+void ecefToGeodeticBatch(int count, const double* x, const double* y, const double* z, double a, double e,
+                         double* latitude, double* longitude, double* height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GEODETIC_CONVERSION_H
@@ -1,6 +1,8 @@
 #ifndef GEOMETRY_PRIMITIVES_H
 #define GEOMETRY_PRIMITIVES_H
 
+#include <math.h>
+
 #define epsilon 0.000001
 
 
@@ -60,6 +62,93 @@ Vector subtractVector(Vector v1, Vector v2);
 Vector scalarVectorMult(double s, Vector v);
 
 
+//=================================================================
+// Struct describing a lean vector, that has no stored length.
+//=================================================================
+// The operations below never calculate the length, it is computed
+// on demand by vec3Length(). Hot paths should use this instead of
+// Vector, whose every operation calls sqrt().
+typedef struct Vec3
+{
+    double x;
+    double y;
+    double z;
+}Vec3;
+
+static inline Vec3 vec3(double x, double y, double z)
+{
+    Vec3 v = {x, y, z};
+    return v;
+}
+
+static inline Vec3 vec3FromVector(Vector v)
+{
+    return vec3(v.x, v.y, v.z);
+}
+
+/*
+ * Converts to Vector, the length is calculated here.
+ */
+static inline Vector vectorFromVec3(Vec3 v)
+{
+    return createVector(v.x, v.y, v.z);
+}
+
+static inline double vec3Dot(Vec3 v1, Vec3 v2)
+{
+    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+}
+
+static inline Vec3 vec3Cross(Vec3 v1, Vec3 v2)
+{
+    return vec3(v1.y * v2.z - v1.z * v2.y,
+                v1.z * v2.x - v1.x * v2.z,
+                v1.x * v2.y - v1.y * v2.x);
+}
+
+static inline Vec3 vec3Add(Vec3 v1, Vec3 v2)
+{
+    return vec3(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
+}
+
+/*
+ * Returns v1 - v2. Note that the order is the natural one, unlike
+ * subtractVector().
+ */
+static inline Vec3 vec3Subtract(Vec3 v1, Vec3 v2)
+{
+    return vec3(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z);
+}
+
+static inline Vec3 vec3Scale(double s, Vec3 v)
+{
+    return vec3(s * v.x, s * v.y, s * v.z);
+}
+
+/*
+ * Returns p + s * d, the point of a line at distance s.
+ */
+static inline Vec3 vec3MultiplyAdd(Vec3 p, double s, Vec3 d)
+{
+    return vec3(p.x + s * d.x, p.y + s * d.y, p.z + s * d.z);
+}
+
+static inline double vec3Length(Vec3 v)
+{
+    return sqrt(vec3Dot(v, v));
+}
+
+static inline Vec3 vec3Normalize(Vec3 v)
+{
+    double length = vec3Length(v);
+    if (length < epsilon)
+    {
+        return v;
+    }
+    return vec3Scale(1 / length, v);
+}
+
+
 //============================================
 // Struct describing an axis aligned spheroid
 //============================================
@@ -70,6 +159,10 @@ typedef struct Spheroid
     double a;
     double b;
     double e;
+
+    //precomputed 1/a^2 and 1/b^2 for the intersection calculations
+    double invA2;
+    double invB2;
 }Spheroid;
 
 /*
@@ -147,6 +240,82 @@ int intersectLineSpheroid(Line l, Spheroid s, Vector* results);
  */
 int intersectLinePlane(Line l, Plane p, Vector* result);
 
+//=========================================================
+// Struct describing a lean line (ray) built from Vec3s
+//=========================================================
+// direction is the unit vector pointing from origin to the other point.
+typedef struct Ray
+{
+    Vec3 origin;
+    Vec3 direction;
+}Ray;
+
+/*
+ * Creator function for rays, the direction points from p1 to p2.
+ */
+Ray createRay(Vec3 p1, Vec3 p2);
+
+/*
+ * Ray variant of intersectLineSpheroidDistances().
+ */
+int intersectRaySpheroidDistances(Ray r, Spheroid* s, double* distances);
+
+/*
+ * Fast variant of intersectLineSpheroid(). Instead of the intersection
+ * points it stores their distance from l.p1 measured along the unit
+ * l.orientation in "distances" in ascending order. The caller must
+ * allocate memory for 2 doubles. The return value is the number of
+ * intersections (0, 1 or 2).
+ */
+int intersectLineSpheroidDistances(Line l, Spheroid* s, double* distances);
+
+/*
+ * Fast variant of intersectLinePlane(). The distance of the intersection
+ * from l.p1 along the unit l.orientation is stored in "distance". The
+ * return value is the same as the one of intersectLinePlane().
+ */
+int intersectLinePlaneDistance(Line l, Plane* p, double* distance);
+
+
+//=========================================================
+// Struct describing lines in structure of arrays layout
+//=========================================================
+// p is the starting point, d is the unit orientation of the lines.
+// The arrays are owned by the batch.
+typedef struct LineBatch
+{
+    int count;
+    double* px;
+    double* py;
+    double* pz;
+    double* dx;
+    double* dy;
+    double* dz;
+}LineBatch;
+
+/*
+ * Allocates the arrays of a batch for "count" lines.
+ */
+void initLineBatch(LineBatch* batch, int count);
+
+/*
+ * Frees all the arrays of the given batch.
+ */
+void deleteLineBatch(LineBatch* batch);
+
+/*
+ * Stores line l at position "index" of the batch.
+ */
+void setLineBatchElement(LineBatch* batch, int index, Line l);
+
+/*
+ * Batch variant of intersectLineSpheroidDistances(). The near and far
+ * intersection distances of line i are stored in nearDistances[i] and
+ * farDistances[i], both are NAN if the line misses the spheroid. AVX2
+ * is used if the processor supports it.
+ */
+void intersectLineBatchSpheroid(LineBatch* batch, Spheroid* s, double* nearDistances, double* farDistances);
+
 
 //===============================
 // Struct describing a Tesseroid
@@ -0,0 +1,41 @@
+#ifndef GRID_BASIS_H
+#define GRID_BASIS_H
+
+#include "ionosphereGrid.h"
+
+/*
+ * Trilinear node basis of the quadratic grid. The electron density is
+ * defined at the corners of the cells (nodes) and interpolated inside a
+ * cell trilinearly in its local coordinates: the latitude, the longitude
+ * and the spheroid parameter between the lower and upper boundary
+ * spheroid of the layer, all normalized to [0, 1]. The nodes are indexed
+ * by the boundary indexes: layer boundary (lowest first), latitude
+ * boundary (north first) and longitude boundary (west first). Nodes at
+ * the same point have the same ID: the nodes of a pole, and on a grid
+ * reaching across the globe the nodes of the first and last longitude
+ * boundary.
+ */
+
+//number of nodes of the grid, (layerNum + 1) * (latitude boundaries) * (longitude boundaries)
+int getQuadraticGridNodeCount(QuadraticGrid* grid);
+
+int getSingleNodeIDByIndexes(int layerBoundaryId, int latitudeBoundaryId, int longitudeBoundaryId, QuadraticGrid* grid);
+
+/*
+ * This function calculates the integrals of the basis functions of the
+ * 8 corner nodes of the sector's cell along the line sector. The local
+ * coordinates are taken linear between the entry and exit point of the
+ * sector, so the integral of the product of the three linear factors is
+ * evaluated in closed form. The weights (meters) sum to the length of the
+ * sector. The sector must have valid layer, lateral and longitudinal IDs
+ * (no adaptive or merged cells).
+ */
+void getLineSectorNodeWeights(LineSectorList* lsl, QuadraticGrid* grid, int* nodeIds, double* weights);
+
+/*
+ * Same as getLineSectorNodeWeights() for sector "index" of the compact
+ * line sectors, which must have retained points.
+ */
+void getCompactLineSectorNodeWeights(CompactLineSectors* lineSectors, int index, QuadraticGrid* grid, int* nodeIds, double* weights);
+
+#endif //GRID_BASIS_H
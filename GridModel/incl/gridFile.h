@@ -0,0 +1,31 @@
+#ifndef GRID_FILE_H
+#define GRID_FILE_H
+
+#include "ionosphereGrid.h"
+
+/*
+ * Binary storage of built grids. The file contains a versioned header,
+ * the boundary tables (spheroids, latitudes, longitudes, meridian and
+ * latitude planes) and the cell table with the boundary and neighbor
+ * indexes, all in the same layout as in memory. The tables are 8 byte
+ * aligned, so a loaded grid uses them directly from the mapped file,
+ * only the row pointers of "cells" are allocated. A hash of all the
+ * tables is stored in the header and checked on loading. The file is
+ * specific to the architecture it was written on.
+ */
+
+/*
+ * This function writes the grid into gridFile.
+ * Returns 1 on success, 0 otherwise.
+ */
+int saveQuadraticGrid(QuadraticGrid* grid, char* gridFile);
+
+/*
+ * This function maps gridFile into memory and initializes grid from it.
+ * The mapping is released by deleteQuadraticGrid(). Returns 1 on success,
+ * 0 if the file is missing, has a different version or is corrupted, in
+ * which case grid is not modified.
+ */
+int loadQuadraticGrid(char* gridFile, QuadraticGrid* grid);
+
+#endif //GRID_FILE_H
@@ -1,6 +1,8 @@
 #ifndef IONOSPHERE_GRID_H
 #define IONOSPHERE_GRID_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "geometryPrimitives.h"
 
 extern const Spheroid WGS84_Spheroid;
@@ -26,6 +28,12 @@ typedef struct GeoCoord
 //default: mode 1
 GeoCoord createGeoCoord(double latitude, double longitude, int mode);
 
+//position of the geographic coordinate (radians) on the WGS84 ellipsoid
+Vector geoCoordToWGS84Vector(double latitude, double longitude);
+
+//returns 1 if the latitude (radians) is a pole within epsilon
+int isPoleLatitude(double latitude);
+
 /*
  * This function creates a tesseroid. The two boundary spheroid are
  * considered geocentrical. The boundary planes are specified by 3
@@ -40,15 +48,31 @@ Tesseroid createGeoTesseroid(Spheroid* lowerBound, Spheroid* upperBound, GeoCoor
 //=================================================================
 // Representing struct for a cell that has a "quadratic" tesseroid
 //=================================================================
+// The cell does not store its own geometry, the boundaries are shared
+// with the adjacent cells through the boundary tables of the grid.
 typedef struct QuadraticGridCell
 {
-    Tesseroid t;
     // indexes of the cell inside the model
     int layerId;
     int lateralId;
     int longitudinalId;
     /*
-     * Pointers to adjacent cells
+     * Indexes of the boundaries in the tables of the grid, ordered
+     * the same way as the neighbors. Boundary i separates the cell
+     * from neighbor i.
+     * 0: lower spheroid  (boundarySpheroids)
+     * 1: upper spheroid  (boundarySpheroids)
+     * 2: northern plane  (latitudePlanes)
+     * 3: eastern plane   (meridianPlanes)
+     * 4: southern plane  (latitudePlanes)
+     * 5: western plane   (meridianPlanes)
+     * -1 means that the boundary is degenerated into a pole.
+     */
+    int boundaryIds[6];
+    /*
+     * Single cell IDs (see getSingleCellIDByIndexes()) of the adjacent
+     * cells, -1 if there is no neighbor. The cell does not contain
+     * pointers, so the cell table can be stored and mapped as it is.
      * 0: lower
      * 1: upper
      * 2: northern
@@ -56,7 +80,7 @@ typedef struct QuadraticGridCell
      * 4: southern
      * 5: western
      */
-    struct QuadraticGridCell* neighbors[6];
+    int neighborIds[6];
 }QuadraticGridCell;
 
 void initQuadraticGridCell(QuadraticGridCell* cell);
@@ -72,8 +96,24 @@ void deleteQuadraticGridCell(QuadraticGridCell* cell);
 typedef struct QuadraticGrid
 {
     GeoCoord center;
+    //all the cells in single cell ID order, cells[i][j] points into it
+    QuadraticGridCell* cellTable;
     QuadraticGridCell*** cells;
+    //layer boundaries from the lowest to the highest
     Spheroid* boundarySpheroids;
+    /*
+     * Side boundaries shared by the cells. All the cells of a column
+     * share the same meridian planes (west->east, normals point east,
+     * index = longitude boundary). The latitude planes go through the
+     * origo and the two vertexes of a cell on the same latitude, so
+     * they are shared along a column (north->south, normals point
+     * north, index = latitude boundary * column count + column).
+     */
+    Plane* meridianPlanes;
+    Plane* latitudePlanes;
+    //radians, north->south and west->east
+    double* boundaryLatitudes;
+    double* boundaryLongitudes;
     int eastNum;
     int westNum;
     int northNum;
@@ -82,6 +122,11 @@ typedef struct QuadraticGrid
     //radians
     double latitudeUnit;
     double longitudeUnit;
+    //hash of the specification the grid was created from (0 if unknown)
+    unsigned long long specHash;
+    //the tables are mapped from a grid file, see gridFile.h
+    void* mappedData;
+    size_t mappedSize;
 }QuadraticGrid;
 
 void initQuadraticGrid(QuadraticGrid* grid);
@@ -94,6 +139,133 @@ void deleteQuadraticGrid(QuadraticGrid* grid);
  */
 int getSingleCellIDByIndexes(int layerIndex, int nsIndex, int weIndex, QuadraticGrid* grid);
 
+//the inverse of getSingleCellIDByIndexes()
+void getIndexesBySingleCellID(int cellId, QuadraticGrid* grid, int* layerIndex, int* nsIndex, int* weIndex);
+
+/*
+ * This function returns the cell ID used for the line sectors of the cell.
+ * It equals the single cell ID, except in the rows touching a pole: the
+ * cells of such a row meet at the pole and form a polar cap, which is a
+ * single cell of the model, so every cell of the row has the ID of its
+ * first cell. The traversal still steps through the cells of the cap one
+ * by one, so the layer, lateral and longitudinal IDs of the sectors are
+ * the ones of the crossed cell.
+ */
+int getLineSectorCellId(int layerIndex, int nsIndex, int weIndex, QuadraticGrid* grid);
+
+//returns the neighbor of the cell through the given boundary, 0 if there is none
+QuadraticGridCell* getNeighborCell(QuadraticGridCell* cell, int boundary, QuadraticGrid* grid);
+
+/*
+ * This function collects the line sector cell IDs (see getLineSectorCellId())
+ * adjacent to the given line sector cell, each once. The neighbors of a
+ * polar cap are the neighbors of all the cells of its row. isVertical is
+ * set for the neighbors through the lower and upper spheroid. The buffers
+ * must hold getMaxLineSectorCellNeighborCount() IDs, IDs outside the grid
+ * have no neighbors. Returns the number of neighbors.
+ */
+int getLineSectorCellNeighbors(int cellId, QuadraticGrid* grid, int* neighborIds, int* isVertical);
+int getMaxLineSectorCellNeighborCount(QuadraticGrid* grid);
+
+/*
+ * This function returns a hash of the grid definition (cell counts,
+ * boundary latitudes, longitudes and spheroids). Grids giving the same
+ * line sectors for every line have the same hash, so it can be used to
+ * identify stored tracing results.
+ */
+unsigned long long getQuadraticGridHash(QuadraticGrid* grid);
+
+//continues the 64 bit FNV-1a hash with size bytes of data, the initial hash is 14695981039346656037
+unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size);
+
+
+//basis functions of the electron density in the grid
+typedef enum
+{
+    //constant density in every cell, the unknowns are the cells
+    CELL_BASIS,
+    //trilinear interpolation between the cell corners, the unknowns are the nodes (see gridBasis.h)
+    TRILINEAR_NODE_BASIS
+}GridBasis;
+
+//=======================================================
+// Representing struct for the definition of a grid model
+//=======================================================
+typedef struct QuadraticGridSpec
+{
+    GeoCoord center;
+    //degrees
+    double latitudeUnit;
+    double longitudeUnit;
+    //cell number limits in one direction, see createQuadraticGrid()
+    int cellNumLimitLat;
+    int cellNumLimitLong;
+    int layerNum;
+    //layerNum + 1 heights above the WGS84 ellipsoid in meters, lowest first
+    double* layerBoundaryHeights;
+    /*
+     * Adaptive refinement of the cells (see adaptiveGrid.h), 0 levels
+     * means a uniform grid. Cells crossed by more than splitRayCount
+     * rays are split, split cells whose parts are all crossed by less
+     * than mergeRayCount rays are merged back.
+     */
+    int refinementLevels;
+    int splitRayCount;
+    int mergeRayCount;
+    /*
+     * Cells crossed by less than minRayCount rays or with less angular
+     * diversity than minDiversity are merged into a neighbor before the
+     * solution (see cellCoverage.h), 0 means no merging.
+     */
+    int minRayCount;
+    double minDiversity;
+    GridBasis basis;
+}QuadraticGridSpec;
+
+/*
+ * Initializes the specification with the default grid of the modeler:
+ * center 50N 15E, 5x5 degree cells, 3 cells in every direction from
+ * the center and 2 equal layers between ionosphereLowerBound and
+ * ionosphereUpperBound.
+ */
+void initQuadraticGridSpec(QuadraticGridSpec* spec);
+void deleteQuadraticGridSpec(QuadraticGridSpec* spec);
+
+//sets layerNum equal layers between ionosphereLowerBound and ionosphereUpperBound
+void setUniformLayerBoundaryHeights(QuadraticGridSpec* spec, int layerNum);
+
+/*
+ * Reads the grid specification from a text file. Empty lines and lines
+ * starting with '#' are skipped, the other lines are "key values":
+ *     center       LAT LON          (degrees)
+ *     unit         LATUNIT LONUNIT  (degrees)
+ *     extent       LATLIMIT LONLIMIT
+ *     layernum     N                (N equal layers)
+ *     layerheights H0 H1 ... Hn     (km, lowest first, at most 256 heights)
+ *     refinement   LEVELS SPLITCOUNT MERGECOUNT
+ *     observable   MINRAYCOUNT MINDIVERSITY
+ *     basis        cell|trilinear
+ * Keys not present in the file keep their values, so spec should be
+ * initialized by initQuadraticGridSpec(). Only comment lines may be
+ * longer than 4095 characters.
+ */
+void loadQuadraticGridSpec(char* specFile, QuadraticGridSpec* spec);
+
+/*
+ * Checks the specification and exits with an error message if the grid
+ * can not be built from it.
+ */
+void validateQuadraticGridSpec(QuadraticGridSpec* spec);
+
+/*
+ * This function returns a hash of the geometric part of the specification
+ * (refinement settings are not included). It is stored in the grids
+ * created by createQuadraticGridFromSpec().
+ */
+unsigned long long getQuadraticGridSpecHash(QuadraticGridSpec* spec);
+
+//creates the grid specified by spec, the spec is validated first
+QuadraticGrid createQuadraticGridFromSpec(QuadraticGridSpec* spec);
 
 /*
  * This function creates a quadratic grid with the given parameters.
@@ -102,7 +274,8 @@ int getSingleCellIDByIndexes(int layerIndex, int nsIndex, int weIndex, Quadratic
  * radius, or rather major/minor axis) so total number of cells will
  * be doubled. If latitude reaches absolute +/-90 degree or longitute
  * relative +/-180 the model will be truncated. Latitude/longitude unit
- * should be passed as degrees, and must be always positive.
+ * should be passed as degrees, and must be always positive. The layers
+ * are equally spaced between ionosphereLowerBound and ionosphereUpperBound.
  */
 QuadraticGrid createQuadraticGrid(GeoCoord center, double latitudeUnit, double longitudeUnit, int layerNum, int cellNumLimitLat, int cellNumLimitLong);
 
@@ -118,27 +291,132 @@ typedef struct LineSectorList
     int layerId;
     int lateralId;
     int longitudinalId;
+    //linear index of the cell, used as the index of the unknown
+    int cellId;
     //length of the line sector
     double length;
     //coordinates of the entry and exit point of the line sector
     //in the cell with sat->rec direction.
-    Vector cellIntersectionEntry;
-    Vector cellIntersectionExit;
+    Vec3 cellIntersectionEntry;
+    Vec3 cellIntersectionExit;
 }LineSectorList;
 
 void initLineSectorList(LineSectorList* lsl);
 void deleteLineSectorList(LineSectorList** lsl);
 
+//=====================================================
+// Representing struct for the compact sectors of a line
+//=====================================================
+// The sectors of one line are stored contiguously with 8 bytes per
+// sector instead of a LineSectorList element for each. The entry and
+// exit points are optional: points[i] is the entry and points[i + 1] is
+// the exit point of sector i, since the sectors are continuous.
+typedef struct CompactLineSector
+{
+    //linear index of the cell, see LineSectorList
+    uint32_t cellId;
+    float length;
+}CompactLineSector;
+
+typedef struct CompactLineSectors
+{
+    int count;
+    //unit direction of the line (sat->rec)
+    Vec3 direction;
+    CompactLineSector* sectors;
+    //count + 1 points, 0 if the points are not retained
+    Vec3* points;
+}CompactLineSectors;
+
+void initCompactLineSectors(CompactLineSectors* lineSectors);
+void deleteCompactLineSectors(CompactLineSectors* lineSectors);
+
+/*
+ * This function stores the line sectors in compact form. The entry and
+ * exit points are kept only if isPointRetained is set. The list is not
+ * modified, a 0 list gives 0 sectors.
+ */
+void compactLineSectors(LineSectorList* lsl, int isPointRetained, CompactLineSectors* result);
+
 /*
  * This function returns the line sectors of the line specified by
  * satPos and recPos across the grid. All receivers' geographical
  * coordinates must be inside the grid model. Any different cases
  * are unhandled. Trajectories that enter the model from N/S/W/E
- * directions will be discarded. Trajectories that have both ends
- * inside the model, but cross the most eastern/western boundaries,
- * will probably cause segfault. This should be fixed in the future
- * and those trajectories should rather be discarded.
+ * directions or leave it through the most northern/southern/eastern/
+ * western boundaries will be discarded. A grid reaching across the
+ * globe has no eastern/western boundary (the first and last columns
+ * are neighbors) and a grid reaching the poles has no northern/southern
+ * one, so on a global grid every line is traced. The intersection of
+ * the line with a boundary is calculated only once and it is reused by
+ * both cells sharing the boundary.
  */
 LineSectorList* getLineSectorsFromModel(Vector satPos, Vector recPos, QuadraticGrid* grid);
 
+/*
+ * Batch variant of getLineSectorsFromModel(). The lines are specified by
+ * the satPos[i] and recPos[i] pairs, and the line sectors of line i are
+ * stored in results[i] (0 if the line was discarded). The intersections
+ * with the outer boundary spheroids are calculated for the whole batch
+ * at once with the SIMD kernels. The caller allocates "results".
+ */
+void getLineSectorsFromModelBatch(Vector* satPos, Vector* recPos, int count, QuadraticGrid* grid, LineSectorList** results);
+
+
+//=========================================================
+// Representing struct for the horizontal trace of a line
+//=========================================================
+// The columns (cells with the same lateral and longitudinal ID) crossed
+// by the line do not depend on the layer boundaries, so the line sectors
+// of a grid with different layer heights can be calculated from the
+// stored trace by intersecting only the boundary spheroids.
+typedef struct HorizontalCrossing
+{
+    int lateralId;
+    int longitudinalId;
+    //distance from the origin of the ray where it leaves the column
+    double exitDistance;
+}HorizontalCrossing;
+
+typedef struct HorizontalTrace
+{
+    Ray ray;
+    //hash of the side boundaries of the grid, see getQuadraticGridHorizontalHash()
+    unsigned long long horizontalHash;
+    //distance of the start of the trace, the entry into the upper spheroid
+    double startDistance;
+    //the line leaves the grid through its side after the last column
+    int leavesGrid;
+    int crossingCount;
+    HorizontalCrossing* crossings;
+}HorizontalTrace;
+
+void initHorizontalTrace(HorizontalTrace* trace);
+void deleteHorizontalTrace(HorizontalTrace* trace);
+
+/*
+ * This function returns a hash of the side boundaries of the grid
+ * (latitude and longitude boundaries). Grids differing only in their
+ * layers have the same horizontal hash.
+ */
+unsigned long long getQuadraticGridHorizontalHash(QuadraticGrid* grid);
+
+/*
+ * This function traces the columns of the grid crossed by the line from
+ * its entry into the upper boundary spheroid to the receiver. If the line
+ * does not enter the grid from above, the trace has no crossings.
+ */
+void createHorizontalTrace(Vector satPos, Vector recPos, QuadraticGrid* grid, HorizontalTrace* trace);
+
+/*
+ * This function calculates the line sectors of the traced line in the
+ * grid, which must have the same side boundaries as the one used for
+ * the trace, but it may have different layers. Returns 1 and sets
+ * lineSectors (0 if the line is discarded, see getLineSectorsFromModel())
+ * if the trace covers the layers of the grid, and 0 if it does not (the
+ * upper boundary is higher than the start of the trace, or the side
+ * boundaries are different), in which case the line must be traced again.
+ */
+int getLineSectorsFromHorizontalTrace(HorizontalTrace* trace, QuadraticGrid* grid, LineSectorList** lineSectors);
+
 #endif //IONOSPHERE_GRID_H
\ No newline at end of file
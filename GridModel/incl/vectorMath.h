@@ -0,0 +1,133 @@
+#ifndef VECTOR_MATH_H
+#define VECTOR_MATH_H
+
+#include <math.h>
+#include <immintrin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sine and cosine of "count" angles (radians, |angle| < 1e6). AVX2 is used
+ * if the processor supports it, the vectorized results are within a few
+ * ulps of sin() and cos().
+ */
+void sinCosBatch(int count, const double* angles, double* sines, double* cosines);
+
+//=============================================================
+// Kernels of the AVX2 paths, they process 4 values at once.
+// They may only be called from functions compiled for avx2,fma
+// after checking the processor (see sinCosBatch()).
+//=============================================================
+
+/*
+ * Arctangent of 4 values with the rational approximation of the Cephes
+ * library (double precision after the reduction of the argument).
+ */
+__attribute__((target("avx2,fma")))
+static inline __m256d atanAVX2(__m256d x)
+{
+    __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d sign = _mm256_and_pd(x, signMask);
+    x = _mm256_andnot_pd(signMask, x);
+    //x > tan(3pi/8): atan(x) = pi/2 - atan(1/x)
+    __m256d isLarge = _mm256_cmp_pd(x, _mm256_set1_pd(2.41421356237309504880), _CMP_GT_OQ);
+    //x > 0.66: atan(x) = pi/4 + atan((x-1)/(x+1))
+    __m256d isMedium = _mm256_andnot_pd(isLarge, _mm256_cmp_pd(x, _mm256_set1_pd(0.66), _CMP_GT_OQ));
+    __m256d one = _mm256_set1_pd(1);
+    __m256d reduced = _mm256_blendv_pd(x, _mm256_div_pd(_mm256_sub_pd(x, one), _mm256_add_pd(x, one)), isMedium);
+    reduced = _mm256_blendv_pd(reduced, _mm256_div_pd(_mm256_set1_pd(-1), x), isLarge);
+    __m256d offset = _mm256_blendv_pd(_mm256_setzero_pd(), _mm256_set1_pd(M_PI_4), isMedium);
+    offset = _mm256_blendv_pd(offset, _mm256_set1_pd(M_PI_2), isLarge);
+    __m256d moreBits = _mm256_blendv_pd(_mm256_setzero_pd(), _mm256_set1_pd(0.5 * 6.123233995736765886130E-17), isMedium);
+    moreBits = _mm256_blendv_pd(moreBits, _mm256_set1_pd(6.123233995736765886130E-17), isLarge);
+
+    __m256d z = _mm256_mul_pd(reduced, reduced);
+    __m256d numerator = _mm256_set1_pd(-8.750608600031904122785E-1);
+    numerator = _mm256_fmadd_pd(numerator, z, _mm256_set1_pd(-1.615753718733365076637E1));
+    numerator = _mm256_fmadd_pd(numerator, z, _mm256_set1_pd(-7.500855792314704667340E1));
+    numerator = _mm256_fmadd_pd(numerator, z, _mm256_set1_pd(-1.228866684490136173410E2));
+    numerator = _mm256_fmadd_pd(numerator, z, _mm256_set1_pd(-6.485021904942025371773E1));
+    __m256d denominator = _mm256_add_pd(z, _mm256_set1_pd(2.485846490142306297962E1));
+    denominator = _mm256_fmadd_pd(denominator, z, _mm256_set1_pd(1.650270098316988542046E2));
+    denominator = _mm256_fmadd_pd(denominator, z, _mm256_set1_pd(4.328810604912902668951E2));
+    denominator = _mm256_fmadd_pd(denominator, z, _mm256_set1_pd(4.853903996359136964868E2));
+    denominator = _mm256_fmadd_pd(denominator, z, _mm256_set1_pd(1.945506571482613964425E2));
+    __m256d result = _mm256_mul_pd(z, _mm256_div_pd(numerator, denominator));
+    result = _mm256_fmadd_pd(reduced, result, reduced);
+    result = _mm256_add_pd(offset, _mm256_add_pd(result, moreBits));
+    return _mm256_or_pd(result, sign);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d atan2AVX2(__m256d y, __m256d x)
+{
+    __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d absX = _mm256_andnot_pd(signMask, x);
+    __m256d absY = _mm256_andnot_pd(signMask, y);
+    __m256d isSteep = _mm256_cmp_pd(absY, absX, _CMP_GT_OQ);
+    __m256d numerator = _mm256_min_pd(absX, absY);
+    __m256d denominator = _mm256_max_pd(absX, absY);
+    //atan2(0, 0) = 0
+    denominator = _mm256_blendv_pd(denominator, _mm256_set1_pd(1), _mm256_cmp_pd(denominator, _mm256_setzero_pd(), _CMP_EQ_OQ));
+    __m256d result = atanAVX2(_mm256_div_pd(numerator, denominator));
+    result = _mm256_blendv_pd(result, _mm256_sub_pd(_mm256_set1_pd(M_PI_2), result), isSteep);
+    result = _mm256_blendv_pd(result, _mm256_sub_pd(_mm256_set1_pd(M_PI), result), x);
+    return _mm256_or_pd(result, _mm256_and_pd(y, signMask));
+}
+
+/*
+ * Sine and cosine of 4 values with the polynomials of the Cephes library.
+ * The argument is reduced to [-pi/4, pi/4] by the nearest even multiple
+ * of pi/4 (subtracted in 3 parts), the octant selects the polynomial and
+ * the signs.
+ */
+__attribute__((target("avx2,fma")))
+static inline void sinCosAVX2(__m256d x, __m256d* sine, __m256d* cosine)
+{
+    __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d sign = _mm256_and_pd(x, signMask);
+    x = _mm256_andnot_pd(signMask, x);
+    __m256d octant = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(4 / M_PI)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    //odd octants are rounded up, so the reduced argument is in [-pi/4, pi/4]
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d two = _mm256_set1_pd(2);
+    octant = _mm256_add_pd(octant, _mm256_sub_pd(octant, _mm256_mul_pd(two, _mm256_round_pd(_mm256_mul_pd(octant, half), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC))));
+    __m256d z = _mm256_fnmadd_pd(octant, _mm256_set1_pd(7.85398125648498535156E-1), x);
+    z = _mm256_fnmadd_pd(octant, _mm256_set1_pd(3.77489470793079817668E-8), z);
+    z = _mm256_fnmadd_pd(octant, _mm256_set1_pd(2.69515142907905952645E-15), z);
+    //octant modulo 8: 0, 2, 4 or 6
+    __m256d j = _mm256_fnmadd_pd(_mm256_set1_pd(8), _mm256_round_pd(_mm256_mul_pd(octant, _mm256_set1_pd(0.125)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), octant);
+
+    __m256d zz = _mm256_mul_pd(z, z);
+    __m256d sinPoly = _mm256_set1_pd(1.58962301576546568060E-10);
+    sinPoly = _mm256_fmadd_pd(sinPoly, zz, _mm256_set1_pd(-2.50507477628578072866E-8));
+    sinPoly = _mm256_fmadd_pd(sinPoly, zz, _mm256_set1_pd(2.75573136213857245213E-6));
+    sinPoly = _mm256_fmadd_pd(sinPoly, zz, _mm256_set1_pd(-1.98412698295895385996E-4));
+    sinPoly = _mm256_fmadd_pd(sinPoly, zz, _mm256_set1_pd(8.33333333332211858878E-3));
+    sinPoly = _mm256_fmadd_pd(sinPoly, zz, _mm256_set1_pd(-1.66666666666666307295E-1));
+    sinPoly = _mm256_fmadd_pd(_mm256_mul_pd(z, zz), sinPoly, z);
+    __m256d cosPoly = _mm256_set1_pd(-1.13585365213876817300E-11);
+    cosPoly = _mm256_fmadd_pd(cosPoly, zz, _mm256_set1_pd(2.08757008419747316778E-9));
+    cosPoly = _mm256_fmadd_pd(cosPoly, zz, _mm256_set1_pd(-2.75573141792967388112E-7));
+    cosPoly = _mm256_fmadd_pd(cosPoly, zz, _mm256_set1_pd(2.48015872888517045348E-5));
+    cosPoly = _mm256_fmadd_pd(cosPoly, zz, _mm256_set1_pd(-1.38888888888730564116E-3));
+    cosPoly = _mm256_fmadd_pd(cosPoly, zz, _mm256_set1_pd(4.16666666666665929218E-2));
+    cosPoly = _mm256_fmadd_pd(_mm256_mul_pd(zz, zz), cosPoly, _mm256_fnmadd_pd(half, zz, _mm256_set1_pd(1)));
+
+    //octants 2 and 6 swap the polynomials, 4 and 6 negate the sine, 2 and 4 the cosine
+    __m256d isSwapped = _mm256_or_pd(_mm256_cmp_pd(j, two, _CMP_EQ_OQ), _mm256_cmp_pd(j, _mm256_set1_pd(6), _CMP_EQ_OQ));
+    __m256d isSineNegated = _mm256_cmp_pd(j, _mm256_set1_pd(3), _CMP_GT_OQ);
+    __m256d isCosineNegated = _mm256_or_pd(_mm256_cmp_pd(j, two, _CMP_EQ_OQ), _mm256_cmp_pd(j, _mm256_set1_pd(4), _CMP_EQ_OQ));
+    __m256d s = _mm256_blendv_pd(sinPoly, cosPoly, isSwapped);
+    __m256d c = _mm256_blendv_pd(cosPoly, sinPoly, isSwapped);
+    *sine = _mm256_xor_pd(_mm256_xor_pd(s, _mm256_and_pd(isSineNegated, signMask)), sign);
+    *cosine = _mm256_xor_pd(c, _mm256_and_pd(isCosineNegated, signMask));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //VECTOR_MATH_H
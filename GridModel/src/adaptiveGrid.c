@@ -0,0 +1,348 @@
+#include <adaptiveGrid.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void initAdaptiveGridNode(AdaptiveGridNode* node, int level, double north, double south, double west, double east)
+{
+    memset(node, 0, sizeof(AdaptiveGridNode));
+    node->cellId = -1;
+    node->level = level;
+    node->northLatitude = north;
+    node->southLatitude = south;
+    node->westLongitude = west;
+    node->eastLongitude = east;
+}
+
+void deleteAdaptiveGridNode(AdaptiveGridNode* node)
+{
+    if (node->children)
+    {
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            deleteAdaptiveGridNode(&(node->children[i]));
+        }
+        free(node->children);
+        node->children = 0;
+    }
+}
+
+void initAdaptiveGrid(AdaptiveGrid* grid)
+{
+    memset(grid, 0, sizeof(AdaptiveGrid));
+}
+
+void deleteAdaptiveGrid(AdaptiveGrid* grid)
+{
+    if (grid->roots)
+    {
+        int rootCount = grid->baseGrid->layerNum *
+                        (grid->baseGrid->northNum + grid->baseGrid->southNum) *
+                        (grid->baseGrid->eastNum + grid->baseGrid->westNum);
+        int i;
+        for (i = 0; i < rootCount; i++)
+        {
+            deleteAdaptiveGridNode(&(grid->roots[i]));
+        }
+        free(grid->roots);
+    }
+    if (grid->cells)
+    {
+        free(grid->cells);
+    }
+    initAdaptiveGrid(grid);
+}
+
+//normal of the latitude plane, pointing north
+Vec3 getLatitudeNormal(double latitude, double west, double east)
+{
+    Vec3 normal = vec3Cross(vec3FromVector(geoCoordToWGS84Vector(latitude, west)),
+                            vec3FromVector(geoCoordToWGS84Vector(latitude, east)));
+    return vec3Normalize(normal);
+}
+
+void splitAdaptiveGridNode(AdaptiveGridNode* node)
+{
+    double middleLatitude = (node->northLatitude + node->southLatitude) / 2;
+    double middleLongitude = (node->westLongitude + node->eastLongitude) / 2;
+    node->meridianNormal = vec3(-sin(middleLongitude), cos(middleLongitude), 0);
+    node->westLatitudeNormal = getLatitudeNormal(middleLatitude, node->westLongitude, middleLongitude);
+    node->eastLatitudeNormal = getLatitudeNormal(middleLatitude, middleLongitude, node->eastLongitude);
+    node->children = malloc(sizeof(AdaptiveGridNode) * 4);
+    initAdaptiveGridNode(&(node->children[0]), node->level + 1, node->northLatitude, middleLatitude, node->westLongitude, middleLongitude);
+    initAdaptiveGridNode(&(node->children[1]), node->level + 1, node->northLatitude, middleLatitude, middleLongitude, node->eastLongitude);
+    initAdaptiveGridNode(&(node->children[2]), node->level + 1, middleLatitude, node->southLatitude, node->westLongitude, middleLongitude);
+    initAdaptiveGridNode(&(node->children[3]), node->level + 1, middleLatitude, node->southLatitude, middleLongitude, node->eastLongitude);
+    node->cellId = -1;
+}
+
+void mergeAdaptiveGridNode(AdaptiveGridNode* node)
+{
+    deleteAdaptiveGridNode(node);
+    node->isMerged = 1;
+}
+
+//depth first, northwest->southeast numbering of the leaves
+void numberAdaptiveGridNode(AdaptiveGridNode* node, AdaptiveGrid* grid)
+{
+    node->rayCount = 0;
+    if (node->children)
+    {
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            numberAdaptiveGridNode(&(node->children[i]), grid);
+        }
+        return;
+    }
+    node->cellId = grid->cellCount;
+    grid->cells[grid->cellCount] = node;
+    grid->cellCount++;
+}
+
+int countAdaptiveGridLeaves(AdaptiveGridNode* node)
+{
+    if (!node->children)
+    {
+        return 1;
+    }
+    int count = 0;
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        count += countAdaptiveGridLeaves(&(node->children[i]));
+    }
+    return count;
+}
+
+void numberAdaptiveGridCells(AdaptiveGrid* grid)
+{
+    int rootCount = grid->baseGrid->layerNum *
+                    (grid->baseGrid->northNum + grid->baseGrid->southNum) *
+                    (grid->baseGrid->eastNum + grid->baseGrid->westNum);
+    int leafCount = 0;
+    int i;
+    for (i = 0; i < rootCount; i++)
+    {
+        leafCount += countAdaptiveGridLeaves(&(grid->roots[i]));
+    }
+    if (grid->cells)
+    {
+        free(grid->cells);
+    }
+    grid->cells = malloc(sizeof(AdaptiveGridNode*) * leafCount);
+    grid->cellCount = 0;
+    for (i = 0; i < rootCount; i++)
+    {
+        numberAdaptiveGridNode(&(grid->roots[i]), grid);
+    }
+}
+
+AdaptiveGrid createAdaptiveGrid(QuadraticGrid* baseGrid)
+{
+    AdaptiveGrid grid;
+    initAdaptiveGrid(&grid);
+    grid.baseGrid = baseGrid;
+    int latCount = baseGrid->northNum + baseGrid->southNum;
+    int longCount = baseGrid->eastNum + baseGrid->westNum;
+    grid.roots = malloc(sizeof(AdaptiveGridNode) * baseGrid->layerNum * latCount * longCount);
+    int i;
+    for (i = 0; i < baseGrid->layerNum; i++)
+    {
+        int j;
+        for (j = 0; j < latCount; j++)
+        {
+            int k;
+            for (k = 0; k < longCount; k++)
+            {
+                initAdaptiveGridNode(&(grid.roots[getSingleCellIDByIndexes(i, j, k, baseGrid)]), 0,
+                                     baseGrid->boundaryLatitudes[j], baseGrid->boundaryLatitudes[j + 1],
+                                     baseGrid->boundaryLongitudes[k], baseGrid->boundaryLongitudes[k + 1]);
+            }
+        }
+    }
+    numberAdaptiveGridCells(&grid);
+    return grid;
+}
+
+/*
+ * Splits the segment entry->exit by the plane through the origo with the
+ * given normal. Returns 1 and sets "middle" if the segment crosses the
+ * plane farther than epsilon from its ends.
+ */
+int splitSegmentByPlane(Vec3 entry, Vec3 exit, Vec3 normal, Vec3* middle)
+{
+    double entrySide = vec3Dot(normal, entry);
+    double exitSide = vec3Dot(normal, exit);
+    if ((entrySide > 0) == (exitSide > 0))
+    {
+        return 0;
+    }
+    double ratio = entrySide / (entrySide - exitSide);
+    double length = vec3Length(vec3Subtract(exit, entry));
+    if (ratio * length < epsilon || (1 - ratio) * length < epsilon)
+    {
+        return 0;
+    }
+    *middle = vec3MultiplyAdd(entry, ratio, vec3Subtract(exit, entry));
+    return 1;
+}
+
+LineSectorList* appendAdaptiveLineSector(LineSectorList* baseSector, AdaptiveGridNode* node, Vec3 entry, Vec3 exit, LineSectorList*** lastLineSector);
+
+//appends the sectors of the segment inside the node in entry->exit order
+void splitSegmentByNode(LineSectorList* baseSector, AdaptiveGridNode* node, Vec3 entry, Vec3 exit, LineSectorList*** lastLineSector)
+{
+    if (!node->children)
+    {
+        appendAdaptiveLineSector(baseSector, node, entry, exit, lastLineSector);
+        return;
+    }
+    Vec3 points[5];
+    int pointCount = 0;
+    points[pointCount++] = entry;
+    Vec3 middle;
+    if (splitSegmentByPlane(entry, exit, node->meridianNormal, &middle))
+    {
+        points[pointCount++] = middle;
+    }
+    points[pointCount++] = exit;
+
+    int i;
+    for (i = 0; i < pointCount - 1; i++)
+    {
+        Vec3 halfEntry = points[i];
+        Vec3 halfExit = points[i + 1];
+        Vec3 halfMiddle = vec3Scale(0.5, vec3Add(halfEntry, halfExit));
+        int isEast = vec3Dot(node->meridianNormal, halfMiddle) > 0;
+        Vec3 latitudeNormal = isEast ? node->eastLatitudeNormal : node->westLatitudeNormal;
+        Vec3 quarterPoints[3];
+        int quarterPointCount = 0;
+        quarterPoints[quarterPointCount++] = halfEntry;
+        if (splitSegmentByPlane(halfEntry, halfExit, latitudeNormal, &middle))
+        {
+            quarterPoints[quarterPointCount++] = middle;
+        }
+        quarterPoints[quarterPointCount++] = halfExit;
+        int j;
+        for (j = 0; j < quarterPointCount - 1; j++)
+        {
+            Vec3 quarterMiddle = vec3Scale(0.5, vec3Add(quarterPoints[j], quarterPoints[j + 1]));
+            int isNorth = vec3Dot(latitudeNormal, quarterMiddle) > 0;
+            AdaptiveGridNode* child = &(node->children[(isNorth ? 0 : 2) + (isEast ? 1 : 0)]);
+            splitSegmentByNode(baseSector, child, quarterPoints[j], quarterPoints[j + 1], lastLineSector);
+        }
+    }
+}
+
+LineSectorList* appendAdaptiveLineSector(LineSectorList* baseSector, AdaptiveGridNode* node, Vec3 entry, Vec3 exit, LineSectorList*** lastLineSector)
+{
+    LineSectorList* lsl = malloc(sizeof(LineSectorList));
+    initLineSectorList(lsl);
+    lsl->layerId = baseSector->layerId;
+    lsl->lateralId = baseSector->lateralId;
+    lsl->longitudinalId = baseSector->longitudinalId;
+    lsl->cellId = node->cellId;
+    lsl->cellIntersectionEntry = entry;
+    lsl->cellIntersectionExit = exit;
+    lsl->length = vec3Length(vec3Subtract(exit, entry));
+    **lastLineSector = lsl;
+    *lastLineSector = &(lsl->next);
+    return lsl;
+}
+
+LineSectorList* splitLineSectorsByAdaptiveGrid(LineSectorList* baseSectors, AdaptiveGrid* grid)
+{
+    LineSectorList* result = 0;
+    LineSectorList** lastLineSector = &result;
+    LineSectorList* baseSector;
+    for (baseSector = baseSectors; baseSector; baseSector = baseSector->next)
+    {
+        int baseCellId = getSingleCellIDByIndexes(baseSector->layerId, baseSector->lateralId, baseSector->longitudinalId, grid->baseGrid);
+        AdaptiveGridNode* root = &(grid->roots[baseCellId]);
+        if (!root->children)
+        {
+            //unsplit cell, the base sector is kept as it is
+            LineSectorList* lsl = appendAdaptiveLineSector(baseSector, root, baseSector->cellIntersectionEntry,
+                                                           baseSector->cellIntersectionExit, &lastLineSector);
+            lsl->length = baseSector->length;
+            continue;
+        }
+        splitSegmentByNode(baseSector, root, baseSector->cellIntersectionEntry, baseSector->cellIntersectionExit, &lastLineSector);
+    }
+    return result;
+}
+
+LineSectorList* getLineSectorsFromAdaptiveGrid(Vector satPos, Vector recPos, AdaptiveGrid* grid)
+{
+    LineSectorList* baseSectors = getLineSectorsFromModel(satPos, recPos, grid->baseGrid);
+    LineSectorList* result = splitLineSectorsByAdaptiveGrid(baseSectors, grid);
+    deleteLineSectorList(&baseSectors);
+    return result;
+}
+
+void addAdaptiveGridRayCounts(LineSectorList* lineSectors, AdaptiveGrid* grid)
+{
+    int lastCellId = -1;
+    while (lineSectors)
+    {
+        //a ray is counted once even if it leaves a cell and enters it again
+        if (lineSectors->cellId != lastCellId)
+        {
+            grid->cells[lineSectors->cellId]->rayCount++;
+            lastCellId = lineSectors->cellId;
+        }
+        lineSectors = lineSectors->next;
+    }
+}
+
+int refineAdaptiveGridNode(AdaptiveGridNode* node, int splitRayCount, int mergeRayCount, int maxLevel)
+{
+    if (!node->children)
+    {
+        if (node->rayCount > splitRayCount && node->level < maxLevel && !node->isMerged)
+        {
+            splitAdaptiveGridNode(node);
+            return 1;
+        }
+        return 0;
+    }
+    int changeCount = 0;
+    int isMergeable = 1;
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        AdaptiveGridNode* child = &(node->children[i]);
+        if (child->children || child->rayCount >= mergeRayCount)
+        {
+            isMergeable = 0;
+        }
+    }
+    if (isMergeable)
+    {
+        mergeAdaptiveGridNode(node);
+        return 1;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        changeCount += refineAdaptiveGridNode(&(node->children[i]), splitRayCount, mergeRayCount, maxLevel);
+    }
+    return changeCount;
+}
+
+int refineAdaptiveGrid(AdaptiveGrid* grid, int splitRayCount, int mergeRayCount, int maxLevel)
+{
+    int rootCount = grid->baseGrid->layerNum *
+                    (grid->baseGrid->northNum + grid->baseGrid->southNum) *
+                    (grid->baseGrid->eastNum + grid->baseGrid->westNum);
+    int changeCount = 0;
+    int i;
+    for (i = 0; i < rootCount; i++)
+    {
+        changeCount += refineAdaptiveGridNode(&(grid->roots[i]), splitRayCount, mergeRayCount, maxLevel);
+    }
+    numberAdaptiveGridCells(grid);
+    return changeCount;
+}
@@ -0,0 +1,199 @@
+#include <cellCoverage.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void initGridCoverage(GridCoverage* coverage, int cellCount)
+{
+    coverage->cellCount = cellCount;
+    coverage->cells = malloc(sizeof(CellCoverage) * cellCount);
+    memset(coverage->cells, 0, sizeof(CellCoverage) * cellCount);
+}
+
+void deleteGridCoverage(GridCoverage* coverage)
+{
+    if (coverage->cells)
+    {
+        free(coverage->cells);
+    }
+    memset(coverage, 0, sizeof(GridCoverage));
+}
+
+void addLineSectorsToCoverage(GridCoverage* coverage, CompactLineSectors* lineSectors)
+{
+    int lastCellId = -1;
+    int i;
+    for (i = 0; i < lineSectors->count; i++)
+    {
+        int cellId = lineSectors->sectors[i].cellId;
+        CellCoverage* cellCoverage = &(coverage->cells[cellId]);
+        if (cellId != lastCellId)
+        {
+            cellCoverage->rayCount++;
+            cellCoverage->directionSum = vec3Add(cellCoverage->directionSum, lineSectors->direction);
+            lastCellId = cellId;
+        }
+        cellCoverage->pathLength += lineSectors->sectors[i].length;
+    }
+}
+
+double getCellAngularDiversity(CellCoverage* cellCoverage)
+{
+    if (!cellCoverage->rayCount)
+    {
+        return 0;
+    }
+    double diversity = 1 - vec3Length(cellCoverage->directionSum) / cellCoverage->rayCount;
+    return diversity < 0 ? 0 : diversity;
+}
+
+int writeGridCoverageReport(GridCoverage* coverage, char* reportFile)
+{
+    FILE* file = fopen(reportFile, "w");
+    if (!file)
+    {
+        printf("Can not open coverage report file %s\n", reportFile);
+        return 0;
+    }
+    int crossedCount = 0;
+    int i;
+    for (i = 0; i < coverage->cellCount; i++)
+    {
+        if (coverage->cells[i].rayCount)
+        {
+            crossedCount++;
+        }
+    }
+    fprintf(file, "# cells: %d,    crossed: %d,    never crossed: %d\n", coverage->cellCount, crossedCount, coverage->cellCount - crossedCount);
+    fprintf(file, "# cellId rayCount pathLength[km] angularDiversity\n");
+    for (i = 0; i < coverage->cellCount; i++)
+    {
+        CellCoverage* cellCoverage = &(coverage->cells[i]);
+        if (!cellCoverage->rayCount)
+        {
+            continue;
+        }
+        fprintf(file, "%d %d %.3lf %.6lf\n", i, cellCoverage->rayCount, cellCoverage->pathLength / 1000, getCellAngularDiversity(cellCoverage));
+    }
+    fclose(file);
+    return 1;
+}
+
+int isCellObservable(CellCoverage* cellCoverage, int minRayCount, double minDiversity)
+{
+    return cellCoverage->rayCount >= minRayCount && getCellAngularDiversity(cellCoverage) >= minDiversity;
+}
+
+typedef struct MergeCandidate
+{
+    int cellId;
+    int rayCount;
+}MergeCandidate;
+
+int compareMergeCandidates(const void* a, const void* b)
+{
+    const MergeCandidate* first = a;
+    const MergeCandidate* second = b;
+    if (first->rayCount != second->rayCount)
+    {
+        return first->rayCount - second->rayCount;
+    }
+    return first->cellId - second->cellId;
+}
+
+//the cell whose unknown is used for the given cell
+int getMergedCell(int cellId, int* cellMapping)
+{
+    while (cellMapping[cellId] != cellId)
+    {
+        cellId = cellMapping[cellId];
+    }
+    return cellId;
+}
+
+int mergeUnobservableCells(GridCoverage* coverage, QuadraticGrid* grid, int minRayCount, double minDiversity, int* cellMapping)
+{
+    int cellCount = grid->layerNum * (grid->northNum + grid->southNum) * (grid->eastNum + grid->westNum);
+    if (coverage->cellCount != cellCount)
+    {
+        printf("The coverage does not belong to the grid, cell count: %d,    grid cell count: %d\n", coverage->cellCount, cellCount);
+        exit(-1);
+    }
+    MergeCandidate* candidates = malloc(sizeof(MergeCandidate) * cellCount);
+    int candidateCount = 0;
+    int i;
+    for (i = 0; i < cellCount; i++)
+    {
+        cellMapping[i] = i;
+        if (coverage->cells[i].rayCount && !isCellObservable(&(coverage->cells[i]), minRayCount, minDiversity))
+        {
+            candidates[candidateCount].cellId = i;
+            candidates[candidateCount].rayCount = coverage->cells[i].rayCount;
+            candidateCount++;
+        }
+    }
+    //the least crossed cells are merged first
+    qsort(candidates, candidateCount, sizeof(MergeCandidate), compareMergeCandidates);
+
+    int* neighborIds = malloc(sizeof(int) * getMaxLineSectorCellNeighborCount(grid));
+    int* isVertical = malloc(sizeof(int) * getMaxLineSectorCellNeighborCount(grid));
+    int mergedCount = 0;
+    for (i = 0; i < candidateCount; i++)
+    {
+        int cellId = candidates[i].cellId;
+        CellCoverage* cellCoverage = &(coverage->cells[cellId]);
+        //it may have become observable by the cells merged into it
+        if (isCellObservable(cellCoverage, minRayCount, minDiversity))
+        {
+            continue;
+        }
+        //the coverage is counted for the line sector cells, a polar cap is one cell
+        int neighborCount = getLineSectorCellNeighbors(cellId, grid, neighborIds, isVertical);
+        int target = -1;
+        int isTargetVertical = 0;
+        int j;
+        for (j = 0; j < neighborCount; j++)
+        {
+            int neighborId = getMergedCell(neighborIds[j], cellMapping);
+            if (neighborId == cellId || !isCellObservable(&(coverage->cells[neighborId]), minRayCount, minDiversity))
+            {
+                continue;
+            }
+            //vertical neighbors first, than the most crossed one
+            if (target < 0 || isVertical[j] > isTargetVertical ||
+                (isVertical[j] == isTargetVertical && coverage->cells[neighborId].rayCount > coverage->cells[target].rayCount))
+            {
+                target = neighborId;
+                isTargetVertical = isVertical[j];
+            }
+        }
+        if (target < 0)
+        {
+            continue;
+        }
+        CellCoverage* targetCoverage = &(coverage->cells[target]);
+        targetCoverage->rayCount += cellCoverage->rayCount;
+        targetCoverage->pathLength += cellCoverage->pathLength;
+        targetCoverage->directionSum = vec3Add(targetCoverage->directionSum, cellCoverage->directionSum);
+        memset(cellCoverage, 0, sizeof(CellCoverage));
+        cellMapping[cellId] = target;
+        mergedCount++;
+    }
+    for (i = 0; i < cellCount; i++)
+    {
+        cellMapping[i] = getMergedCell(i, cellMapping);
+    }
+    free(neighborIds);
+    free(isVertical);
+    free(candidates);
+    return mergedCount;
+}
+
+void applyCellMapping(CompactLineSectors* lineSectors, int* cellMapping)
+{
+    int i;
+    for (i = 0; i < lineSectors->count; i++)
+    {
+        lineSectors->sectors[i].cellId = cellMapping[lineSectors->sectors[i].cellId];
+    }
+}
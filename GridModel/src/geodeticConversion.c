@@ -0,0 +1,117 @@
+#include <geodeticConversion.h>
+#include <vectorMath.h>
+#include <math.h>
+#include <immintrin.h>
+
+void geodeticToECEF(double latitude, double longitude, double height, double a, double e, double* x, double* y, double* z)
+{
+    double e2 = e * e;
+    double sinLatitude = sin(latitude);
+    double cosLatitude = cos(latitude);
+    //radius of curvature in the prime vertical
+    double n = a / sqrt(1 - e2 * sinLatitude * sinLatitude);
+    *x = (n + height) * cosLatitude * cos(longitude);
+    *y = (n + height) * cosLatitude * sin(longitude);
+    *z = (n * (1 - e2) + height) * sinLatitude;
+}
+
+void ecefToGeodetic(double x, double y, double z, double a, double e, double* latitude, double* longitude, double* height)
+{
+    double e2 = e * e;
+    double e4 = e2 * e2;
+    double horizontal2 = x * x + y * y;
+    double p = horizontal2 / (a * a);
+    double q = (1 - e2) / (a * a) * z * z;
+    double r = (p + q - e4) / 6;
+    double s = e4 * p * q / (4 * r * r * r);
+    double t = cbrt(1 + s + sqrt(s * (2 + s)));
+    double u = r * (1 + t + 1 / t);
+    double v = sqrt(u * u + e4 * q);
+    double w = e2 * (u + v - q) / (2 * v);
+    double k = sqrt(u + v + w * w) - w;
+    double d = k * sqrt(horizontal2) / (k + e2);
+    double dz = sqrt(d * d + z * z);
+    *latitude = 2 * atan(z / (d + dz));
+    *longitude = atan2(y, x);
+    *height = (k + e2 - 1) / k * dz;
+}
+
+void ecefToGeodeticBatchScalar(int start, int count, const double* x, const double* y, const double* z, double a, double e,
+                               double* latitude, double* longitude, double* height)
+{
+    int i;
+    for (i = start; i < count; i++)
+    {
+        ecefToGeodetic(x[i], y[i], z[i], a, e, &(latitude[i]), &(longitude[i]), &(height[i]));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void ecefToGeodeticBatchAVX2(int count, const double* x, const double* y, const double* z, double a, double e,
+                             double* latitude, double* longitude, double* height)
+{
+    double e2Scalar = e * e;
+    __m256d e2 = _mm256_set1_pd(e2Scalar);
+    __m256d e4 = _mm256_set1_pd(e2Scalar * e2Scalar);
+    __m256d invA2 = _mm256_set1_pd(1 / (a * a));
+    __m256d oneMinusE2PerA2 = _mm256_set1_pd((1 - e2Scalar) / (a * a));
+    __m256d one = _mm256_set1_pd(1);
+    __m256d two = _mm256_set1_pd(2);
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d third = _mm256_set1_pd(1.0 / 3);
+    __m256d sixth = _mm256_set1_pd(1.0 / 6);
+    //the cube root is calculated by Newton iterations for 1 <= c <= cbrtLimit
+    __m256d cbrtLimit = _mm256_set1_pd(2);
+    int i;
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        __m256d px = _mm256_loadu_pd(x + i);
+        __m256d py = _mm256_loadu_pd(y + i);
+        __m256d pz = _mm256_loadu_pd(z + i);
+        __m256d horizontal2 = _mm256_fmadd_pd(px, px, _mm256_mul_pd(py, py));
+        __m256d p = _mm256_mul_pd(horizontal2, invA2);
+        __m256d q = _mm256_mul_pd(oneMinusE2PerA2, _mm256_mul_pd(pz, pz));
+        __m256d r = _mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(p, q), e4), sixth);
+        __m256d s = _mm256_div_pd(_mm256_mul_pd(e4, _mm256_mul_pd(p, q)), _mm256_mul_pd(_mm256_set1_pd(4), _mm256_mul_pd(r, _mm256_mul_pd(r, r))));
+        __m256d c = _mm256_add_pd(_mm256_add_pd(one, s), _mm256_sqrt_pd(_mm256_mul_pd(s, _mm256_add_pd(two, s))));
+        //points near the center of the earth, where c is large
+        if (_mm256_movemask_pd(_mm256_cmp_pd(c, cbrtLimit, _CMP_GT_OQ)))
+        {
+            ecefToGeodeticBatchScalar(i, i + 4, x, y, z, a, e, latitude, longitude, height);
+            continue;
+        }
+        //the tangent at 1 is above the root, the iterations converge from above
+        __m256d t = _mm256_fmadd_pd(_mm256_sub_pd(c, one), third, one);
+        int j;
+        for (j = 0; j < 5; j++)
+        {
+            __m256d t2 = _mm256_mul_pd(t, t);
+            t = _mm256_sub_pd(t, _mm256_div_pd(_mm256_fmsub_pd(t2, t, c), _mm256_mul_pd(_mm256_set1_pd(3), t2)));
+        }
+        __m256d u = _mm256_mul_pd(r, _mm256_add_pd(_mm256_add_pd(one, t), _mm256_div_pd(one, t)));
+        __m256d v = _mm256_sqrt_pd(_mm256_fmadd_pd(u, u, _mm256_mul_pd(e4, q)));
+        __m256d w = _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(e2, half), _mm256_sub_pd(_mm256_add_pd(u, v), q)), v);
+        __m256d k = _mm256_sub_pd(_mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(u, v), _mm256_mul_pd(w, w))), w);
+        __m256d d = _mm256_div_pd(_mm256_mul_pd(k, _mm256_sqrt_pd(horizontal2)), _mm256_add_pd(k, e2));
+        __m256d dz = _mm256_sqrt_pd(_mm256_fmadd_pd(d, d, _mm256_mul_pd(pz, pz)));
+        __m256d lat = _mm256_mul_pd(two, atanAVX2(_mm256_div_pd(pz, _mm256_add_pd(d, dz))));
+        __m256d h = _mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(_mm256_add_pd(k, e2), one), k), dz);
+        _mm256_storeu_pd(latitude + i, lat);
+        _mm256_storeu_pd(longitude + i, atan2AVX2(py, px));
+        _mm256_storeu_pd(height + i, h);
+    }
+    ecefToGeodeticBatchScalar(i, count, x, y, z, a, e, latitude, longitude, height);
+}
+
+void ecefToGeodeticBatch(int count, const double* x, const double* y, const double* z, double a, double e,
+                         double* latitude, double* longitude, double* height)
+{
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        ecefToGeodeticBatchAVX2(count, x, y, z, a, e, latitude, longitude, height);
+    }
+    else
+    {
+        ecefToGeodeticBatchScalar(0, count, x, y, z, a, e, latitude, longitude, height);
+    }
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <immintrin.h>
 
 double calculateVectorLength(Vector v)
 {
@@ -110,6 +111,8 @@ Spheroid createSpheroid(Vector center, double p1, double p2, int mode)
         sph.b = p2;
         sph.e = calculateSpheroidEccentricity(sph.a, sph.b);
     }
+    sph.invA2 = 1 / (sph.a * sph.a);
+    sph.invB2 = 1 / (sph.b * sph.b);
     return sph;
 }
 
@@ -135,7 +138,7 @@ double checkVectorAgainstPlane(Vector v, Plane p)
 
 double checkVectorAgainstSpheroid(Vector v, Spheroid s)
 {
-    double retVal = (pow(v.x, 2) + pow(v.y, 2)) / pow(s.a, 2) + pow(v.z, 2) / pow(s.b, 2) - 1;
+    double retVal = (v.x * v.x + v.y * v.y) * s.invA2 + v.z * v.z * s.invB2 - 1;
     if (retVal < epsilon && retVal > -epsilon)
     {
         retVal = 0;
@@ -194,29 +197,178 @@ int solveSecondDegreePolyReal(double a, double b, double c, double* results)
 //the caller allocates memory for results
 int intersectLineSpheroid(Line l, Spheroid s, Vector* results)
 {
-    double a = (pow((l.p2.x - l.p1.x), 2) +
-               pow((l.p2.y - l.p1.y), 2)) / pow(s.a, 2) +
-               pow((l.p2.z - l.p1.z), 2) / pow(s.b, 2);
-    double b = 2 * (((l.p2.x - l.p1.x) * l.p1.x +
-               (l.p2.y - l.p1.y) * l.p1.y) / pow(s.a, 2) +
-               ((l.p2.z - l.p1.z) * l.p1.z) / pow(s.b, 2));
-    double c = (pow(l.p1.x, 2) + pow(l.p1.y, 2)) / pow(s.a, 2) +
-               pow(l.p1.z, 2) / pow(s.b, 2) - 1;
+    double dx = l.p2.x - l.p1.x;
+    double dy = l.p2.y - l.p1.y;
+    double dz = l.p2.z - l.p1.z;
+    double a = (dx * dx + dy * dy) * s.invA2 + dz * dz * s.invB2;
+    double b = 2 * ((dx * l.p1.x + dy * l.p1.y) * s.invA2 + dz * l.p1.z * s.invB2);
+    double c = (l.p1.x * l.p1.x + l.p1.y * l.p1.y) * s.invA2 + l.p1.z * l.p1.z * s.invB2 - 1;
     double t[2];
     int resultNum = solveSecondDegreePolyReal(a, b, c, t);
-    if (resultNum == 0)
+    int i;
+    for (i = 0; i < resultNum; i++)
+    {
+        results[i] = createVector(l.p1.x + t[i] * dx, l.p1.y + t[i] * dy, l.p1.z + t[i] * dz);
+    }
+    return resultNum;
+}
+
+Ray createRay(Vec3 p1, Vec3 p2)
+{
+    Ray r;
+    r.origin = p1;
+    r.direction = vec3Normalize(vec3Subtract(p2, p1));
+    return r;
+}
+
+int intersectRaySpheroidDistances(Ray r, Spheroid* s, double* distances)
+{
+    Vec3 p = r.origin;
+    Vec3 d = r.direction;
+    double a = (d.x * d.x + d.y * d.y) * s->invA2 + d.z * d.z * s->invB2;
+    double b = 2 * ((d.x * p.x + d.y * p.y) * s->invA2 + d.z * p.z * s->invB2);
+    double c = (p.x * p.x + p.y * p.y) * s->invA2 + p.z * p.z * s->invB2 - 1;
+    double discriminant = b * b - 4 * a * c;
+    if (discriminant < 0)
     {
         return 0;
     }
-    results[0] = addVector(l.p1, scalarVectorMult(t[0], subtractVector(l.p1, l.p2)));
-    if (resultNum == 1)
+    if (discriminant == 0)
     {
+        distances[0] = - b / (2 * a);
         return 1;
     }
-    results[1] = addVector(l.p1, scalarVectorMult(t[1], subtractVector(l.p1, l.p2)));
+    double sqrtDiscriminant = sqrt(discriminant);
+    distances[0] = (- b - sqrtDiscriminant) / (2 * a);
+    distances[1] = (- b + sqrtDiscriminant) / (2 * a);
     return 2;
 }
 
+int intersectLineSpheroidDistances(Line l, Spheroid* s, double* distances)
+{
+    Ray r = {vec3FromVector(l.p1), vec3FromVector(l.orientation)};
+    return intersectRaySpheroidDistances(r, s, distances);
+}
+
+int intersectLinePlaneDistance(Line l, Plane* p, double* distance)
+{
+    double denom = dotProduct(p->normal, l.orientation);
+    double isPlanePoint = -dotProduct(p->normal, l.p1) - p->d;
+    if (denom < epsilon && denom > -epsilon)
+    {
+        //the line is on the plane
+        if (isPlanePoint < epsilon && isPlanePoint > -epsilon)
+        {
+            return 1;
+        }
+        return 2;
+    }
+    *distance = isPlanePoint / denom;
+    return 0;
+}
+
+void initLineBatch(LineBatch* batch, int count)
+{
+    memset(batch, 0, sizeof(LineBatch));
+    batch->count = count;
+    //one block, 32 byte aligned rows for the vector loads
+    int rowLength = (count + 3) & ~3;
+    double* block = aligned_alloc(32, sizeof(double) * 6 * (rowLength > 0 ? rowLength : 4));
+    batch->px = block;
+    batch->py = block + rowLength;
+    batch->pz = block + 2 * rowLength;
+    batch->dx = block + 3 * rowLength;
+    batch->dy = block + 4 * rowLength;
+    batch->dz = block + 5 * rowLength;
+}
+
+void deleteLineBatch(LineBatch* batch)
+{
+    if (batch->px)
+    {
+        free(batch->px);
+    }
+    memset(batch, 0, sizeof(LineBatch));
+}
+
+void setLineBatchElement(LineBatch* batch, int index, Line l)
+{
+    batch->px[index] = l.p1.x;
+    batch->py[index] = l.p1.y;
+    batch->pz[index] = l.p1.z;
+    batch->dx[index] = l.orientation.x;
+    batch->dy[index] = l.orientation.y;
+    batch->dz[index] = l.orientation.z;
+}
+
+void intersectLineBatchSpheroidScalar(LineBatch* batch, Spheroid* s, double* nearDistances, double* farDistances, int start)
+{
+    int i;
+    for (i = start; i < batch->count; i++)
+    {
+        double a = (batch->dx[i] * batch->dx[i] + batch->dy[i] * batch->dy[i]) * s->invA2 + batch->dz[i] * batch->dz[i] * s->invB2;
+        double b = 2 * ((batch->dx[i] * batch->px[i] + batch->dy[i] * batch->py[i]) * s->invA2 + batch->dz[i] * batch->pz[i] * s->invB2);
+        double c = (batch->px[i] * batch->px[i] + batch->py[i] * batch->py[i]) * s->invA2 + batch->pz[i] * batch->pz[i] * s->invB2 - 1;
+        double discriminant = b * b - 4 * a * c;
+        if (discriminant < 0)
+        {
+            nearDistances[i] = NAN;
+            farDistances[i] = NAN;
+            continue;
+        }
+        double sqrtDiscriminant = sqrt(discriminant);
+        nearDistances[i] = (- b - sqrtDiscriminant) / (2 * a);
+        farDistances[i] = (- b + sqrtDiscriminant) / (2 * a);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void intersectLineBatchSpheroidAVX2(LineBatch* batch, Spheroid* s, double* nearDistances, double* farDistances)
+{
+    __m256d invA2 = _mm256_set1_pd(s->invA2);
+    __m256d invB2 = _mm256_set1_pd(s->invB2);
+    __m256d one = _mm256_set1_pd(1);
+    __m256d two = _mm256_set1_pd(2);
+    __m256d four = _mm256_set1_pd(4);
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d nan = _mm256_set1_pd(NAN);
+    int i;
+    for (i = 0; i + 4 <= batch->count; i += 4)
+    {
+        __m256d px = _mm256_load_pd(batch->px + i);
+        __m256d py = _mm256_load_pd(batch->py + i);
+        __m256d pz = _mm256_load_pd(batch->pz + i);
+        __m256d dx = _mm256_load_pd(batch->dx + i);
+        __m256d dy = _mm256_load_pd(batch->dy + i);
+        __m256d dz = _mm256_load_pd(batch->dz + i);
+        __m256d a = _mm256_fmadd_pd(_mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy)), invA2, _mm256_mul_pd(_mm256_mul_pd(dz, dz), invB2));
+        __m256d b = _mm256_mul_pd(two, _mm256_fmadd_pd(_mm256_fmadd_pd(dx, px, _mm256_mul_pd(dy, py)), invA2, _mm256_mul_pd(_mm256_mul_pd(dz, pz), invB2)));
+        __m256d c = _mm256_sub_pd(_mm256_fmadd_pd(_mm256_fmadd_pd(px, px, _mm256_mul_pd(py, py)), invA2, _mm256_mul_pd(_mm256_mul_pd(pz, pz), invB2)), one);
+        __m256d discriminant = _mm256_fmsub_pd(b, b, _mm256_mul_pd(four, _mm256_mul_pd(a, c)));
+        __m256d isHit = _mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ);
+        __m256d sqrtDiscriminant = _mm256_sqrt_pd(_mm256_max_pd(discriminant, zero));
+        __m256d inv2A = _mm256_div_pd(half, a);
+        __m256d nearDistance = _mm256_mul_pd(_mm256_sub_pd(_mm256_sub_pd(zero, b), sqrtDiscriminant), inv2A);
+        __m256d farDistance = _mm256_mul_pd(_mm256_add_pd(_mm256_sub_pd(zero, b), sqrtDiscriminant), inv2A);
+        _mm256_storeu_pd(nearDistances + i, _mm256_blendv_pd(nan, nearDistance, isHit));
+        _mm256_storeu_pd(farDistances + i, _mm256_blendv_pd(nan, farDistance, isHit));
+    }
+    intersectLineBatchSpheroidScalar(batch, s, nearDistances, farDistances, i);
+}
+
+void intersectLineBatchSpheroid(LineBatch* batch, Spheroid* s, double* nearDistances, double* farDistances)
+{
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        intersectLineBatchSpheroidAVX2(batch, s, nearDistances, farDistances);
+    }
+    else
+    {
+        intersectLineBatchSpheroidScalar(batch, s, nearDistances, farDistances, 0);
+    }
+}
+
 void initTesseroid(Tesseroid* t)
 {
     memset(t, 0, sizeof(Tesseroid));
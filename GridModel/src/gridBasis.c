@@ -0,0 +1,102 @@
+#include <math.h>
+#include "gridBasis.h"
+#include "geodeticConversion.h"
+
+int getQuadraticGridNodeCount(QuadraticGrid* grid)
+{
+    return (grid->layerNum + 1) * (grid->northNum + grid->southNum + 1) * (grid->eastNum + grid->westNum + 1);
+}
+
+int getSingleNodeIDByIndexes(int layerBoundaryId, int latitudeBoundaryId, int longitudeBoundaryId, QuadraticGrid* grid)
+{
+    int latCount = grid->northNum + grid->southNum + 1;
+    int longCount = grid->eastNum + grid->westNum + 1;
+    if (isPoleLatitude(grid->boundaryLatitudes[latitudeBoundaryId]))
+    {
+        longitudeBoundaryId = 0;
+    }
+    //the seam of a grid reaching across the globe
+    else if (longitudeBoundaryId == longCount - 1 && grid->westNum * grid->longitudeUnit >= M_PI)
+    {
+        longitudeBoundaryId = 0;
+    }
+    return layerBoundaryId * latCount * longCount + latitudeBoundaryId * longCount + longitudeBoundaryId;
+}
+
+double clampUnit(double value)
+{
+    return value < 0 ? 0 : (value > 1 ? 1 : value);
+}
+
+//local coordinates of a point inside the cell: north, east and up fractions
+void getCellLocalCoordinates(Vec3 point, LineSectorList* lsl, QuadraticGrid* grid, double* local)
+{
+    double latitude, longitude, height;
+    ecefToGeodetic(point.x, point.y, point.z, WGS84_Spheroid.a, WGS84_Spheroid.e, &latitude, &longitude, &height);
+    double southLatitude = grid->boundaryLatitudes[lsl->lateralId + 1];
+    double northLatitude = grid->boundaryLatitudes[lsl->lateralId];
+    local[0] = clampUnit((latitude - southLatitude) / (northLatitude - southLatitude));
+    double westLongitude = grid->boundaryLongitudes[lsl->longitudinalId];
+    double eastLongitude = grid->boundaryLongitudes[lsl->longitudinalId + 1];
+    double fromWest = remainder(longitude - westLongitude, 2 * M_PI);
+    if (fromWest < -M_PI/2)
+    {
+        fromWest += 2 * M_PI;
+    }
+    local[1] = clampUnit(fromWest / (eastLongitude - westLongitude));
+    //the point is on the spheroid with major axis s, all boundary spheroids have the same eccentricity
+    Spheroid* lower = &(grid->boundarySpheroids[lsl->layerId]);
+    Spheroid* upper = &(grid->boundarySpheroids[lsl->layerId + 1]);
+    double s = sqrt(point.x * point.x + point.y * point.y + point.z * point.z / (1 - lower->e * lower->e));
+    local[2] = clampUnit((s - lower->a) / (upper->a - lower->a));
+}
+
+void getLineSectorNodeWeights(LineSectorList* lsl, QuadraticGrid* grid, int* nodeIds, double* weights)
+{
+    double entry[3];
+    double exit[3];
+    getCellLocalCoordinates(lsl->cellIntersectionEntry, lsl, grid, entry);
+    getCellLocalCoordinates(lsl->cellIntersectionExit, lsl, grid, exit);
+    int corner;
+    for (corner = 0; corner < 8; corner++)
+    {
+        int north = corner & 1;
+        int east = (corner >> 1) & 1;
+        int up = (corner >> 2) & 1;
+        nodeIds[corner] = getSingleNodeIDByIndexes(lsl->layerId + up, lsl->lateralId + 1 - north,
+                                                   lsl->longitudinalId + east, grid);
+        //values of the three linear factors at the entry (a) and exit (b)
+        double a0 = north ? entry[0] : 1 - entry[0];
+        double b0 = north ? exit[0] : 1 - exit[0];
+        double a1 = east ? entry[1] : 1 - entry[1];
+        double b1 = east ? exit[1] : 1 - exit[1];
+        double a2 = up ? entry[2] : 1 - entry[2];
+        double b2 = up ? exit[2] : 1 - exit[2];
+        //integral over [0, 1] of the product in Bernstein form
+        double integral = (a0 * a1 * a2 + b0 * b1 * b2) / 4 +
+                          (a0 * a1 * b2 + a0 * b1 * a2 + b0 * a1 * a2 +
+                           a0 * b1 * b2 + b0 * a1 * b2 + b0 * b1 * a2) / 12;
+        weights[corner] = lsl->length * integral;
+    }
+}
+
+void getCompactLineSectorNodeWeights(CompactLineSectors* lineSectors, int index, QuadraticGrid* grid, int* nodeIds, double* weights)
+{
+    LineSectorList lsl;
+    initLineSectorList(&lsl);
+    lsl.cellId = lineSectors->sectors[index].cellId;
+    lsl.length = lineSectors->sectors[index].length;
+    lsl.cellIntersectionEntry = lineSectors->points[index];
+    lsl.cellIntersectionExit = lineSectors->points[index + 1];
+    getIndexesBySingleCellID(lsl.cellId, grid, &(lsl.layerId), &(lsl.lateralId), &(lsl.longitudinalId));
+    //the cells of a polar cap have the same ID, the crossed one is found by the longitude
+    if (isPoleLatitude(grid->boundaryLatitudes[lsl.lateralId]) || isPoleLatitude(grid->boundaryLatitudes[lsl.lateralId + 1]))
+    {
+        Vec3 middle = vec3Scale(0.5, vec3Add(lsl.cellIntersectionEntry, lsl.cellIntersectionExit));
+        double longitude = remainder(atan2(middle.y, middle.x) - grid->center.longitude, 2 * M_PI);
+        int longCount = grid->eastNum + grid->westNum;
+        int weIndex = floor((longitude + grid->westNum * grid->longitudeUnit) / grid->longitudeUnit);
+        lsl.longitudinalId = weIndex < 0 ? 0 : (weIndex >= longCount ? longCount - 1 : weIndex);
+    }
+    getLineSectorNodeWeights(&lsl, grid, nodeIds, weights);
+}
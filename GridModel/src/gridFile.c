@@ -0,0 +1,207 @@
+#include <gridFile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char gridFileMagic[8] = {'I', 'O', 'N', 'O', 'G', 'R', 'I', 'D'};
+static const int gridFileVersion = 2;
+
+typedef struct GridFileHeader
+{
+    char magic[8];
+    int version;
+    //sizes of the stored structs, the layout check of the file
+    int spheroidSize;
+    int planeSize;
+    int cellSize;
+    int layerNum;
+    int northNum;
+    int southNum;
+    int eastNum;
+    int westNum;
+    int reserved;
+    GeoCoord center;
+    double latitudeUnit;
+    double longitudeUnit;
+    unsigned long long specHash;
+    //hash of the grid, see getQuadraticGridHash()
+    unsigned long long gridHash;
+    //hash of all the bytes after the header, the tables are used without further checks
+    unsigned long long tableHash;
+    //offsets of the tables from the beginning of the file
+    long long spheroidOffset;
+    long long latitudeOffset;
+    long long longitudeOffset;
+    long long meridianPlaneOffset;
+    long long latitudePlaneOffset;
+    long long cellOffset;
+    long long fileSize;
+}GridFileHeader;
+
+//fills the table offsets of the header from the cell counts
+void setGridFileOffsets(GridFileHeader* header)
+{
+    long long latCount = header->northNum + header->southNum;
+    long long longCount = header->eastNum + header->westNum;
+    header->spheroidOffset = sizeof(GridFileHeader);
+    header->latitudeOffset = header->spheroidOffset + sizeof(Spheroid) * (header->layerNum + 1);
+    header->longitudeOffset = header->latitudeOffset + sizeof(double) * (latCount + 1);
+    header->meridianPlaneOffset = header->longitudeOffset + sizeof(double) * (longCount + 1);
+    header->latitudePlaneOffset = header->meridianPlaneOffset + sizeof(Plane) * (longCount + 1);
+    header->cellOffset = header->latitudePlaneOffset + sizeof(Plane) * (latCount + 1) * longCount;
+    header->fileSize = header->cellOffset + sizeof(QuadraticGridCell) * header->layerNum * latCount * longCount;
+}
+
+int saveQuadraticGrid(QuadraticGrid* grid, char* gridFile)
+{
+    FILE* file = fopen(gridFile, "wb");
+    if (!file)
+    {
+        printf("Can not open grid file %s for writing\n", gridFile);
+        return 0;
+    }
+    int latCount = grid->northNum + grid->southNum;
+    int longCount = grid->eastNum + grid->westNum;
+
+    GridFileHeader header;
+    memset(&header, 0, sizeof(GridFileHeader));
+    memcpy(header.magic, gridFileMagic, 8);
+    header.version = gridFileVersion;
+    header.spheroidSize = sizeof(Spheroid);
+    header.planeSize = sizeof(Plane);
+    header.cellSize = sizeof(QuadraticGridCell);
+    header.layerNum = grid->layerNum;
+    header.northNum = grid->northNum;
+    header.southNum = grid->southNum;
+    header.eastNum = grid->eastNum;
+    header.westNum = grid->westNum;
+    header.center = grid->center;
+    header.latitudeUnit = grid->latitudeUnit;
+    header.longitudeUnit = grid->longitudeUnit;
+    header.specHash = grid->specHash;
+    header.gridHash = getQuadraticGridHash(grid);
+    setGridFileOffsets(&header);
+    //the tables are hashed in the order of the file
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, grid->boundarySpheroids, sizeof(Spheroid) * (grid->layerNum + 1));
+    hash = hashBytes(hash, grid->boundaryLatitudes, sizeof(double) * (latCount + 1));
+    hash = hashBytes(hash, grid->boundaryLongitudes, sizeof(double) * (longCount + 1));
+    hash = hashBytes(hash, grid->meridianPlanes, sizeof(Plane) * (longCount + 1));
+    hash = hashBytes(hash, grid->latitudePlanes, sizeof(Plane) * (latCount + 1) * longCount);
+    header.tableHash = hashBytes(hash, grid->cellTable, sizeof(QuadraticGridCell) * grid->layerNum * latCount * longCount);
+
+    fwrite(&header, sizeof(GridFileHeader), 1, file);
+    fwrite(grid->boundarySpheroids, sizeof(Spheroid), grid->layerNum + 1, file);
+    fwrite(grid->boundaryLatitudes, sizeof(double), latCount + 1, file);
+    fwrite(grid->boundaryLongitudes, sizeof(double), longCount + 1, file);
+    fwrite(grid->meridianPlanes, sizeof(Plane), longCount + 1, file);
+    fwrite(grid->latitudePlanes, sizeof(Plane), (latCount + 1) * longCount, file);
+    fwrite(grid->cellTable, sizeof(QuadraticGridCell), grid->layerNum * latCount * longCount, file);
+    int isWritten = !ferror(file);
+    if (fclose(file) || !isWritten)
+    {
+        printf("Could not write grid file %s\n", gridFile);
+        return 0;
+    }
+    return 1;
+}
+
+//checks the header of a mapped file of the given size
+int isValidGridFileHeader(GridFileHeader* header, long long fileSize)
+{
+    if (fileSize < (long long)sizeof(GridFileHeader) ||
+        memcmp(header->magic, gridFileMagic, 8) ||
+        header->version != gridFileVersion ||
+        header->spheroidSize != sizeof(Spheroid) ||
+        header->planeSize != sizeof(Plane) ||
+        header->cellSize != sizeof(QuadraticGridCell) ||
+        header->layerNum < 1 || header->northNum < 0 || header->southNum < 0 ||
+        header->eastNum < 0 || header->westNum < 0 ||
+        header->northNum + header->southNum < 1 || header->eastNum + header->westNum < 1)
+    {
+        return 0;
+    }
+    GridFileHeader expected = *header;
+    setGridFileOffsets(&expected);
+    return !memcmp(&expected, header, sizeof(GridFileHeader)) && header->fileSize == fileSize;
+}
+
+int loadQuadraticGrid(char* gridFile, QuadraticGrid* grid)
+{
+    int fd = open(gridFile, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) || fileStat.st_size < (off_t)sizeof(GridFileHeader))
+    {
+        printf("Invalid grid file %s\n", gridFile);
+        close(fd);
+        return 0;
+    }
+    //private mapping, the file is never modified through the grid
+    char* data = mmap(0, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("Could not map grid file %s\n", gridFile);
+        return 0;
+    }
+    GridFileHeader* header = (GridFileHeader*)data;
+    if (!isValidGridFileHeader(header, fileStat.st_size))
+    {
+        printf("Grid file %s has a different version or it is corrupted\n", gridFile);
+        munmap(data, fileStat.st_size);
+        return 0;
+    }
+
+    QuadraticGrid result;
+    initQuadraticGrid(&result);
+    result.center = header->center;
+    result.layerNum = header->layerNum;
+    result.northNum = header->northNum;
+    result.southNum = header->southNum;
+    result.eastNum = header->eastNum;
+    result.westNum = header->westNum;
+    result.latitudeUnit = header->latitudeUnit;
+    result.longitudeUnit = header->longitudeUnit;
+    result.specHash = header->specHash;
+    result.boundarySpheroids = (Spheroid*)(data + header->spheroidOffset);
+    result.boundaryLatitudes = (double*)(data + header->latitudeOffset);
+    result.boundaryLongitudes = (double*)(data + header->longitudeOffset);
+    result.meridianPlanes = (Plane*)(data + header->meridianPlaneOffset);
+    result.latitudePlanes = (Plane*)(data + header->latitudePlaneOffset);
+    //the boundary and neighbor indexes of the cells are used as table indexes, so every table is covered
+    if (hashBytes(14695981039346656037ULL, data + header->spheroidOffset, header->fileSize - header->spheroidOffset) != header->tableHash ||
+        getQuadraticGridHash(&result) != header->gridHash)
+    {
+        printf("Grid file %s is corrupted\n", gridFile);
+        munmap(data, fileStat.st_size);
+        return 0;
+    }
+    result.mappedData = data;
+    result.mappedSize = fileStat.st_size;
+
+    result.cellTable = (QuadraticGridCell*)(data + header->cellOffset);
+
+    //only the row pointers are allocated, the cells are used from the file
+    int latCount = result.northNum + result.southNum;
+    result.cells = malloc(sizeof(QuadraticGridCell**) * result.layerNum);
+    int i;
+    for (i = 0; i < result.layerNum; i++)
+    {
+        result.cells[i] = malloc(sizeof(QuadraticGridCell*) * latCount);
+        int j;
+        for (j = 0; j < latCount; j++)
+        {
+            result.cells[i][j] = &(result.cellTable[getSingleCellIDByIndexes(i, j, 0, &result)]);
+        }
+    }
+    *grid = result;
+    return 1;
+}
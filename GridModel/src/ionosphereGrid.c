@@ -1,16 +1,20 @@
 #include <ionosphereGrid.h>
+#include <geodeticConversion.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 #define _USE_MATH_DEFINES
 
 const Spheroid WGS84_Spheroid = {{0,0,0},
                                  6378137,
                                  6356752.314245,
-                                 0.0818191908429643};
+                                 0.0818191908429643,
+                                 1 / (6378137.0 * 6378137.0),
+                                 1 / (6356752.314245 * 6356752.314245)};
 
 const double ionosphereLowerBound =  100000;
 const double ionosphereUpperBound =  1000000;
@@ -126,11 +130,16 @@ Tesseroid createGeoTesseroid(Spheroid* lowerBound, Spheroid* upperBound, GeoCoor
 void initQuadraticGridCell(QuadraticGridCell* cell)
 {
     memset(cell, 0, sizeof(QuadraticGridCell));
+    int i;
+    for (i = 0; i < 6; i++)
+    {
+        cell->neighborIds[i] = -1;
+    }
 }
 
 void deleteQuadraticGridCell(QuadraticGridCell* cell)
 {
-    deleteTesseroid(&(cell->t));
+    memset(cell, 0, sizeof(QuadraticGridCell));
 }
 
 void initQuadraticGrid(QuadraticGrid* grid)
@@ -147,44 +156,295 @@ void deleteQuadraticGrid(QuadraticGrid* grid)
         {
             if (grid->cells[i])
             {
-                int j;
-                for (j = 0; j < grid->northNum + grid->southNum; j++)
-                {
-                    if (grid->cells[i][j])
-                    {
-                        int k;
-                        for (k = 0; k < grid->eastNum + grid->westNum; k++)
-                        {
-                            deleteQuadraticGridCell(&(grid->cells[i][j][k]));
-                        }
-                        free(grid->cells[i][j]);
-                    }
-                }
                 free(grid->cells[i]);
             }
         }
         free(grid->cells);
     }
+    //the tables of a loaded grid are in the mapped file
+    if (grid->mappedData)
+    {
+        munmap(grid->mappedData, grid->mappedSize);
+        initQuadraticGrid(grid);
+        return;
+    }
+    if (grid->cellTable)
+    {
+        free(grid->cellTable);
+    }
     if (grid->boundarySpheroids)
     {
         free (grid->boundarySpheroids);
     }
+    if (grid->meridianPlanes)
+    {
+        free(grid->meridianPlanes);
+    }
+    if (grid->latitudePlanes)
+    {
+        free(grid->latitudePlanes);
+    }
+    if (grid->boundaryLatitudes)
+    {
+        free(grid->boundaryLatitudes);
+    }
+    if (grid->boundaryLongitudes)
+    {
+        free(grid->boundaryLongitudes);
+    }
+    initQuadraticGrid(grid);
 }
 
-QuadraticGrid createQuadraticGrid(GeoCoord center, double latitudeUnit, double longitudeUnit, int layerNum, int cellNumLimitLat, int cellNumLimitLong)
+Vector geoCoordToWGS84Vector(double latitude, double longitude)
+{
+    double x, y, z;
+    geodeticToECEF(latitude, longitude, 0, WGS84_Spheroid.a, WGS84_Spheroid.e, &x, &y, &z);
+    return createVector(x, y, z);
+}
+
+int isPoleLatitude(double latitude)
+{
+    return latitude > M_PI/2 - epsilon || latitude < -M_PI/2 + epsilon;
+}
+
+void initQuadraticGridSpec(QuadraticGridSpec* spec)
+{
+    memset(spec, 0, sizeof(QuadraticGridSpec));
+    spec->center = createGeoCoord(50, 15, 1);
+    spec->latitudeUnit = 5;
+    spec->longitudeUnit = 5;
+    spec->cellNumLimitLat = 3;
+    spec->cellNumLimitLong = 3;
+    setUniformLayerBoundaryHeights(spec, 2);
+}
+
+void deleteQuadraticGridSpec(QuadraticGridSpec* spec)
+{
+    if (spec->layerBoundaryHeights)
+    {
+        free(spec->layerBoundaryHeights);
+    }
+    memset(spec, 0, sizeof(QuadraticGridSpec));
+}
+
+void setUniformLayerBoundaryHeights(QuadraticGridSpec* spec, int layerNum)
+{
+    if (spec->layerBoundaryHeights)
+    {
+        free(spec->layerBoundaryHeights);
+        spec->layerBoundaryHeights = 0;
+    }
+    spec->layerNum = layerNum;
+    if (layerNum < 1)
+    {
+        return;
+    }
+    spec->layerBoundaryHeights = malloc(sizeof(double) * (layerNum + 1));
+    double layerWidth = (ionosphereUpperBound - ionosphereLowerBound) / layerNum;
+    int i;
+    for (i = 0; i < layerNum + 1; i++)
+    {
+        spec->layerBoundaryHeights[i] = ionosphereLowerBound + i * layerWidth;
+    }
+}
+
+void loadQuadraticGridSpec(char* specFile, QuadraticGridSpec* spec)
+{
+    FILE* file = fopen(specFile, "r");
+    if (!file)
+    {
+        printf("Can not open grid specification file %s\n", specFile);
+        exit(-1);
+    }
+    char line[4096];
+    int lineNum = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        lineNum++;
+        //fgets splits the lines longer than the buffer, only comments may be that long
+        int isComplete = strchr(line, '\n') || feof(file);
+        char key[32];
+        int offset;
+        if (sscanf(line, " %31s%n", key, &offset) != 1 || key[0] == '#')
+        {
+            while (!isComplete && fgets(line, sizeof(line), file))
+            {
+                isComplete = strchr(line, '\n') || feof(file);
+            }
+            continue;
+        }
+        char* values = line + offset;
+        int valid = 0;
+        if (!strcmp(key, "center"))
+        {
+            double latitude, longitude;
+            valid = sscanf(values, "%lf %lf", &latitude, &longitude) == 2;
+            spec->center = createGeoCoord(latitude, longitude, 1);
+        }
+        else if (!strcmp(key, "unit"))
+        {
+            valid = sscanf(values, "%lf %lf", &spec->latitudeUnit, &spec->longitudeUnit) == 2;
+        }
+        else if (!strcmp(key, "extent"))
+        {
+            valid = sscanf(values, "%d %d", &spec->cellNumLimitLat, &spec->cellNumLimitLong) == 2;
+        }
+        else if (!strcmp(key, "layernum"))
+        {
+            int layerNum;
+            valid = sscanf(values, "%d", &layerNum) == 1;
+            if (valid)
+            {
+                setUniformLayerBoundaryHeights(spec, layerNum);
+            }
+        }
+        else if (!strcmp(key, "layerheights"))
+        {
+            int heightCount = 0;
+            double heights[256];
+            double height;
+            while (sscanf(values, "%lf%n", &height, &offset) == 1)
+            {
+                //more heights than the table holds are rejected, not cut
+                if (heightCount == 256)
+                {
+                    heightCount = 0;
+                    break;
+                }
+                heights[heightCount++] = height * 1000;
+                values += offset;
+            }
+            valid = heightCount > 1;
+            if (valid)
+            {
+                setUniformLayerBoundaryHeights(spec, 0);
+                spec->layerNum = heightCount - 1;
+                spec->layerBoundaryHeights = malloc(sizeof(double) * heightCount);
+                memcpy(spec->layerBoundaryHeights, heights, sizeof(double) * heightCount);
+            }
+        }
+        else if (!strcmp(key, "refinement"))
+        {
+            valid = sscanf(values, "%d %d %d", &spec->refinementLevels, &spec->splitRayCount, &spec->mergeRayCount) == 3;
+        }
+        else if (!strcmp(key, "observable"))
+        {
+            valid = sscanf(values, "%d %lf", &spec->minRayCount, &spec->minDiversity) == 2;
+        }
+        else if (!strcmp(key, "basis"))
+        {
+            char basis[32];
+            valid = sscanf(values, "%31s", basis) == 1 && (!strcmp(basis, "cell") || !strcmp(basis, "trilinear"));
+            spec->basis = valid && !strcmp(basis, "trilinear") ? TRILINEAR_NODE_BASIS : CELL_BASIS;
+        }
+        else
+        {
+            printf("Unknown key \"%s\" in grid specification file %s, line %d\n", key, specFile, lineNum);
+            exit(-1);
+        }
+        if (!valid || !isComplete)
+        {
+            printf("Invalid value for \"%s\" in grid specification file %s, line %d\n", key, specFile, lineNum);
+            exit(-1);
+        }
+    }
+    fclose(file);
+}
+
+void validateQuadraticGridSpec(QuadraticGridSpec* spec)
 {
-    if (latitudeUnit < epsilon || longitudeUnit < epsilon)
+    if (spec->latitudeUnit < epsilon || spec->longitudeUnit < epsilon)
     {
         printf("Too small latitude or longitude unit specified for model, minimal value is %lf degrees\n" \
-              "latitude unit: %lf,    longitude unit: %lf\n", epsilon, latitudeUnit, longitudeUnit);
+              "latitude unit: %lf,    longitude unit: %lf\n", epsilon, spec->latitudeUnit, spec->longitudeUnit);
               exit(-1);
     }
+    if (spec->center.latitude < -M_PI/2 || spec->center.latitude > M_PI/2)
+    {
+        printf("Invalid latitude for the center of the model: %lf degrees\n", spec->center.latitude / M_PI * 180);
+        exit(-1);
+    }
+    if (spec->cellNumLimitLat < 1 || spec->cellNumLimitLong < 1)
+    {
+        printf("The cell number limits of the model must be positive\n" \
+               "latitude limit: %d,    longitude limit: %d\n", spec->cellNumLimitLat, spec->cellNumLimitLong);
+        exit(-1);
+    }
+    if (spec->layerNum < 1 || !spec->layerBoundaryHeights)
+    {
+        printf("The model must have at least one layer\n");
+        exit(-1);
+    }
+    if (spec->layerBoundaryHeights[0] < 0)
+    {
+        printf("The lowest layer boundary must be above the ellipsoid, height: %lf m\n", spec->layerBoundaryHeights[0]);
+        exit(-1);
+    }
+    if (spec->refinementLevels < 0 ||
+        (spec->refinementLevels > 0 && (spec->splitRayCount < 1 || spec->mergeRayCount > spec->splitRayCount)))
+    {
+        printf("Invalid refinement of the model, levels: %d,    split ray count: %d,    merge ray count: %d\n" \
+               "the split ray count must be positive and not less than the merge ray count\n",
+               spec->refinementLevels, spec->splitRayCount, spec->mergeRayCount);
+        exit(-1);
+    }
+    if (spec->minRayCount < 0 || spec->minDiversity < 0 || spec->minDiversity > 1)
+    {
+        printf("Invalid observability limits, min ray count: %d,    min angular diversity: %lf\n",
+               spec->minRayCount, spec->minDiversity);
+        exit(-1);
+    }
+    if (spec->refinementLevels > 0 && (spec->minRayCount > 0 || spec->minDiversity > 0))
+    {
+        printf("Unobservable cells can not be merged on an adaptive grid, its refinement merges the sparse cells\n");
+        exit(-1);
+    }
+    if (spec->basis == TRILINEAR_NODE_BASIS && (spec->refinementLevels > 0 || spec->minRayCount > 0 || spec->minDiversity > 0))
+    {
+        printf("The trilinear node basis is defined on the uniform grid, it can not be used with refinement or cell merging\n");
+        exit(-1);
+    }
+    int i;
+    for (i = 0; i < spec->layerNum; i++)
+    {
+        if (spec->layerBoundaryHeights[i + 1] - spec->layerBoundaryHeights[i] < epsilon)
+        {
+            printf("The layer boundary heights must be increasing, boundary %d: %lf m,    boundary %d: %lf m\n",
+                   i, spec->layerBoundaryHeights[i], i + 1, spec->layerBoundaryHeights[i + 1]);
+            exit(-1);
+        }
+    }
+}
+
+QuadraticGrid createQuadraticGrid(GeoCoord center, double latitudeUnit, double longitudeUnit, int layerNum, int cellNumLimitLat, int cellNumLimitLong)
+{
+    QuadraticGridSpec spec;
+    initQuadraticGridSpec(&spec);
+    spec.center = center;
+    spec.latitudeUnit = latitudeUnit;
+    spec.longitudeUnit = longitudeUnit;
+    spec.cellNumLimitLat = cellNumLimitLat;
+    spec.cellNumLimitLong = cellNumLimitLong;
+    setUniformLayerBoundaryHeights(&spec, layerNum);
+    QuadraticGrid grid = createQuadraticGridFromSpec(&spec);
+    deleteQuadraticGridSpec(&spec);
+    return grid;
+}
+
+QuadraticGrid createQuadraticGridFromSpec(QuadraticGridSpec* spec)
+{
+    validateQuadraticGridSpec(spec);
+    GeoCoord center = spec->center;
+    int layerNum = spec->layerNum;
+    int cellNumLimitLat = spec->cellNumLimitLat;
+    int cellNumLimitLong = spec->cellNumLimitLong;
     QuadraticGrid grid;
     initQuadraticGrid(&grid);
+    grid.specHash = getQuadraticGridSpecHash(spec);
     grid.center = center;
     grid.layerNum = layerNum;
-    latitudeUnit = latitudeUnit / 180 * M_PI;
-    longitudeUnit = longitudeUnit / 180 * M_PI;
+    double latitudeUnit = spec->latitudeUnit / 180 * M_PI;
+    double longitudeUnit = spec->longitudeUnit / 180 * M_PI;
     grid.latitudeUnit = latitudeUnit;
     grid.longitudeUnit = longitudeUnit;
     grid.northNum = cellNumLimitLat;
@@ -237,129 +497,138 @@ QuadraticGrid createQuadraticGrid(GeoCoord center, double latitudeUnit, double l
             grid.westNum++;
         }
     }
+    int latCount = grid.northNum + grid.southNum;
+    int longCount = grid.eastNum + grid.westNum;
 
-    double layerWidth = (1000000 - 100000) / layerNum;
     grid.boundarySpheroids = malloc(sizeof(Spheroid) * (layerNum + 1));
     Vector o = createVector(0,0,0);
     int i;
     for (i = 0; i < layerNum + 1; i++)
     {
-        grid.boundarySpheroids[i] = createSpheroid(o, WGS84_Spheroid.a + ionosphereLowerBound + i * layerWidth, WGS84_Spheroid.e, 2);
+        grid.boundarySpheroids[i] = createSpheroid(o, WGS84_Spheroid.a + spec->layerBoundaryHeights[i], WGS84_Spheroid.e, 2);
     }
-    grid.cells = malloc(sizeof(QuadraticGridCell**) * layerNum);
-    for (i = 0; i < layerNum; i++)
+
+    //side boundaries, computed once for every column/row instead of every cell
+    grid.boundaryLatitudes = malloc(sizeof(double) * (latCount + 1));
+    for (i = 0; i < latCount + 1; i++)
+    {
+        double latitude = grid.center.latitude + grid.latitudeUnit * (grid.northNum - i);
+        if (latitude > M_PI/2)
+        {
+            latitude = M_PI/2;
+        }
+        if (latitude < -M_PI/2)
+        {
+            latitude = -M_PI/2;
+        }
+        grid.boundaryLatitudes[i] = latitude;
+    }
+    grid.boundaryLongitudes = malloc(sizeof(double) * (longCount + 1));
+    grid.meridianPlanes = malloc(sizeof(Plane) * (longCount + 1));
+    for (i = 0; i < longCount + 1; i++)
     {
-        grid.cells[i] = malloc(sizeof(QuadraticGridCell*) * (grid.northNum + grid.southNum));
-        int j;
-        for (j = 0; j < grid.northNum + grid.southNum; j++)
+        double longitude = grid.center.longitude - grid.longitudeUnit * (grid.westNum - i);
+        if (longitude > grid.center.longitude + M_PI)
+        {
+            longitude = grid.center.longitude + M_PI;
+        }
+        if (longitude < grid.center.longitude - M_PI)
         {
-            grid.cells[i][j] = malloc(sizeof(QuadraticGridCell) * (grid.eastNum + grid.westNum));
-            int k;
-            for (k = 0; k < grid.eastNum + grid.westNum; k++)
+            longitude = grid.center.longitude - M_PI;
+        }
+        grid.boundaryLongitudes[i] = longitude;
+        grid.meridianPlanes[i] = createPlane(o, createVector(-sin(longitude), cos(longitude), 0));
+    }
+    grid.latitudePlanes = malloc(sizeof(Plane) * (latCount + 1) * longCount);
+    #pragma omp parallel for
+    for (i = 0; i < latCount + 1; i++)
+    {
+        int k;
+        for (k = 0; k < longCount; k++)
+        {
+            Plane* p = &(grid.latitudePlanes[i * longCount + k]);
+            if (isPoleLatitude(grid.boundaryLatitudes[i]))
             {
-                GeoCoord vertexes[4];
-                int vertexNum = 4;
-                int northPole = 0;
-                int southPole = 0;
-                int currentVertex = 0;
-                double nLat = grid.center.latitude + grid.latitudeUnit * (grid.northNum - j);
-                double sLat = grid.center.latitude + grid.latitudeUnit * (grid.northNum - j - 1);
-                double wLong = grid.center.longitude - grid.longitudeUnit * (grid.westNum - k);
-                double eLong = grid.center.longitude - grid.longitudeUnit * (grid.westNum - k - 1);
-                if (sLat < -M_PI/2)
-                {
-                    sLat = -M_PI/2;
-                    vertexNum--;
-                    southPole = 1;
-                }
-                if (nLat > M_PI/2)
-                {
-                    nLat = M_PI/2;
-                    vertexNum--;
-                    northPole = 1;
-                }
-                if (eLong > grid.center.longitude + M_PI)
-                {
-                    eLong = grid.center.longitude + M_PI;
-                }
-                if (wLong < grid.center.longitude - M_PI)
-                {
-                    wLong = grid.center.longitude - M_PI;
-                }
-                vertexes[0] = createGeoCoord(nLat, wLong, 2);
-                currentVertex++;
-                if (!northPole)
-                {
-                    vertexes[1] = createGeoCoord(nLat, eLong, 2);
-                    currentVertex++;
-                }
-                vertexes[currentVertex] = createGeoCoord(sLat, eLong, 2);
-                currentVertex++;
-                if (!southPole)
-                {
-                    vertexes[currentVertex] = createGeoCoord(sLat, wLong, 2);
-                }
-
-                initQuadraticGridCell(&(grid.cells[i][j][k]));
-
-                grid.cells[i][j][k].t = createGeoTesseroid(&(grid.boundarySpheroids[i]),
-                                                           &(grid.boundarySpheroids[i+1]),
-                                                           vertexes,
-                                                           vertexNum);
-                grid.cells[i][j][k].layerId = i;
-                grid.cells[i][j][k].longitudinalId = k;
-                grid.cells[i][j][k].lateralId = j;
+                memset(p, 0, sizeof(Plane));
+                continue;
             }
+            //normal points north if the cell is narrower than 180 degrees
+            Vector west = geoCoordToWGS84Vector(grid.boundaryLatitudes[i], grid.boundaryLongitudes[k]);
+            Vector east = geoCoordToWGS84Vector(grid.boundaryLatitudes[i], grid.boundaryLongitudes[k + 1]);
+            *p = createPlane(o, crossProduct(west, east));
         }
     }
+
+    grid.cellTable = malloc(sizeof(QuadraticGridCell) * layerNum * latCount * longCount);
+    grid.cells = malloc(sizeof(QuadraticGridCell**) * layerNum);
     for (i = 0; i < layerNum; i++)
     {
-        int j;
-        for (j = 0; j < grid.northNum + grid.southNum; j++)
+        grid.cells[i] = malloc(sizeof(QuadraticGridCell*) * latCount);
+    }
+    //if grid is reaching across the globe the first and last columns are neighbors
+    int isWestWrapping = grid.westNum * grid.longitudeUnit >= M_PI;
+    int isEastWrapping = grid.eastNum * grid.longitudeUnit >= M_PI;
+    //the rows only depend on the shared boundary tables, so they are filled in parallel
+    int row;
+    #pragma omp parallel for schedule(static)
+    for (row = 0; row < layerNum * latCount; row++)
+    {
+        int i = row / latCount;
+        int j = row % latCount;
+        grid.cells[i][j] = &(grid.cellTable[getSingleCellIDByIndexes(i, j, 0, &grid)]);
+        int northBoundaryId = isPoleLatitude(grid.boundaryLatitudes[j]) ? -1 : j * longCount;
+        int southBoundaryId = isPoleLatitude(grid.boundaryLatitudes[j + 1]) ? -1 : (j + 1) * longCount;
+        int k;
+        for (k = 0; k < longCount; k++)
         {
-            int k;
-            for (k = 0; k < grid.eastNum + grid.westNum; k++)
+            QuadraticGridCell* cell = &(grid.cells[i][j][k]);
+            initQuadraticGridCell(cell);
+            cell->layerId = i;
+            cell->lateralId = j;
+            cell->longitudinalId = k;
+            cell->boundaryIds[0] = i;
+            cell->boundaryIds[1] = i + 1;
+            cell->boundaryIds[2] = northBoundaryId < 0 ? -1 : northBoundaryId + k;
+            cell->boundaryIds[3] = k + 1;
+            cell->boundaryIds[4] = southBoundaryId < 0 ? -1 : southBoundaryId + k;
+            cell->boundaryIds[5] = k;
+            //lower neighbor
+            if (i != 0)
             {
-                //lower neighbor
-                if (i != 0)
-                {
-                    grid.cells[i][j][k].neighbors[0] = &(grid.cells[i-1][j][k]);
-                }
-                //upper neighbor
-                if (i != layerNum - 1)
-                {
-                    grid.cells[i][j][k].neighbors[1] = &(grid.cells[i+1][j][k]);
-                }
-                //northern neighbor
-                if (j != 0)
-                {
-                     grid.cells[i][j][k].neighbors[2] = &(grid.cells[i][j-1][k]);
-                }
-                //southern neighbor
-                if (j != (grid.northNum + grid.southNum) - 1)
-                {
-                     grid.cells[i][j][k].neighbors[4] = &(grid.cells[i][j+1][k]);
-                }
-                //western neighbor
-                if (k != 0)
-                {
-                     grid.cells[i][j][k].neighbors[5] = &(grid.cells[i][j][k-1]);
-                }
-                //if grid is reaching across the globe
-                else if (grid.westNum * grid.longitudeUnit >= M_PI)
-                {
-                    grid.cells[i][j][k].neighbors[5] = &(grid.cells[i][j][grid.eastNum + grid.westNum - 1]);
-                }
-                //estern neighbor
-                if (k != (grid.eastNum + grid.westNum) - 1)
-                {
-                     grid.cells[i][j][k].neighbors[3] = &(grid.cells[i][j][k+1]);
-                }
-                //if grid is reaching across the globe
-                else if (grid.eastNum * grid.longitudeUnit >= M_PI)
-                {
-                    grid.cells[i][j][k].neighbors[3] = &(grid.cells[i][j][0]);
-                }
+                cell->neighborIds[0] = getSingleCellIDByIndexes(i-1, j, k, &grid);
+            }
+            //upper neighbor
+            if (i != layerNum - 1)
+            {
+                cell->neighborIds[1] = getSingleCellIDByIndexes(i+1, j, k, &grid);
+            }
+            //northern neighbor
+            if (j != 0)
+            {
+                cell->neighborIds[2] = getSingleCellIDByIndexes(i, j-1, k, &grid);
+            }
+            //southern neighbor
+            if (j != latCount - 1)
+            {
+                cell->neighborIds[4] = getSingleCellIDByIndexes(i, j+1, k, &grid);
+            }
+            //western neighbor
+            if (k != 0)
+            {
+                cell->neighborIds[5] = getSingleCellIDByIndexes(i, j, k-1, &grid);
+            }
+            else if (isWestWrapping)
+            {
+                cell->neighborIds[5] = getSingleCellIDByIndexes(i, j, longCount - 1, &grid);
+            }
+            //estern neighbor
+            if (k != longCount - 1)
+            {
+                cell->neighborIds[3] = getSingleCellIDByIndexes(i, j, k+1, &grid);
+            }
+            else if (isEastWrapping)
+            {
+                cell->neighborIds[3] = getSingleCellIDByIndexes(i, j, 0, &grid);
             }
         }
     }
@@ -382,6 +651,131 @@ int getSingleCellIDByIndexes(int layerIndex, int nsIndex, int weIndex, Quadratic
            weIndex;
 }
 
+void getIndexesBySingleCellID(int cellId, QuadraticGrid* grid, int* layerIndex, int* nsIndex, int* weIndex)
+{
+    int longCount = grid->eastNum + grid->westNum;
+    int layerCellCount = longCount * (grid->northNum + grid->southNum);
+    *layerIndex = cellId / layerCellCount;
+    *nsIndex = (cellId % layerCellCount) / longCount;
+    *weIndex = cellId % longCount;
+}
+
+int getLineSectorCellId(int layerIndex, int nsIndex, int weIndex, QuadraticGrid* grid)
+{
+    if (isPoleLatitude(grid->boundaryLatitudes[nsIndex]) || isPoleLatitude(grid->boundaryLatitudes[nsIndex + 1]))
+    {
+        weIndex = 0;
+    }
+    return getSingleCellIDByIndexes(layerIndex, nsIndex, weIndex, grid);
+}
+
+QuadraticGridCell* getNeighborCell(QuadraticGridCell* cell, int boundary, QuadraticGrid* grid)
+{
+    int neighborId = cell->neighborIds[boundary];
+    return neighborId < 0 ? 0 : &(grid->cellTable[neighborId]);
+}
+
+int getMaxLineSectorCellNeighborCount(QuadraticGrid* grid)
+{
+    //a polar cap has a lower, an upper and a side neighbor for every cell of its row
+    return 3 * (grid->eastNum + grid->westNum) + 6;
+}
+
+int getLineSectorCellNeighbors(int cellId, QuadraticGrid* grid, int* neighborIds, int* isVertical)
+{
+    int longCount = grid->eastNum + grid->westNum;
+    if (cellId < 0 || cellId >= grid->layerNum * (grid->northNum + grid->southNum) * longCount)
+    {
+        return 0;
+    }
+    int layer, lat, lon;
+    getIndexesBySingleCellID(cellId, grid, &layer, &lat, &lon);
+    //the cells of a polar cap are one cell, its neighbors are the ones of all of them
+    int isCap = isPoleLatitude(grid->boundaryLatitudes[lat]) || isPoleLatitude(grid->boundaryLatitudes[lat + 1]);
+    int first = isCap ? 0 : lon;
+    int last = isCap ? longCount - 1 : lon;
+    int count = 0;
+    int i;
+    for (i = first; i <= last; i++)
+    {
+        QuadraticGridCell* cell = &(grid->cellTable[getSingleCellIDByIndexes(layer, lat, i, grid)]);
+        int boundary;
+        for (boundary = 0; boundary < 6; boundary++)
+        {
+            if (cell->neighborIds[boundary] < 0)
+            {
+                continue;
+            }
+            int nLayer, nLat, nLon;
+            getIndexesBySingleCellID(cell->neighborIds[boundary], grid, &nLayer, &nLat, &nLon);
+            int neighborId = getLineSectorCellId(nLayer, nLat, nLon, grid);
+            int j;
+            for (j = 0; j < count && neighborIds[j] != neighborId; j++);
+            if (neighborId == cellId || j < count)
+            {
+                continue;
+            }
+            neighborIds[count] = neighborId;
+            //boundary 0 and 1 are the lower and upper spheroids
+            isVertical[count] = boundary < 2;
+            count++;
+        }
+    }
+    return count;
+}
+
+//64 bit FNV-1a
+unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+unsigned long long getQuadraticGridHash(QuadraticGrid* grid)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    int counts[5] = {grid->layerNum, grid->northNum, grid->southNum, grid->eastNum, grid->westNum};
+    hash = hashBytes(hash, counts, sizeof(counts));
+    hash = hashBytes(hash, grid->boundaryLatitudes, sizeof(double) * (grid->northNum + grid->southNum + 1));
+    hash = hashBytes(hash, grid->boundaryLongitudes, sizeof(double) * (grid->eastNum + grid->westNum + 1));
+    int i;
+    for (i = 0; i < grid->layerNum + 1; i++)
+    {
+        hash = hashBytes(hash, &(grid->boundarySpheroids[i].a), sizeof(double));
+        hash = hashBytes(hash, &(grid->boundarySpheroids[i].b), sizeof(double));
+    }
+    return hash;
+}
+
+unsigned long long getQuadraticGridSpecHash(QuadraticGridSpec* spec)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    double units[4] = {spec->center.latitude, spec->center.longitude, spec->latitudeUnit, spec->longitudeUnit};
+    int counts[3] = {spec->cellNumLimitLat, spec->cellNumLimitLong, spec->layerNum};
+    hash = hashBytes(hash, units, sizeof(units));
+    hash = hashBytes(hash, counts, sizeof(counts));
+    if (spec->layerBoundaryHeights)
+    {
+        hash = hashBytes(hash, spec->layerBoundaryHeights, sizeof(double) * (spec->layerNum + 1));
+    }
+    return hash;
+}
+
+unsigned long long getQuadraticGridHorizontalHash(QuadraticGrid* grid)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    int counts[4] = {grid->northNum, grid->southNum, grid->eastNum, grid->westNum};
+    hash = hashBytes(hash, counts, sizeof(counts));
+    hash = hashBytes(hash, grid->boundaryLatitudes, sizeof(double) * (grid->northNum + grid->southNum + 1));
+    hash = hashBytes(hash, grid->boundaryLongitudes, sizeof(double) * (grid->eastNum + grid->westNum + 1));
+    return hash;
+}
 
 void initLineSectorList(LineSectorList* lsl)
 {
@@ -399,383 +793,606 @@ void deleteLineSectorList(LineSectorList** lsl)
     *lsl = 0;
 }
 
-//  -1: outer point
-//   0: inner point
-//   a: point is on boundary of index a-1
-//  ab: point is on boundary of index a-1 and index b-1
-// abc: point is on boundary of index a-1 and b-1 and c-1
-// more values are not permitted
-int innerPointChecker(Vector v, QuadraticGridCell* currentCell)
+void initCompactLineSectors(CompactLineSectors* lineSectors)
 {
-    int retVal = 0;
-    int boundCount = currentCell->t.planeCount + 2;
-    int i;
-    for (i = 0; i < 2; i++)
+    memset(lineSectors, 0, sizeof(CompactLineSectors));
+}
+
+void deleteCompactLineSectors(CompactLineSectors* lineSectors)
+{
+    if (lineSectors->sectors)
     {
-        double subst = checkVectorAgainstSpheroid(v, *(currentCell->t.boundarySpheroids[i]));
-        if(subst < epsilon && subst > -epsilon)
-        {
-            retVal = retVal * 10 + i + 1;
-        }
-        else if ((i == 0 && subst < 0) || (i == 1 && subst > 0))
-        {
-            return -1;
-        }
+        free(lineSectors->sectors);
     }
-    for (i = 0; i < boundCount - 2; i++)
+    if (lineSectors->points)
     {
-        double subst = checkVectorAgainstPlane(v, currentCell->t.boundaryPlanes[i]);
-        //this is not elegant, just hacking
-        //this should be rather handled when specifying neighbors
-        //requires smaller redesign
-        int skipNorthbound = 0;
-        int skipSouthbound = 0;
-        if (boundCount == 5)
-        {
-            if (currentCell->t.vertexes[0].x < epsilon || currentCell->t.vertexes[0].x > -epsilon)
-            {
-                skipNorthbound = 1;
-            }
-            else if (currentCell->t.vertexes[4].x < epsilon || currentCell->t.vertexes[4].x > -epsilon)
-            {
-                skipSouthbound = 1;
-            }
-        }
-        else if (boundCount == 4)
+        free(lineSectors->points);
+    }
+    initCompactLineSectors(lineSectors);
+}
+
+void compactLineSectors(LineSectorList* lsl, int isPointRetained, CompactLineSectors* result)
+{
+    initCompactLineSectors(result);
+    LineSectorList* tmp;
+    for (tmp = lsl; tmp; tmp = tmp->next)
+    {
+        result->count++;
+    }
+    if (!result->count)
+    {
+        return;
+    }
+    result->direction = vec3Normalize(vec3Subtract(lsl->cellIntersectionExit, lsl->cellIntersectionEntry));
+    result->sectors = malloc(sizeof(CompactLineSector) * result->count);
+    if (isPointRetained)
+    {
+        result->points = malloc(sizeof(Vec3) * (result->count + 1));
+        result->points[0] = lsl->cellIntersectionEntry;
+    }
+    int i = 0;
+    for (tmp = lsl; tmp; tmp = tmp->next, i++)
+    {
+        result->sectors[i].cellId = tmp->cellId;
+        result->sectors[i].length = tmp->length;
+        if (isPointRetained)
         {
-            skipNorthbound = 1;
-            skipSouthbound = 1;
+            result->points[i + 1] = tmp->cellIntersectionExit;
         }
-        if (subst < epsilon && subst > -epsilon)
+    }
+}
+
+//direction of the outward normal of the side boundaries relative to the stored normals
+static const double boundaryOrientation[6] = {0, 0, 1, 1, -1, -1};
+
+//the opposite boundary of a cell, the one the line enters through from a neighbor
+static const int oppositeBoundary[6] = {1, 0, 4, 5, 2, 3};
+
+Plane* getCellBoundaryPlane(QuadraticGridCell* cell, int boundary, QuadraticGrid* grid)
+{
+    if (cell->boundaryIds[boundary] < 0)
+    {
+        return 0;
+    }
+    if (boundary == 2 || boundary == 4)
+    {
+        return &(grid->latitudePlanes[cell->boundaryIds[boundary]]);
+    }
+    return &(grid->meridianPlanes[cell->boundaryIds[boundary]]);
+}
+
+/*
+ * Distance from the origin of the ray where it leaves the cell through
+ * the side boundary. INFINITY is returned if the ray does not leave the
+ * cell there (it is paralel or it enters the cell through the boundary).
+ */
+double getPlaneExitDistance(Ray r, QuadraticGridCell* cell, int boundary, QuadraticGrid* grid)
+{
+    Plane* p = getCellBoundaryPlane(cell, boundary, grid);
+    if (!p)
+    {
+        return INFINITY;
+    }
+    Vec3 normal = vec3FromVector(p->normal);
+    double denom = boundaryOrientation[boundary] * vec3Dot(normal, r.direction);
+    if (denom < epsilon)
+    {
+        return INFINITY;
+    }
+    return -boundaryOrientation[boundary] * (vec3Dot(normal, r.origin) + p->d) / denom;
+}
+
+/*
+ * Per ray state of the traversal. The exit distances of the current
+ * cell are kept, so that when the ray moves to a neighbor only the
+ * boundaries not shared with the previous cell have to be intersected.
+ */
+typedef struct TraversalState
+{
+    QuadraticGridCell* cell;
+    //intersections with the lower and upper boundary spheroid of the cell
+    double lowerDistances[2];
+    int lowerCount;
+    double upperDistances[2];
+    int upperCount;
+    double exitDistances[6];
+}TraversalState;
+
+void setSpheroidExitDistances(TraversalState* state)
+{
+    state->exitDistances[0] = state->lowerCount == 2 ? state->lowerDistances[0] : INFINITY;
+    state->exitDistances[1] = state->upperCount == 2 ? state->upperDistances[1] : INFINITY;
+}
+
+void initTraversalState(TraversalState* state, Ray r, QuadraticGridCell* cell, QuadraticGrid* grid)
+{
+    state->cell = cell;
+    state->lowerCount = intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[cell->boundaryIds[0]]), state->lowerDistances);
+    state->upperCount = intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[cell->boundaryIds[1]]), state->upperDistances);
+    setSpheroidExitDistances(state);
+    int i;
+    for (i = 2; i < 6; i++)
+    {
+        state->exitDistances[i] = getPlaneExitDistance(r, cell, i, grid);
+    }
+}
+
+/*
+ * Moves the state into the neighbor through the given boundary, reusing
+ * every intersection that belongs to a boundary shared by the two cells.
+ */
+void stepTraversalState(TraversalState* state, Ray r, int boundary, QuadraticGrid* grid)
+{
+    QuadraticGridCell* next = getNeighborCell(state->cell, boundary, grid);
+    state->cell = next;
+    if (boundary == 0)
+    {
+        memcpy(state->upperDistances, state->lowerDistances, sizeof(state->lowerDistances));
+        state->upperCount = state->lowerCount;
+        state->lowerCount = intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[next->boundaryIds[0]]), state->lowerDistances);
+        setSpheroidExitDistances(state);
+        return;
+    }
+    if (boundary == 1)
+    {
+        memcpy(state->lowerDistances, state->upperDistances, sizeof(state->upperDistances));
+        state->lowerCount = state->upperCount;
+        state->upperCount = intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[next->boundaryIds[1]]), state->upperDistances);
+        setSpheroidExitDistances(state);
+        return;
+    }
+    //the ray crossed the shared plane, it can not leave through it again
+    state->exitDistances[oppositeBoundary[boundary]] = INFINITY;
+    state->exitDistances[boundary] = getPlaneExitDistance(r, next, boundary, grid);
+    //moving along a column keeps the meridian planes, moving along a row changes every latitude plane
+    if (boundary == 3 || boundary == 5)
+    {
+        state->exitDistances[2] = getPlaneExitDistance(r, next, 2, grid);
+        state->exitDistances[4] = getPlaneExitDistance(r, next, 4, grid);
+    }
+}
+
+/*
+ * Checks whether the point is on the inner side of the boundary. Points
+ * on the boundary are inside if the ray does not leave through it.
+ */
+int isInsideCellBoundary(Vec3 v, Vec3 direction, Plane* p, double outward)
+{
+    if (!p)
+    {
+        return 1;
+    }
+    Vec3 normal = vec3FromVector(p->normal);
+    double subst = outward * (vec3Dot(v, normal) + p->d);
+    if (subst >= epsilon)
+    {
+        return 0;
+    }
+    else if (subst > -epsilon && outward * vec3Dot(direction, normal) >= epsilon)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Finds the cell of the uppermost layer containing the entry point of
+ * the ray. The cell is estimated from the geodetic coordinates of the
+ * entry point, than it is corrected by the boundary planes, since the
+ * chord shaped latitude boundaries may put the point into an adjacent
+ * row.
+ */
+QuadraticGridCell* findEntryCell(Vec3 entryCoord, Ray r, GeoCoord entryGeoCoord, QuadraticGrid* grid)
+{
+    int latCount = grid->northNum + grid->southNum;
+    int longCount = grid->eastNum + grid->westNum;
+    int isGlobal = grid->westNum * grid->longitudeUnit >= M_PI;
+    double longitude = remainder(entryGeoCoord.longitude - grid->center.longitude, 2 * M_PI);
+    double latitude = entryGeoCoord.latitude - grid->center.latitude;
+    int longId = floor((longitude + grid->westNum * grid->longitudeUnit) / grid->longitudeUnit);
+    int latId = floor((grid->northNum * grid->latitudeUnit - latitude) / grid->latitudeUnit);
+    longId = longId < 0 ? 0 : (longId >= longCount ? longCount - 1 : longId);
+    latId = latId < 0 ? 0 : (latId >= latCount ? latCount - 1 : latId);
+    int step;
+    for (step = 0; step < latCount + longCount + 2; step++)
+    {
+        if (!isInsideCellBoundary(entryCoord, r.direction, &(grid->meridianPlanes[longId]), -1))
         {
-            if (boundCount == 5)
+            longId--;
+            if (longId < 0)
             {
-                if(i < 2)
+                if (!isGlobal)
                 {
-                    retVal = retVal * 10 + i + 3 + skipNorthbound;
-                }
-                else
-                {
-                    retVal = retVal * 10 + i + 3 + skipNorthbound + skipSouthbound;
+                    return 0;
                 }
+                longId = longCount - 1;
             }
-            else if (boundCount == 4)
+            continue;
+        }
+        if (!isInsideCellBoundary(entryCoord, r.direction, &(grid->meridianPlanes[longId + 1]), 1))
+        {
+            longId++;
+            if (longId == longCount)
             {
-                if(i < 2)
-                {
-                    retVal = retVal * 10 + i + 3 + skipNorthbound;
-                }
-                else
+                if (!isGlobal)
                 {
-                    retVal = retVal * 10 + i + 3 + skipNorthbound + skipSouthbound;
+                    return 0;
                 }
+                longId = 0;
             }
-            else
+            continue;
+        }
+        QuadraticGridCell* cell = &(grid->cells[grid->layerNum - 1][latId][longId]);
+        if (!isInsideCellBoundary(entryCoord, r.direction, getCellBoundaryPlane(cell, 2, grid), 1))
+        {
+            latId--;
+            if (latId < 0)
             {
-                retVal = retVal * 10 + i + 3;
+                return 0;
             }
+            continue;
         }
-        else if(subst > 0)
+        if (!isInsideCellBoundary(entryCoord, r.direction, getCellBoundaryPlane(cell, 4, grid), -1))
         {
-            return -1;
+            latId++;
+            if (latId == latCount)
+            {
+                return 0;
+            }
+            continue;
         }
+        return cell;
     }
-    return retVal;
+    return 0;
 }
 
-LineSectorList* getLineSectorOfCell(Line l, QuadraticGridCell* currentCell, QuadraticGridCell** nextCell)
+/*
+ * Traces the ray through the grid. The ray enters the uppermost layer at
+ * entryDistance (measured from the origin of the ray), the trace ends
+ * where it leaves the lowest one. entryGeoCoord is the geodetic position
+ * of the entry point.
+ */
+LineSectorList* traceLineSectors(Ray r, double entryDistance, GeoCoord entryGeoCoord, QuadraticGrid* grid)
 {
-    Vector satPos = l.p1;
-    if (l.p1.length < l.p2.length)
+    Vec3 entryCoord = vec3MultiplyAdd(r.origin, entryDistance, r.direction);
+
+    QuadraticGridCell* currentCell = findEntryCell(entryCoord, r, entryGeoCoord, grid);
+    if (!currentCell)
     {
-        satPos = l.p2;
+        return 0;
     }
-    LineSectorList* lsl = malloc(sizeof(LineSectorList));
-    initLineSectorList(lsl);
-    int boundCount = currentCell->t.planeCount + 2;
-    //indexing according to neighbors
-    Vector** intersections = malloc(sizeof(Vector*) * boundCount);
-    memset(intersections, 0, sizeof(Vector*) * boundCount);
-    int* isInnerPoint = malloc(sizeof(int) * boundCount);
-    memset(isInnerPoint, 0, sizeof(int) * boundCount);
-    //calculate upper spheroid
-    int i;
-    for (i = 0; i < 2; i++)
+    //start calculating the line sectors
+    LineSectorList* result = 0;
+    LineSectorList** lastLineSector = &result;
+    TraversalState state;
+    initTraversalState(&state, r, currentCell, grid);
+    while (1)
     {
-        Vector intersectResults[2];
-        int resultNum = intersectLineSpheroid(l, *(currentCell->t.boundarySpheroids[i]), intersectResults);
-        if (resultNum != 2)
+        int i;
+        double exitDistance = INFINITY;
+        for (i = 0; i < 6; i++)
         {
-            printf("Satellite-receiver trajectory has less then 2 intersections with\n" \
-                   "boundary spheroid, which should not be possible since receiver\n" \
-                   "must be inside and satellite must be outside.\n");
-            exit(-1);
+            //intersections behind the entry point are numerical noise of the entered boundaries
+            if (state.exitDistances[i] - entryDistance > -epsilon && state.exitDistances[i] < exitDistance)
+            {
+                exitDistance = state.exitDistances[i];
+            }
         }
-        intersections[i] = malloc(sizeof(Vector));
-        if (subtractVector(intersectResults[0], satPos).length < subtractVector(intersectResults[1], satPos).length)
+        if (exitDistance == INFINITY)
         {
-            *intersections[i] = intersectResults[0];
+            deleteLineSectorList(&result);
+            return 0;
         }
-        else
+        if (exitDistance - entryDistance >= epsilon)
         {
-            *intersections[i] = intersectResults[1];
+            LineSectorList* lsl = malloc(sizeof(LineSectorList));
+            initLineSectorList(lsl);
+            lsl->layerId = state.cell->layerId;
+            lsl->lateralId = state.cell->lateralId;
+            lsl->longitudinalId = state.cell->longitudinalId;
+            lsl->cellId = getLineSectorCellId(lsl->layerId, lsl->lateralId, lsl->longitudinalId, grid);
+            //the exit point of a sector is the entry point of the next one
+            lsl->cellIntersectionEntry = entryCoord;
+            entryCoord = vec3MultiplyAdd(r.origin, exitDistance, r.direction);
+            lsl->cellIntersectionExit = entryCoord;
+            lsl->length = exitDistance - entryDistance;
+            *lastLineSector = lsl;
+            lastLineSector = &(lsl->next);
         }
-    }
-    for (i = 0; i < boundCount - 2; i++)
-    {
-        Vector intersectResult;
-        int resultCode = intersectLinePlane(l, currentCell->t.boundaryPlanes[i], &intersectResult);
-        if (resultCode == 0)
+        //the ray leaves on the lowest spheroid, the trajectory is complete
+        if (state.cell->layerId == 0 && state.exitDistances[0] - exitDistance < epsilon)
         {
-            intersections[i+2] = malloc(sizeof(Vector));
-            *intersections[i+2] = intersectResult;
+            break;
         }
-        else if (resultCode == 1)
+        //more exits at the same point means the ray crosses an edge or a vertex
+        int exitBoundaries[6];
+        int exitCount = 0;
+        for (i = 0; i < 6; i++)
         {
-            lsl->layerId = currentCell->layerId;
-            lsl->lateralId = currentCell->lateralId;
-            lsl->longitudinalId = currentCell->longitudinalId;
-            lsl->cellIntersectionEntry = *intersections[0];
-            lsl->cellIntersectionExit = *intersections[1];
-            lsl->length = subtractVector(*intersections[1], *intersections[0]).length;
-            *nextCell = currentCell->neighbors[0];
-            int j;
-            for (j = 0; j < boundCount; j++)
+            if (state.exitDistances[i] - entryDistance > -epsilon && state.exitDistances[i] - exitDistance < epsilon)
             {
-                if (intersections[j])
-                {
-                    free(intersections[j]);
-                }
+                exitBoundaries[exitCount] = i;
+                exitCount++;
             }
-            free(intersections);
-            free(isInnerPoint);
-            return lsl;
         }
-    }
-    for (i = 0; i < boundCount; i++)
-    {
-        isInnerPoint[i] = innerPointChecker(*intersections[i], currentCell);
-    }
-    Vector* differentPoints[6] = {0};
-    int isDiffInnerPoint[6] = {0};
-    int differentPointCount = 0;
-    for (i = 0; i < boundCount; i++)
-    {
-        assert(isInnerPoint[i] != 0);
-        if (isInnerPoint[i] == -1)
-        {
-            continue;
-        }
-        int storedDifferentPoint = 0;
-        int j;
-        for (j = 0; j < differentPointCount; j++)
+        for (i = 0; i < exitCount; i++)
         {
-            Vector diff = subtractVector(*(intersections[i]), *differentPoints[j]);
-            if (diff.length < epsilon)
+            //ray exits the model before reaches the lower bound
+            if (!getNeighborCell(state.cell, exitBoundaries[i], grid))
+            {
+                deleteLineSectorList(&result);
+                return 0;
+            }
+            if (exitCount == 1)
             {
-                storedDifferentPoint = 1;
-                break;
+                stepTraversalState(&state, r, exitBoundaries[i], grid);
+            }
+            else
+            {
+                state.cell = getNeighborCell(state.cell, exitBoundaries[i], grid);
             }
         }
-        if (!storedDifferentPoint)
+        if (exitCount > 1)
         {
-            differentPoints[differentPointCount] = intersections[i];
-            isDiffInnerPoint[differentPointCount] = isInnerPoint[i];
-            differentPointCount++;
+            initTraversalState(&state, r, state.cell, grid);
+            //boundaries crossed at the corner are behind the ray
+            for (i = 0; i < 6; i++)
+            {
+                if (state.exitDistances[i] - exitDistance < epsilon)
+                {
+                    state.exitDistances[i] = INFINITY;
+                }
+            }
         }
+        entryDistance = exitDistance;
     }
-    assert(differentPointCount == 2);
-    int entryIndex;
-    int exitIndex;
-    if ((*differentPoints[0]).length > (*differentPoints[1]).length)
-    {
-        entryIndex = 0;
-        exitIndex = 1;
-    }
-    else
+    //the sector lengths sum to the shell-to-shell path length, checked by GridModelTest
+    return result;
+}
+
+LineSectorList* getLineSectorsFromModel(Vector satPos, Vector recPos, QuadraticGrid* grid)
+{
+    //search for intersection on most upper spheroid
+    Ray r = createRay(vec3FromVector(satPos), vec3FromVector(recPos));
+    double upperDistances[2];
+    double lowerDistances[2];
+    if (intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[grid->layerNum]), upperDistances) != 2 ||
+        intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[0]), lowerDistances) != 2)
     {
-        entryIndex = 1;
-        exitIndex = 0;
+        printf("Satellite-receiver trajectory has less then 2 intersections with\n" \
+               "boundary spheroid, which should not be possible since receiver\n" \
+               "must be inside and satellite must be outside.\n");
+        exit(-1);
     }
-    lsl->layerId = currentCell->layerId;
-    lsl->lateralId = currentCell->lateralId;
-    lsl->longitudinalId = currentCell->longitudinalId;
-    lsl->cellIntersectionEntry = *differentPoints[entryIndex];
-    lsl->cellIntersectionExit = *differentPoints[exitIndex];
-    lsl->length = subtractVector(*differentPoints[entryIndex], *differentPoints[exitIndex]).length;
-    int exitNeighbor = isDiffInnerPoint[exitIndex];
-    assert(exitNeighbor >= 0);
-    int neighborIds[3] = {0};
-    for (i = 0; i < 3; i++)
+    //the ray enters at the upper intersection and leaves the model on the lower spheroid
+    Vec3 entryCoord = vec3MultiplyAdd(r.origin, upperDistances[0], r.direction);
+    GeoCoord entryGeoCoord;
+    double entryHeight;
+    ecefToGeodetic(entryCoord.x, entryCoord.y, entryCoord.z, WGS84_Spheroid.a, WGS84_Spheroid.e,
+                   &(entryGeoCoord.latitude), &(entryGeoCoord.longitude), &entryHeight);
+    return traceLineSectors(r, upperDistances[0], entryGeoCoord, grid);
+}
+
+void getLineSectorsFromModelBatch(Vector* satPos, Vector* recPos, int count, QuadraticGrid* grid, LineSectorList** results)
+{
+    LineBatch batch;
+    initLineBatch(&batch, count);
+    Ray* rays = malloc(sizeof(Ray) * count);
+    double* distances = malloc(sizeof(double) * 4 * count);
+    double* upperNear = distances;
+    double* upperFar = distances + count;
+    double* lowerNear = distances + 2 * count;
+    double* lowerFar = distances + 3 * count;
+    //entry points and their geodetic coordinates
+    double* entryCoords = malloc(sizeof(double) * 6 * count);
+    double* entryX = entryCoords;
+    double* entryY = entryCoords + count;
+    double* entryZ = entryCoords + 2 * count;
+    double* entryLatitudes = entryCoords + 3 * count;
+    double* entryLongitudes = entryCoords + 4 * count;
+    double* entryHeights = entryCoords + 5 * count;
+    int i;
+    for (i = 0; i < count; i++)
     {
-        neighborIds[i] = (exitNeighbor % 10);
-        exitNeighbor /= 10;
+        rays[i] = createRay(vec3FromVector(satPos[i]), vec3FromVector(recPos[i]));
+        batch.px[i] = rays[i].origin.x;
+        batch.py[i] = rays[i].origin.y;
+        batch.pz[i] = rays[i].origin.z;
+        batch.dx[i] = rays[i].direction.x;
+        batch.dy[i] = rays[i].direction.y;
+        batch.dz[i] = rays[i].direction.z;
     }
-    assert(exitNeighbor == 0);
-    int isLowerBoundExit = 0;
-    for(i = 0; i < 3; i++)
+    //the shell entry and exit of every ray with one pass over the batch per spheroid
+    intersectLineBatchSpheroid(&batch, &(grid->boundarySpheroids[grid->layerNum]), upperNear, upperFar);
+    intersectLineBatchSpheroid(&batch, &(grid->boundarySpheroids[0]), lowerNear, lowerFar);
+    for (i = 0; i < count; i++)
     {
-        if(neighborIds[i] == 1)
+        if (isnan(upperNear[i]) || isnan(lowerNear[i]))
         {
-            isLowerBoundExit = 1;
+            printf("Satellite-receiver trajectory has less then 2 intersections with\n" \
+                   "boundary spheroid, which should not be possible since receiver\n" \
+                   "must be inside and satellite must be outside.\n");
+            exit(-1);
         }
+        Vec3 entryCoord = vec3MultiplyAdd(rays[i].origin, upperNear[i], rays[i].direction);
+        entryX[i] = entryCoord.x;
+        entryY[i] = entryCoord.y;
+        entryZ[i] = entryCoord.z;
     }
-    *nextCell = currentCell;
-    i = 0;
-    for(i = 0; i < 3 && neighborIds[i] != 0; i++)
+    ecefToGeodeticBatch(count, entryX, entryY, entryZ, WGS84_Spheroid.a, WGS84_Spheroid.e,
+                        entryLatitudes, entryLongitudes, entryHeights);
+    for (i = 0; i < count; i++)
     {
-        *nextCell = (*nextCell)->neighbors[neighborIds[i] - 1];
-        //line exits the model before reaches the lower bound
-        if(!(*nextCell != 0 || (currentCell->layerId == 0 && isLowerBoundExit == 1)))
-        {
-            deleteLineSectorList(&lsl);
-            return 0;
-        }
-        if(*nextCell == 0)
-        {
-            break;
-        }
+        results[i] = traceLineSectors(rays[i], upperNear[i], createGeoCoord(entryLatitudes[i], entryLongitudes[i], 2), grid);
     }
+    free(entryCoords);
+    free(distances);
+    free(rays);
+    deleteLineBatch(&batch);
+}
+
+void initHorizontalTrace(HorizontalTrace* trace)
+{
+    memset(trace, 0, sizeof(HorizontalTrace));
+}
 
-    for (i = 0; i < boundCount; i++)
+void deleteHorizontalTrace(HorizontalTrace* trace)
+{
+    if (trace->crossings)
     {
-        if (intersections[i])
-        {
-            free(intersections[i]);
-        }
+        free(trace->crossings);
     }
-    free(intersections);
-    free(isInnerPoint);
-    return lsl;
+    initHorizontalTrace(trace);
 }
 
-LineSectorList* getLineSectorsFromModel(Vector satPos, Vector recPos, QuadraticGrid* grid)
+void appendHorizontalCrossing(HorizontalTrace* trace, int* capacity, QuadraticGridCell* cell, double exitDistance)
 {
-    //search for intersection on most upper spheroid
-    Line l = createLine(satPos, recPos);
-    Vector intersectResults[2];
-    int resultNum = intersectLineSpheroid(l, grid->boundarySpheroids[grid->layerNum], intersectResults);
-    if (resultNum != 2)
+    if (trace->crossingCount == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        trace->crossings = realloc(trace->crossings, sizeof(HorizontalCrossing) * (*capacity));
+    }
+    HorizontalCrossing* crossing = &(trace->crossings[trace->crossingCount]);
+    crossing->lateralId = cell->lateralId;
+    crossing->longitudinalId = cell->longitudinalId;
+    crossing->exitDistance = exitDistance;
+    trace->crossingCount++;
+}
+
+void createHorizontalTrace(Vector satPos, Vector recPos, QuadraticGrid* grid, HorizontalTrace* trace)
+{
+    initHorizontalTrace(trace);
+    Ray r = createRay(vec3FromVector(satPos), vec3FromVector(recPos));
+    trace->ray = r;
+    trace->horizontalHash = getQuadraticGridHorizontalHash(grid);
+    double upperDistances[2];
+    if (intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[grid->layerNum]), upperDistances) != 2)
     {
         printf("Satellite-receiver trajectory has less then 2 intersections with\n" \
                "boundary spheroid, which should not be possible since receiver\n" \
                "must be inside and satellite must be outside.\n");
         exit(-1);
     }
-    LineSectorList* result = 0;
-    LineSectorList* currentLineSector = 0;
-    Vector entryCoord;
-    Vector exitCoord;
-    int layerId;
-    int latId;
-    int longId;
-    //get the upper intersection
-    if (subtractVector(intersectResults[0], satPos).length < subtractVector(intersectResults[1], satPos).length)
-    {
-        entryCoord = intersectResults[0];
-    }
-    else
-    {
-        entryCoord = intersectResults[1];
-    }
-    resultNum = intersectLineSpheroid(l, grid->boundarySpheroids[0], intersectResults);
-    assert(resultNum == 2);
-    if (subtractVector(intersectResults[0], satPos).length < subtractVector(intersectResults[1], satPos).length)
-    {
-        exitCoord = intersectResults[0];
-    }
-    else
-    {
-        exitCoord = intersectResults[1];
-    }
-    double totalLength = subtractVector(entryCoord, exitCoord).length;
+    trace->startDistance = upperDistances[0];
+    double endDistance = vec3Length(vec3Subtract(vec3FromVector(recPos), vec3FromVector(satPos)));
 
-    int i;
-    int mismatchFound = 0;
-    //check the cells to find out which one contains the intersection
-    for (i = 0; i < grid->northNum + grid->southNum; i++)
+    Vec3 entryCoord = vec3MultiplyAdd(r.origin, trace->startDistance, r.direction);
+    GeoCoord entryGeoCoord;
+    double entryHeight;
+    ecefToGeodetic(entryCoord.x, entryCoord.y, entryCoord.z, WGS84_Spheroid.a, WGS84_Spheroid.e,
+                   &(entryGeoCoord.latitude), &(entryGeoCoord.longitude), &entryHeight);
+    //the columns are followed in the uppermost layer
+    QuadraticGridCell* cell = findEntryCell(entryCoord, r, entryGeoCoord, grid);
+    int capacity = 0;
+    int columnCount = (grid->northNum + grid->southNum) * (grid->eastNum + grid->westNum);
+    int step;
+    for (step = 0; cell && step <= columnCount; step++)
     {
-        int j;
-        for (j = 0; j < grid->eastNum + grid->westNum; j++)
+        double exitDistances[6];
+        double exitDistance = INFINITY;
+        int i;
+        for (i = 2; i < 6; i++)
         {
-            mismatchFound = 0;
-            int k;
-            for (k = 0; k < grid->cells[grid->layerNum-1][i][j].t.planeCount; k++)
+            exitDistances[i] = getPlaneExitDistance(r, cell, i, grid);
+            if (exitDistances[i] < exitDistance)
             {
-                double subst = (checkVectorAgainstPlane(entryCoord, grid->cells[grid->layerNum-1][i][j].t.boundaryPlanes[k]));
-                if (subst >= epsilon)
-                {
-                    mismatchFound = 1;
-                    break;
-                }
-                else if (subst > -epsilon)
-                {
-                    double direction = dotProduct(l.orientation, grid->cells[grid->layerNum-1][i][j].t.boundaryPlanes[k].normal);
-                    if (direction >= epsilon)
-                    {
-                        mismatchFound = 1;
-                        break;
-                    }
-                }
-            }
-            if (!mismatchFound)
-            {
-                layerId = grid->layerNum - 1;
-                latId = i;
-                longId = j;
-                break;
+                exitDistance = exitDistances[i];
             }
         }
-        if (!mismatchFound)
+        if (exitDistance >= endDistance)
         {
-            break;
+            appendHorizontalCrossing(trace, &capacity, cell, endDistance);
+            return;
+        }
+        appendHorizontalCrossing(trace, &capacity, cell, exitDistance);
+        //more exits at the same point means the line crosses a vertical edge
+        for (i = 2; i < 6 && cell; i++)
+        {
+            if (exitDistances[i] - exitDistance < epsilon)
+            {
+                cell = getNeighborCell(cell, i, grid);
+            }
         }
     }
-    if (mismatchFound)
+    trace->leavesGrid = 1;
+}
+
+int getLineSectorsFromHorizontalTrace(HorizontalTrace* trace, QuadraticGrid* grid, LineSectorList** lineSectors)
+{
+    *lineSectors = 0;
+    if (trace->horizontalHash != getQuadraticGridHorizontalHash(grid))
     {
         return 0;
     }
-    //start calculating the line sectors
-    else
+    Ray r = trace->ray;
+    //the line crosses every boundary spheroid downwards at its near intersection
+    double* layerDistances = malloc(sizeof(double) * (grid->layerNum + 1));
+    int i;
+    for (i = 0; i < grid->layerNum + 1; i++)
     {
-        i = 1;
-        QuadraticGridCell* currentCell = &(grid->cells[layerId][latId][longId]);
-        QuadraticGridCell* nextCell = 0;
-        do
+        double distances[2];
+        if (intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[i]), distances) != 2)
         {
-            if (!nextCell)
-            {
-                result = currentLineSector = getLineSectorOfCell(l, currentCell, &nextCell);
-            }
-            else
-            {
-                i++;
-                LineSectorList* tmpLineSector = currentLineSector;
-                currentLineSector = getLineSectorOfCell(l, currentCell, &nextCell);
-                tmpLineSector->next = currentLineSector;
-            }
-            if(!currentLineSector)
-            {
-                if(result)
-                {
-                    deleteLineSectorList(&result);
-                }
-                return 0;
-            }
-            currentCell = nextCell;
+            printf("Satellite-receiver trajectory has less then 2 intersections with\n" \
+                   "boundary spheroid, which should not be possible since receiver\n" \
+                   "must be inside and satellite must be outside.\n");
+            exit(-1);
         }
-        while(nextCell);
+        layerDistances[i] = distances[0];
+    }
+    double entryDistance = layerDistances[grid->layerNum];
+    if (entryDistance < trace->startDistance - epsilon ||
+        (!trace->crossingCount && entryDistance - trace->startDistance >= epsilon))
+    {
+        //the line may enter the grid before or after the start of the trace
+        free(layerDistances);
+        return 0;
     }
-    if(result)
+    //the columns left before the entry into the upper layer
+    int column = 0;
+    while (column < trace->crossingCount && trace->crossings[column].exitDistance - entryDistance < epsilon)
+    {
+        column++;
+    }
+    LineSectorList* result = 0;
+    LineSectorList** lastLineSector = &result;
+    Vec3 entryCoord = vec3MultiplyAdd(r.origin, entryDistance, r.direction);
+    int layer = grid->layerNum - 1;
+    while (layer >= 0 && column < trace->crossingCount)
     {
-        double sum = 0;
-        LineSectorList* tmpLineSector = result;
-        while(tmpLineSector)
+        HorizontalCrossing* crossing = &(trace->crossings[column]);
+        double exitDistance = layerDistances[layer] < crossing->exitDistance ? layerDistances[layer] : crossing->exitDistance;
+        if (exitDistance - entryDistance >= epsilon)
         {
-            sum += tmpLineSector->length;
-            tmpLineSector = tmpLineSector->next;
+            LineSectorList* lsl = malloc(sizeof(LineSectorList));
+            initLineSectorList(lsl);
+            lsl->layerId = layer;
+            lsl->lateralId = crossing->lateralId;
+            lsl->longitudinalId = crossing->longitudinalId;
+            lsl->cellId = getLineSectorCellId(layer, crossing->lateralId, crossing->longitudinalId, grid);
+            lsl->cellIntersectionEntry = entryCoord;
+            entryCoord = vec3MultiplyAdd(r.origin, exitDistance, r.direction);
+            lsl->cellIntersectionExit = entryCoord;
+            lsl->length = exitDistance - entryDistance;
+            *lastLineSector = lsl;
+            lastLineSector = &(lsl->next);
+            entryDistance = exitDistance;
+        }
+        if (layerDistances[layer] - exitDistance < epsilon)
+        {
+            layer--;
+        }
+        if (crossing->exitDistance - exitDistance < epsilon)
+        {
+            column++;
         }
-        assert(totalLength - sum < 1 && totalLength - sum > -1);
     }
-    return result;
+    free(layerDistances);
+    //the line leaves the grid through its side before it reaches the lower bound
+    if (layer >= 0)
+    {
+        deleteLineSectorList(&result);
+    }
+    *lineSectors = result;
+    return 1;
 }
@@ -0,0 +1,39 @@
+#include <vectorMath.h>
+#include <math.h>
+#include <immintrin.h>
+
+void sinCosBatchScalar(int start, int count, const double* angles, double* sines, double* cosines)
+{
+    int i;
+    for (i = start; i < count; i++)
+    {
+        sines[i] = sin(angles[i]);
+        cosines[i] = cos(angles[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void sinCosBatchAVX2(int count, const double* angles, double* sines, double* cosines)
+{
+    int i;
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        __m256d sine, cosine;
+        sinCosAVX2(_mm256_loadu_pd(angles + i), &sine, &cosine);
+        _mm256_storeu_pd(sines + i, sine);
+        _mm256_storeu_pd(cosines + i, cosine);
+    }
+    sinCosBatchScalar(i, count, angles, sines, cosines);
+}
+
+void sinCosBatch(int count, const double* angles, double* sines, double* cosines)
+{
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        sinCosBatchAVX2(count, angles, sines, cosines);
+    }
+    else
+    {
+        sinCosBatchScalar(0, count, angles, sines, cosines);
+    }
+}
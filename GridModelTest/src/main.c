@@ -1,97 +1,443 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <argp.h>
 #include "geometryPrimitives.h"
 #include "ionosphereGrid.h"
+#include "geodeticConversion.h"
 #include "math.h"
 
 #define _USE_MATH_DEFINES
 
-int main()
+/*
+ * Ray tracing benchmark and correctness harness of the grid model.
+ * Rays are generated between a station list (IONOREG.CRD format or
+ * synthetic stations spread over the grid) and a nominal GPS
+ * constellation over a number of epochs, then traced through the grid.
+ * Every traced ray is checked: the midpoint of every sector must lie in
+ * the latitude, longitude and height bounds of its cell, the sector
+ * lengths must sum to the shell-to-shell path length and consecutive
+ * sectors must be continuous.
+ * The exit code is nonzero if any ray fails the checks.
+ */
+
+const char* argp_program_version = "gridmodel_test 1.0";
+static char doc[] = "Ray tracing benchmark and correctness check of the grid model";
+static char args_doc[] = "";
+
+static struct argp_option options[] =
+{
+    {"gridspec", 'g', "GRIDSPEC", 0, "Grid specification file (see loadQuadraticGridSpec), default: 1 degree cells, 30x30 columns, 10 layers around 50N 15E"},
+    {"stations", 's', "CRDFILE", 0, "Station coordinate file in IONOREG.CRD format, default: synthetic stations"},
+    {"stationnum", 'n', "COUNT", 0, "Number of synthetic stations, default: 100"},
+    {"epochs", 'e', "COUNT", 0, "Number of 30 second epochs, default: 240"},
+    {"mask", 'm', "DEGREES", 0, "Elevation mask, default: 10"},
+    {"repeat", 'r', "COUNT", 0, "Number of timed runs, the fastest is reported, default: 3"},
+    {"single", 'b', 0, 0, "Trace with getLineSectorsFromModel() one ray at a time as well and compare the results"},
+    {0}
+};
+
+struct arguments
+{
+    char* gridSpecFile;
+    char* stationFile;
+    int stationNum;
+    int epochNum;
+    double elevationMask;
+    int repeatNum;
+    int isSingleChecked;
+};
+
+static error_t parse_opt(int key, char* arg, struct argp_state* state)
 {
-    Vector v1 = createVector(-5,0,0);
-    Vector v2 = createVector(5,0,0);
-    printf("V1, V2 length: %lf, %lf\n", v1.length, v2.length);
-    Vector v3 = crossProduct(v1, v2);
-    printf("V3(crossprod): %lf, %lf, %lf,    %lf\n", v3.x, v3.y, v3.z, v3.length);
-    Vector v4 = createVector(0,0,0);
-    Spheroid sph = createSpheroid(v4, 3, 1, 1);
-    printf("SPH ecc: %lf\n", sph.e);
-    Line l = createLine(v1, v2);
-    printf("LINE ori: %lf, %lf, %lf\n", l.orientation.x, l.orientation.y, l.orientation.z);
-    Plane p = createPlane(v4, v2);
-    printf("PLANE coeff: %lf\n", p.d);
-    Vector result[2];
-    intersectLineSpheroid(l, sph, result);
-    printf("INTERSECTION 1: %lf, %lf, %lf\n", result[0].x, result[0].y, result[0].z);
-    printf("INTERSECTION 2: %lf, %lf, %lf\n", result[1].x, result[1].y, result[1].z);
-    intersectLinePlane(l, p, result);
-    printf("INTERSECTION 3: %lf, %lf, %lf\n", result[0].x, result[0].y, result[0].z);
-
-    GeoCoord center = createGeoCoord(45, 0, 1);
-    QuadraticGrid grid = createQuadraticGrid(center, 11, 11, 10, 10, 20);
-    int i = 0;
-    for (i = 0; i < grid.layerNum; i++)
+    struct arguments* arguments = state->input;
+    switch (key)
     {
-        printf("Center: %lf, %lf\n\n", grid.center.latitude * 180 / M_PI, grid.center.longitude * 180 / M_PI);
-        printf("Layer %d\n", i);
-        int j;
-        for (j = 0; j < grid.northNum + grid.southNum; j++)
+        case 'g':
+            arguments->gridSpecFile = arg;
+            break;
+        case 's':
+            arguments->stationFile = arg;
+            break;
+        case 'n':
+            arguments->stationNum = atoi(arg);
+            break;
+        case 'e':
+            arguments->epochNum = atoi(arg);
+            break;
+        case 'm':
+            arguments->elevationMask = atof(arg);
+            break;
+        case 'r':
+            arguments->repeatNum = atoi(arg);
+            break;
+        case 'b':
+            arguments->isSingleChecked = 1;
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+//nominal GPS constellation: 6 planes, 4 satellites per plane, circular orbits
+static const int gpsPlaneNum = 6;
+static const int gpsSatPerPlane = 4;
+static const double gpsOrbitRadius = 26559700;
+static const double gpsInclination = 55.0 / 180 * M_PI;
+static const double gpsPeriod = 43082.0;
+static const double earthRotationRate = 7.2921151467e-5;
+static const double epochInterval = 30;
+//tolerance of the length and continuity checks in meters
+static const double checkTolerance = 0.001;
+//tolerance of the latitude check in radians (about 1 mm) besides the bulge of the latitude planes
+static const double latitudeCheckTolerance = 1.6e-10;
+
+Vector getGPSSatPosition(int satId, double time)
+{
+    int plane = satId / gpsSatPerPlane;
+    int slot = satId % gpsSatPerPlane;
+    //ascending node in the rotating ECEF frame
+    double node = plane * M_PI / 3 - earthRotationRate * time;
+    double argument = slot * M_PI / 2 + plane * M_PI / 12 + 2 * M_PI * time / gpsPeriod;
+    double x = gpsOrbitRadius * cos(argument);
+    double y = gpsOrbitRadius * sin(argument);
+    return createVector(x * cos(node) - y * cos(gpsInclination) * sin(node),
+                        x * sin(node) + y * cos(gpsInclination) * cos(node),
+                        y * sin(gpsInclination));
+}
+
+//reads the station coordinates of an IONOREG.CRD style file (7 header lines), returns the count
+int loadStations(char* stationFile, Vector** stations)
+{
+    FILE* file = fopen(stationFile, "r");
+    if (!file)
+    {
+        printf("could not open station coordinate file %s\n", stationFile);
+        exit(-1);
+    }
+    char line[100];
+    int capacity = 64;
+    int count = 0;
+    *stations = malloc(sizeof(Vector) * capacity);
+    int lineNum = 0;
+    while (fgets(line, 100, file))
+    {
+        int stationNum;
+        char stationId[5];
+        double x, y, z;
+        if (++lineNum <= 7 || sscanf(line, "%d%4s%lf%lf%lf", &stationNum, stationId, &x, &y, &z) != 5)
+        {
+            continue;
+        }
+        if (count == capacity)
         {
-            printf("    lateral %d\n", j);
-            int k;
-            for (k = 0; k < grid.eastNum + grid.westNum; k++)
+            capacity *= 2;
+            *stations = realloc(*stations, sizeof(Vector) * capacity);
+        }
+        (*stations)[count++] = createVector(x, y, z);
+    }
+    fclose(file);
+    return count;
+}
+
+//stations spread randomly over the area of the grid on the ellipsoid, fixed seed
+int createSyntheticStations(QuadraticGrid* grid, int stationNum, Vector** stations)
+{
+    srand(12345);
+    int latCount = grid->northNum + grid->southNum;
+    int longCount = grid->eastNum + grid->westNum;
+    double southLatitude = grid->boundaryLatitudes[latCount];
+    double northLatitude = grid->boundaryLatitudes[0];
+    double westLongitude = grid->boundaryLongitudes[0];
+    double eastLongitude = grid->boundaryLongitudes[longCount];
+    *stations = malloc(sizeof(Vector) * stationNum);
+    int i;
+    for (i = 0; i < stationNum; i++)
+    {
+        double lat = southLatitude + (northLatitude - southLatitude) * rand() / RAND_MAX;
+        double lon = westLongitude + (eastLongitude - westLongitude) * rand() / RAND_MAX;
+        double x, y, z;
+        geodeticToECEF(lat, lon, 0, WGS84_Spheroid.a, WGS84_Spheroid.e, &x, &y, &z);
+        (*stations)[i] = createVector(x, y, z);
+    }
+    return stationNum;
+}
+
+//rays from every satellite above the elevation mask to every station at every epoch
+int createRays(Vector* stations, int stationNum, int epochNum, double elevationMask, Vector** satPos, Vector** recPos)
+{
+    int capacity = 1024;
+    int count = 0;
+    *satPos = malloc(sizeof(Vector) * capacity);
+    *recPos = malloc(sizeof(Vector) * capacity);
+    double minSinElevation = sin(elevationMask / 180 * M_PI);
+    int epoch;
+    for (epoch = 0; epoch < epochNum; epoch++)
+    {
+        int satId;
+        for (satId = 0; satId < gpsPlaneNum * gpsSatPerPlane; satId++)
+        {
+            Vector sat = getGPSSatPosition(satId, epoch * epochInterval);
+            int i;
+            for (i = 0; i < stationNum; i++)
             {
-                printf("        longitudinal %d\n", k);
-                int l;
-                printf("            vertexes:\n");
-                for (l = 0; l < grid.cells[i][j][k].t.vertexCount/2; l++)
+                double lat, lon, height;
+                ecefToGeodetic(stations[i].x, stations[i].y, stations[i].z, WGS84_Spheroid.a, WGS84_Spheroid.e, &lat, &lon, &height);
+                Vector up = createVector(cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat));
+                Vector los = createVector(sat.x - stations[i].x, sat.y - stations[i].y, sat.z - stations[i].z);
+                if ((los.x * up.x + los.y * up.y + los.z * up.z) / los.length < minSinElevation)
                 {
-                    printf("                %lf, %lf, %lf,    length: %lf\n", grid.cells[i][j][k].t.vertexes[2*l].x,
-                                                                              grid.cells[i][j][k].t.vertexes[2*l].y,
-                                                                              grid.cells[i][j][k].t.vertexes[2*l].z,
-                                                                              grid.cells[i][j][k].t.vertexes[2*l].length);
+                    continue;
                 }
-                for (l = 0; l < grid.cells[i][j][k].t.vertexCount/2; l++)
+                if (count == capacity)
                 {
-                    printf("                %lf, %lf, %lf,    length: %lf\n", grid.cells[i][j][k].t.vertexes[2*l+1].x,
-                                                                             grid.cells[i][j][k].t.vertexes[2*l+1].y,
-                                                                             grid.cells[i][j][k].t.vertexes[2*l+1].z,
-                                                                             grid.cells[i][j][k].t.vertexes[2*l+1].length);
-                }
-                printf("            boundary spheroids:\n");
-                printf("                center: %lf, %lf, %lf,   a: %lf,    b: %lf,    e: %lf\n", grid.cells[i][j][k].t.boundarySpheroids[0]->center.x,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[0]->center.y,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[0]->center.z,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[0]->a,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[0]->b,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[0]->e);
-                printf("                center: %lf, %lf, %lf,   a: %lf,    b: %lf,    e: %lf\n", grid.cells[i][j][k].t.boundarySpheroids[1]->center.x,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[1]->center.y,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[1]->center.z,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[1]->a,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[1]->b,
-                                                                                                  grid.cells[i][j][k].t.boundarySpheroids[1]->e);
-                printf("            boundary planes:\n");
-                for (l = 0; l < grid.cells[i][j][k].t.planeCount; l++)
-                {
-                    printf("                point: %lf, %lf, %lf,   normal: %lf, %lf, %lf\n", grid.cells[i][j][k].t.boundaryPlanes[l].point.x,
-                                                                                              grid.cells[i][j][k].t.boundaryPlanes[l].point.y,
-                                                                                              grid.cells[i][j][k].t.boundaryPlanes[l].point.z,
-                                                                                              grid.cells[i][j][k].t.boundaryPlanes[l].normal.x,
-                                                                                              grid.cells[i][j][k].t.boundaryPlanes[l].normal.y,
-                                                                                              grid.cells[i][j][k].t.boundaryPlanes[l].normal.z);
+                    capacity *= 2;
+                    *satPos = realloc(*satPos, sizeof(Vector) * capacity);
+                    *recPos = realloc(*recPos, sizeof(Vector) * capacity);
                 }
+                (*satPos)[count] = sat;
+                (*recPos)[count] = stations[i];
+                count++;
             }
         }
     }
-    Vector satPos = createVector(13860000, 13860000, 100000);
-    Vector recPos = createVector(4510000, 4510000, 100000);
-    LineSectorList* lsl = getLineSectorsFromModel(satPos, recPos, &grid);
+    return count;
+}
+
+/*
+ * Checks the sectors of one ray, returns the absolute error of the
+ * total length (the sectors must cover the ray from the upper to the
+ * lower boundary spheroid) or of the continuity, whichever is larger.
+ */
+double checkLineSectors(Vector satPos, Vector recPos, LineSectorList* lsl, QuadraticGrid* grid)
+{
+    Ray r = createRay(vec3FromVector(satPos), vec3FromVector(recPos));
+    double upperDistances[2];
+    double lowerDistances[2];
+    intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[grid->layerNum]), upperDistances);
+    intersectRaySpheroidDistances(r, &(grid->boundarySpheroids[0]), lowerDistances);
+    double error = 0;
+    double sum = 0;
+    int cellCount = grid->layerNum * (grid->northNum + grid->southNum) * (grid->eastNum + grid->westNum);
     LineSectorList* tmp = lsl;
-    while(tmp)
+    while (tmp)
     {
-        printf("Linesector %d:    cell: (%d, %d, %d)    length: %lf\n", i, tmp->layerId, tmp->lateralId, tmp->longitudinalId, tmp->length);
+        sum += tmp->length;
+        if (tmp->cellId < 0 || tmp->cellId >= cellCount)
+        {
+            return INFINITY;
+        }
+        if (tmp->next)
+        {
+            double gap = vec3Length(vec3Subtract(tmp->next->cellIntersectionEntry, tmp->cellIntersectionExit));
+            error = gap > error ? gap : error;
+        }
         tmp = tmp->next;
-        i++;
     }
-    return 1;
-}
\ No newline at end of file
+    double lengthError = fabs(lowerDistances[0] - upperDistances[0] - sum);
+    return lengthError > error ? lengthError : error;
+}
+
+/*
+ * Checks that the midpoint of the sector lies in its cell by its geodetic
+ * coordinates. The boundaries are not the geodetic ones, so they have a
+ * tolerance:
+ * - a latitude plane goes through the origin and two vertexes on the
+ *   surface, the latitude is checked on the surface below the midpoint,
+ *   where the plane bulges poleward from the parallel between the vertexes
+ * - a layer spheroid is the WGS84 spheroid scaled by its height, so its
+ *   geodetic height decreases to height * (1 - flattening) at the poles
+ */
+int isLineSectorInCell(LineSectorList* lsl, QuadraticGrid* grid)
+{
+    Vec3 midpoint = vec3Scale(0.5, vec3Add(lsl->cellIntersectionEntry, lsl->cellIntersectionExit));
+    double latitude, longitude, height;
+    ecefToGeodetic(midpoint.x, midpoint.y, midpoint.z, WGS84_Spheroid.a, WGS84_Spheroid.e, &latitude, &longitude, &height);
+
+    double lowerHeight = grid->boundarySpheroids[lsl->layerId].a - WGS84_Spheroid.a;
+    double upperHeight = grid->boundarySpheroids[lsl->layerId + 1].a - WGS84_Spheroid.a;
+    if (height < lowerHeight * WGS84_Spheroid.b / WGS84_Spheroid.a - checkTolerance || height > upperHeight + checkTolerance)
+    {
+        return 0;
+    }
+
+    //the meridian planes are exact, the tolerance is checkTolerance in meters
+    double west = grid->boundaryLongitudes[lsl->longitudinalId];
+    double width = grid->boundaryLongitudes[lsl->longitudinalId + 1] - west;
+    double longitudeTolerance = checkTolerance / sqrt(midpoint.x * midpoint.x + midpoint.y * midpoint.y);
+    double longitudeOffset = fmod(longitude - west, 2 * M_PI);
+    if (longitudeOffset < 0)
+    {
+        longitudeOffset += 2 * M_PI;
+    }
+    if (longitudeOffset > width + longitudeTolerance && longitudeOffset < 2 * M_PI - longitudeTolerance)
+    {
+        return 0;
+    }
+
+    double surfaceScale = 1 / sqrt((midpoint.x * midpoint.x + midpoint.y * midpoint.y) * WGS84_Spheroid.invA2 +
+                                   midpoint.z * midpoint.z * WGS84_Spheroid.invB2);
+    double surfaceLatitude, surfaceLongitude, surfaceHeight;
+    ecefToGeodetic(midpoint.x * surfaceScale, midpoint.y * surfaceScale, midpoint.z * surfaceScale, WGS84_Spheroid.a, WGS84_Spheroid.e,
+                   &surfaceLatitude, &surfaceLongitude, &surfaceHeight);
+    double north = grid->boundaryLatitudes[lsl->lateralId];
+    double south = grid->boundaryLatitudes[lsl->lateralId + 1];
+    //the geocentric and geodetic bulge are the same: tan(bulged) = tan(latitude) / cos(width / 2)
+    double northTolerance = isPoleLatitude(north) ? 0 : atan(tan(fabs(north)) / cos(width / 2)) - fabs(north);
+    double southTolerance = isPoleLatitude(south) ? 0 : atan(tan(fabs(south)) / cos(width / 2)) - fabs(south);
+    return surfaceLatitude <= north + northTolerance + latitudeCheckTolerance &&
+           surfaceLatitude >= south - southTolerance - latitudeCheckTolerance;
+}
+
+int isSameLineSectorList(LineSectorList* a, LineSectorList* b)
+{
+    while (a && b)
+    {
+        if (a->cellId != b->cellId || fabs(a->length - b->length) > checkTolerance)
+        {
+            return 0;
+        }
+        a = a->next;
+        b = b->next;
+    }
+    return !a && !b;
+}
+
+double getElapsedSeconds(struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char** argv)
+{
+    struct arguments arguments;
+    memset(&arguments, 0, sizeof(struct arguments));
+    arguments.stationNum = 100;
+    arguments.epochNum = 240;
+    arguments.elevationMask = 10;
+    arguments.repeatNum = 3;
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    QuadraticGridSpec gridSpec;
+    initQuadraticGridSpec(&gridSpec);
+    gridSpec.latitudeUnit = 1;
+    gridSpec.longitudeUnit = 1;
+    gridSpec.cellNumLimitLat = 15;
+    gridSpec.cellNumLimitLong = 15;
+    setUniformLayerBoundaryHeights(&gridSpec, 10);
+    if (arguments.gridSpecFile)
+    {
+        loadQuadraticGridSpec(arguments.gridSpecFile, &gridSpec);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    QuadraticGrid grid = createQuadraticGridFromSpec(&gridSpec);
+    deleteQuadraticGridSpec(&gridSpec);
+    int cellCount = grid.layerNum * (grid.northNum + grid.southNum) * (grid.eastNum + grid.westNum);
+    printf("Grid: %d layers, %d x %d columns, %d cells, built in %lf s\n", grid.layerNum,
+           grid.northNum + grid.southNum, grid.eastNum + grid.westNum, cellCount, getElapsedSeconds(&start));
+
+    Vector* stations;
+    int stationNum = arguments.stationFile ? loadStations(arguments.stationFile, &stations)
+                                           : createSyntheticStations(&grid, arguments.stationNum, &stations);
+    Vector* satPos;
+    Vector* recPos;
+    int rayCount = createRays(stations, stationNum, arguments.epochNum, arguments.elevationMask, &satPos, &recPos);
+    printf("Rays: %d stations, %d epochs, %d rays above %.1lf degrees\n", stationNum, arguments.epochNum, rayCount, arguments.elevationMask);
+
+    LineSectorList** results = malloc(sizeof(LineSectorList*) * rayCount);
+    double bestTime = INFINITY;
+    int tracedCount = 0;
+    long sectorCount = 0;
+    int run;
+    for (run = 0; run < arguments.repeatNum || run == 0; run++)
+    {
+        if (run)
+        {
+            int i;
+            for (i = 0; i < rayCount; i++)
+            {
+                deleteLineSectorList(&(results[i]));
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        getLineSectorsFromModelBatch(satPos, recPos, rayCount, &grid, results);
+        double elapsed = getElapsedSeconds(&start);
+        bestTime = elapsed < bestTime ? elapsed : bestTime;
+    }
+    int failedCount = 0;
+    long misplacedCount = 0;
+    double maxError = 0;
+    int i;
+    for (i = 0; i < rayCount; i++)
+    {
+        if (!results[i])
+        {
+            continue;
+        }
+        tracedCount++;
+        int isContained = 1;
+        LineSectorList* tmp;
+        for (tmp = results[i]; tmp; tmp = tmp->next)
+        {
+            sectorCount++;
+            if (!isLineSectorInCell(tmp, &grid))
+            {
+                misplacedCount++;
+                isContained = 0;
+            }
+        }
+        double error = checkLineSectors(satPos[i], recPos[i], results[i], &grid);
+        maxError = error > maxError ? error : maxError;
+        if (error > checkTolerance || !isContained)
+        {
+            failedCount++;
+        }
+    }
+    //the rays missing the grid are rejected at the shell, the traced ones are reported separately
+    printf("Benchmark: %d rays (%d traced, %ld sectors) in %lf s,    %.0lf rays/s,    %.0lf traced rays/s,    %.0lf sectors/s\n",
+           rayCount, tracedCount, sectorCount, bestTime, rayCount / bestTime, tracedCount / bestTime, sectorCount / bestTime);
+    printf("Check: %d rays failed,    %ld sectors outside their cell,    max length/continuity error: %le m\n",
+           failedCount, misplacedCount, maxError);
+
+    if (arguments.isSingleChecked)
+    {
+        LineSectorList** singleResults = malloc(sizeof(LineSectorList*) * rayCount);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < rayCount; i++)
+        {
+            singleResults[i] = getLineSectorsFromModel(satPos[i], recPos[i], &grid);
+        }
+        double elapsed = getElapsedSeconds(&start);
+        int differentCount = 0;
+        for (i = 0; i < rayCount; i++)
+        {
+            if (!isSameLineSectorList(results[i], singleResults[i]))
+            {
+                differentCount++;
+            }
+            deleteLineSectorList(&(singleResults[i]));
+        }
+        printf("Single: %lf s,    %.0lf rays/s,    %d rays differ from the batch tracing\n",
+               elapsed, rayCount / elapsed, differentCount);
+        failedCount += differentCount;
+        free(singleResults);
+    }
+
+    for (i = 0; i < rayCount; i++)
+    {
+        deleteLineSectorList(&(results[i]));
+    }
+    free(results);
+    free(satPos);
+    free(recPos);
+    free(stations);
+    deleteQuadraticGrid(&grid);
+    return failedCount ? 1 : 0;
+}
@@ -3,15 +3,68 @@
 
 #include <geometryPrimitives.h>
 
+#define GPS_SATELLITE_COUNT 32
+
 extern const long unixUTCMinusGPS;
 
 long utcToGPST(long utc);
 long gpstToUTC(long gpst);
 
+//Keplerian elements of one PRN from a YUMA almanac
+typedef struct AlmanacEntry
+{
+    int isValid;                    //the PRN is in the file and healthy
+    int week;
+    double eccentricity;
+    double referenceTime;           //time of applicability [s of week]
+    double inclination;
+    double rateOfRightAscension;
+    double sqrtA;
+    double rightAscension;          //at the start of the week
+    double argumentOfPerigee;
+    double meanAnomaly;             //at the reference time
+
+    //constants of the position evaluation, set by the loader
+    double meanMotion;
+    double nodeAtZero;              //longitude of the node in ECEF at t = 0
+    double nodeRate;                //rate of right ascension minus earth rotation
+    double aCosPerigee, aSinPerigee;
+    double bCosPerigee, bSinPerigee;
+    double cosInclination, sinInclination;
+}AlmanacEntry;
+
+//The almanac parsed once, indexed by PRN - 1
+typedef struct GPSAlmanac
+{
+    AlmanacEntry entries[GPS_SATELLITE_COUNT];
+}GPSAlmanac;
+
+void initGPSAlmanac(GPSAlmanac* almanac);
+//returns 0 if the file can not be read
+int loadGPSAlmanac(char* almanacFile, GPSAlmanac* almanac);
+
+//ECEF positions of every PRN at a list of epochs, the coordinates of one PRN are contiguous
+typedef struct SatellitePositionTable
+{
+    int epochCount;
+    double* x;                      //[(PRN - 1) * epochCount + epoch]
+    double* y;
+    double* z;
+}SatellitePositionTable;
+
+void initSatellitePositionTable(SatellitePositionTable* table);
+void deleteSatellitePositionTable(SatellitePositionTable* table);
+//zero vector for invalid PRNs
+Vector getSatellitePositionFromTable(SatellitePositionTable* table, int epoch, int prn);
+
+//ECEF position of one satellite at t seconds of the GPS week
+Vector calculateGPSSatellitePosition(AlmanacEntry* entry, double t);
+//times are seconds of the GPS week, the table is (re)allocated
+void calculateGPSSatellitePositionsBatch(GPSAlmanac* almanac, double* times, int epochCount, SatellitePositionTable* table);
 //result must be full zero array
-void calculateGPSSatellitePositions(double t, char* almanacFile, Vector*** results);
+void calculateGPSSatellitePositions(double t, GPSAlmanac* almanac, Vector*** results);
 double calculateTimeOfGPSWeek(long gpsTime);
 
 
 
-#endif //ALMANAC_H
\ No newline at end of file
+#endif //ALMANAC_H
@@ -2,34 +2,78 @@
 #define COORDINATES_H
 
 #include <ionosphereGrid.h>
-
+#include <rayCache.h>
+#include <almanac.h>
+
+/*
+ * Satellite positions of the measurement epochs, GPS_SATELLITE_COUNT per epoch
+ * in one block. Epochs on the startTime + k * interval grid are found by index,
+ * the others through an open addressing hash table.
+ */
 typedef struct GPSSatCoords
 {
-    long gpsTime;
-    Vector** coordinates;
-    struct GPSSatCoords* left;
-    struct GPSSatCoords* right;
+    long startTime;
+    long interval;
+    int slotCount;
+    int* slotEpochs;            //epoch of a grid slot, -1 if it has no measurement
+    int hashSize;               //power of two, 0 if every epoch is on the grid
+    long* hashTimes;
+    int* hashEpochs;            //-1 for an empty bucket
+    int epochCount;
+    Vector* coordinates;        //[epoch * GPS_SATELLITE_COUNT + satId]
+    char isValid[GPS_SATELLITE_COUNT];
 }GPSSatCoords;
 
-GPSSatCoords* createGPSSatCoords(long gpsTime, char* almanacFile);
-int insertGPSSatCoords(long gpsTime, char* almanacFile, GPSSatCoords** gpsSatCoordsTree);
-Vector** getGPSSatCoords(long gpsTime, GPSSatCoords* gpsSatCoordsTree);
-void deleteGPSSatCoordsTree(GPSSatCoords** gpsSatCoordsTree);
+void initGPSSatCoords(GPSSatCoords* gpsSatCoords);
+//gpsTimes may be unsorted and contain duplicates, interval <= 0 hashes every epoch
+void createGPSSatCoords(long* gpsTimes, int count, long interval, GPSAlmanac* almanac, GPSSatCoords* gpsSatCoords);
+//satId is PRN - 1, returns 0 for an unknown epoch or an unhealthy satellite
+Vector* getGPSSatCoords(long gpsTime, int satId, GPSSatCoords* gpsSatCoords);
+void deleteGPSSatCoords(GPSSatCoords* gpsSatCoords);
+
+
+/*
+ * Open addressing hash map from an integer key to a dense index. The index is
+ * the insertion order, so the tables below can keep their items in an array
+ * and use the position as a design matrix column.
+ */
+typedef struct IndexMap
+{
+    int count;
+    int capacity;               //power of two
+    long* keys;
+    int* indexes;               //-1 for an empty bucket
+}IndexMap;
+
+void initIndexMap(IndexMap* map);
+//returns the index of the key, isNew is set if it was added now (optional)
+int insertIndexMap(long key, IndexMap* map, int* isNew);
+//-1 if the key is not in the map
+int getIndexMapIndex(long key, IndexMap* map);
+void deleteIndexMap(IndexMap* map);
+//key of a station ID of at most 4 characters
+long getStationKey(char* stationId);
 
 
 typedef struct StationCoord
 {
     char stationId[5];
     Vector coord;
-    struct StationCoord* left;
-    struct StationCoord* right;
 }StationCoord;
 
-StationCoord* createStationCoord(char* stationId, Vector coord);
-int insertStationCoord(char* stationId, Vector coord, StationCoord** stationCoordTree);
-Vector* getStationCoord(char* stationId, StationCoord* stationCoordTree);
-void deleteStationCoordTree(StationCoord** stationCoordTree);
-void printStationCoordTree(StationCoord* stationCoordTree);
+typedef struct StationCoordTable
+{
+    IndexMap map;
+    StationCoord* items;        //in insertion order
+    int capacity;
+}StationCoordTable;
+
+void initStationCoordTable(StationCoordTable* table);
+//returns the index of the station, an existing station is not overwritten
+int insertStationCoord(char* stationId, Vector coord, StationCoordTable* table);
+Vector* getStationCoord(char* stationId, StationCoordTable* table);
+void deleteStationCoordTable(StationCoordTable* table);
+void printStationCoordTable(StationCoordTable* table);
 
 
 typedef struct Measurement
@@ -39,82 +83,116 @@ typedef struct Measurement
     char recId[5];
     double C1;
     double P2;
+    //sectors of the traced line while the grid is prepared (see main)
     LineSectorList* lineSectors;
-    struct Measurement* next;
+    //final sectors used by the design matrix
+    CompactLineSectors sectors;
 }Measurement;
 
 void initMeasurement(Measurement* meas);
-int insertMeasurementToListEnd(Measurement* meas, Measurement** measListRoot);
-void deleteMeasurementList(Measurement** measListRoot);
-void calculateLineSectors(Measurement* meas, GPSSatCoords* gpsSatcoordsRoot, StationCoord* stationCoordsRoot, QuadraticGrid* grid);
+
+//Measurements in one growable array
+typedef struct MeasurementList
+{
+    Measurement* items;
+    int count;
+    int capacity;
+}MeasurementList;
+
+void initMeasurementList(MeasurementList* measList);
+//the list takes over the line sectors of meas, returns the index of the measurement
+int appendMeasurement(Measurement* meas, MeasurementList* measList);
+//removes the measurements without line sectors in one pass keeping the order, returns the removed count
+int removeUntracedMeasurements(MeasurementList* measList);
+void deleteMeasurementList(MeasurementList* measList);
+//rayCache is optional (0), a cached trace is used if it matches the current satellite and receiver position
+void calculateLineSectors(Measurement* meas, GPSSatCoords* gpsSatCoords, StationCoordTable* stationCoords, QuadraticGrid* grid, RayCache* rayCache);
+//measurements traced together by the modeler, bounds the line sectors kept before compaction
+#define LINE_SECTOR_BATCH_SIZE 1024
+//same for "count" measurements, without a cache the rays are traced by getLineSectorsFromModelBatch()
+void calculateLineSectorsBatch(Measurement* measurements, int count, GPSSatCoords* gpsSatCoords, StationCoordTable* stationCoords, QuadraticGrid* grid, RayCache* rayCache);
 
 
 typedef struct StationDCB
 {
     char stationId[5];
     double dcb;
-    int preorderIndex;
-    struct StationDCB* left;
-    struct StationDCB* right;
 }StationDCB;
 
-StationDCB* createStationDCB(char* stationId, double dcb);
-int insertStationDCB(char* stationId, double dcb, StationDCB** stationDCBRoot);
-double* getStationDCB(char* stationId, StationDCB* stationDCBRoot);
-void deleteStationDCBTree(StationDCB** stationDCBRoot);
-int doStationDCBPreorderIndexing(StationDCB* stationDCBRoot, int lastIndex);
-int getStationDCBPreorderIndex(char* stationId, StationDCB* stationDCBRoot);
-void printStationDCBPreorder(StationDCB* stationDCBRoot);
+typedef struct StationDCBTable
+{
+    IndexMap map;
+    StationDCB* items;          //in insertion order
+    int capacity;
+}StationDCBTable;
+
+void initStationDCBTable(StationDCBTable* table);
+//returns the index of the station, an existing station is not overwritten
+int insertStationDCB(char* stationId, double dcb, StationDCBTable* table);
+double* getStationDCB(char* stationId, StationDCBTable* table);
+//-1 if the station is not in the table
+int getStationDCBIndex(char* stationId, StationDCBTable* table);
+void deleteStationDCBTable(StationDCBTable* table);
+void printStationDCBTable(StationDCBTable* table);
 
 
 typedef struct SatDCB
 {
     int satId;
     double dcb;
-    int preorderIndex;
-    struct SatDCB* left;
-    struct SatDCB* right;
 }SatDCB;
 
-SatDCB* createSatDCB(int satId, double dcb);
-int insertSatDCB(int satId, double dcb, SatDCB** satDCBRoot);
-double* getSatDCB(int satId, SatDCB* satDCBRoot);
-void deleteSatDCBTree(SatDCB** satDCBRoot);
-int doSatDCBPreorderIndexing(SatDCB* satDCBRoot, int lastIndex);
-int getSatDCBPreorderIndex(int satId, SatDCB* satDCBRoot);
+typedef struct SatDCBTable
+{
+    IndexMap map;
+    SatDCB* items;              //in insertion order
+    int capacity;
+}SatDCBTable;
+
+void initSatDCBTable(SatDCBTable* table);
+//returns the index of the satellite, an existing satellite is not overwritten
+int insertSatDCB(int satId, double dcb, SatDCBTable* table);
+double* getSatDCB(int satId, SatDCBTable* table);
+//-1 if the satellite is not in the table
+int getSatDCBIndex(int satId, SatDCBTable* table);
+void deleteSatDCBTable(SatDCBTable* table);
 
 
 typedef struct CellParameter
 {
+    //node ID with the trilinear node basis
     int cellId;
     double eDensity;
-    int preorderIndex;
-    struct CellParameter* left;
-    struct CellParameter* right;
 }CellParameter;
 
-CellParameter* createCellParameter(int cellId, double eDens);
-int insertCellParameter(int cellId, double eDens, CellParameter** cellParamRoot);
-double* getCellParameter(int cellId, CellParameter* cellParamRoot);
-void deleteCellParameter(CellParameter** cellParamRoot);
-int doCellParameterPreorderIndexing(CellParameter* cellParamRoot, int lastIndex);
-int getCellParameterPreorderIndex(int cellId, CellParameter* cellParamRoot);
-void printCellParameterPreorder(CellParameter* cellParamRoot);
+typedef struct CellParameterTable
+{
+    IndexMap map;
+    CellParameter* items;       //in insertion order, the index is the column of the cell
+    int capacity;
+}CellParameterTable;
+
+void initCellParameterTable(CellParameterTable* table);
+//returns the index of the cell, an existing cell is not overwritten
+int insertCellParameter(int cellId, double eDens, CellParameterTable* table);
+double* getCellParameter(int cellId, CellParameterTable* table);
+//-1 if the cell is not in the table
+int getCellParameterIndex(int cellId, CellParameterTable* table);
+void deleteCellParameterTable(CellParameterTable* table);
+void printCellParameterTable(CellParameterTable* table);
 
 
 typedef struct IonoVariables
 {
-    StationDCB* stationDCBRoot;
-    int stationCount;
-    SatDCB* satDCBRoot;
-    int satCount;
-    CellParameter* cellParameters;
-    int cellCount;
+    StationDCBTable stationDCBs;
+    SatDCBTable satDCBs;
+    CellParameterTable cellParameters;
     double* corrections;
     int corrCount;
 }IonoVariables;
 
-IonoVariables* createIonoVariables(Measurement* measRoot, QuadraticGrid* grid);
+//the cell parameters are left empty, they are registered with the columns of the alakmatrix (see createAlakMatrix())
+IonoVariables* createIonoVariables(MeasurementList* measList);
 void deleteIonoVariables(IonoVariables** IonoVariables);
 
 #endif //COORDINATES_H
\ No newline at end of file
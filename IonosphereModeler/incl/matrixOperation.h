@@ -3,17 +3,72 @@
 
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_blas.h>
+#include <gsl/gsl_errno.h>
 #include <containers.h>
 #include <ionosphereGrid.h>
+#include <gridBasis.h>
 
 extern const double freqC1;
 extern const double freqP2;
 
-gsl_matrix* createAlakMatrix(IonoVariables** vars, Measurement* measRoot, QuadraticGrid* grid);
+//Matrix in compressed sparse row form, the columns of a row are increasing
+typedef struct SparseMatrix
+{
+    int rowCount;
+    int columnCount;
+    int* rowStarts;             //rowCount + 1 entries, the last one is the nonzero count
+    int* columns;
+    double* values;
+}SparseMatrix;
 
-void kiegyenlites(gsl_matrix* alakMatrix, gsl_matrix* sulyMatrix,
+void deleteSparseMatrix(SparseMatrix** matrix);
+//y = alpha * op(A) * x + beta * y like gsl_blas_dgemv, y is not read when beta is 0
+void sparseDgemv(CBLAS_TRANSPOSE_t transA, double alpha, SparseMatrix* A, gsl_vector* x, double beta, gsl_vector* y);
+//writes every element in rows of space separated values, for debugging
+int exportSparseMatrixDense(SparseMatrix* matrix, char* fileName);
+
+/*
+ * Creates the design matrix, one row per measurement. The columns are the
+ * cells (the sector lengths are the coefficients) or, with the trilinear
+ * node basis, the nodes (the integrated basis weights are the coefficients).
+ */
+SparseMatrix* createAlakMatrix(IonoVariables** vars, MeasurementList* measList, QuadraticGrid* grid, GridBasis basis);
+
+/*
+ * Creates the smoothness regularization rows of the parameters over the
+ * grid topology. The cell neighbors are taken from QuadraticGridCell's
+ * neighborIds, the node neighbors are the adjacent nodes along the
+ * boundaries. Neighbors in the next layer get verticalWeight, the others
+ * horizontalWeight. Neighbors without a parameter are left out.
+ * differenceOrder 1: one row per neighboring pair, weight * (x_i - x_j)
+ * differenceOrder 2: one row per parameter, sum of weight * (x_i - x_j)
+ *                    over the neighbors (weighted Laplacian)
+ * The cell IDs must be the ones of the uniform grid, it can not be used
+ * after adaptive refinement (the leaves are renumbered).
+ */
+SparseMatrix* createRegularizationMatrix(IonoVariables* vars, QuadraticGrid* grid, GridBasis basis,
+                                         int differenceOrder, double horizontalWeight, double verticalWeight);
+
+//the weight matrix is diagonal, sulyVektor holds its diagonal
+//the regularization rows R (may be 0) add R^T * R to the normal matrix
+//kofaktorVektor receives the diagonal of (A^T * P * A + R^T * R)^-1, it is skipped when 0
+void kiegyenlites(SparseMatrix* alakMatrix, gsl_vector* sulyVektor, SparseMatrix* regularization,
                   gsl_vector* paramStartVektor, gsl_vector* paramJavVektor,
                   gsl_vector* meresVektor, gsl_vector* meresJavVektor,
-                  gsl_vector* allandok, int iterations);
+                  gsl_vector* allandok, gsl_vector* kofaktorVektor, int iterations);
+
+/*
+ * Solves the weighted least squares problem
+ *     min |P^1/2 * (A * x - l)|^2 + |R * x|^2 + damping^2 * |x|^2
+ * with conjugate gradients on the normal equations (CGLS). Only products
+ * with A and R are used, so the memory is proportional to the nonzeros.
+ * The regularization rows R may be 0. paramVektor holds the start values
+ * and receives the solution. The iteration stops when the norm of the
+ * normal equation residual falls below tolerance times |A^T * P * l|,
+ * or after maxIterations. Returns the number of iterations.
+ */
+int solveCGLS(SparseMatrix* alakMatrix, gsl_vector* sulyVektor, gsl_vector* tisztaTagVektor,
+              SparseMatrix* regularization, double damping,
+              double tolerance, int maxIterations, gsl_vector* paramVektor);
 
 #endif //MATRIXOPERATION_H
\ No newline at end of file
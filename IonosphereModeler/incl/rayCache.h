@@ -0,0 +1,59 @@
+#ifndef RAY_CACHE_H
+#define RAY_CACHE_H
+
+#include <stdio.h>
+#include <ionosphereGrid.h>
+
+/*
+ * Persistent cache of traced lines. The ray geometry only depends on the
+ * grid, the receiver and the satellite position at the epoch, so the
+ * horizontal traces (see createHorizontalTrace()) are stored in a file
+ * keyed by the horizontal grid hash, station ID, PRN and GPS time. Later
+ * runs on the same data skip the tracing, even if the layer heights of
+ * the grid are changed, since the line sectors are calculated from the
+ * trace by intersecting only the boundary spheroids.
+ */
+typedef struct RayCacheEntry
+{
+    long gpsTime;
+    int satId;
+    char recId[5];
+    int isUsed;
+    HorizontalTrace trace;
+}RayCacheEntry;
+
+typedef struct RayCache
+{
+    FILE* file;
+    unsigned long long horizontalHash;
+    RayCacheEntry* entries;
+    int capacity;
+    int count;
+    int hitCount;
+    int missCount;
+    //cached traces not covering the layers of the grid or not matching the satellite and receiver position
+    int retraceCount;
+}RayCache;
+
+/*
+ * Opens or creates the cache file. Entries stored for different side
+ * boundaries of the grid are dropped and the file is rewritten.
+ */
+RayCache* openRayCache(char* cacheFile, QuadraticGrid* grid);
+
+/*
+ * Returns the stored trace of the ray, or 0 if the ray is not in the cache.
+ * The trace is owned by the cache.
+ */
+HorizontalTrace* getRayCacheTrace(RayCache* rayCache, long gpsTime, int satId, char* recId);
+
+/*
+ * Stores the trace of the ray in memory, replacing the previous one, and
+ * appends it to the cache file. The cache takes over the crossings of
+ * the trace.
+ */
+void insertRayCacheTrace(RayCache* rayCache, long gpsTime, int satId, char* recId, HorizontalTrace* trace);
+
+void closeRayCache(RayCache** rayCache);
+
+#endif //RAY_CACHE_H
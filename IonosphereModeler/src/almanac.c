@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <vectorMath.h>
 #include <almanac.h>
 
 
@@ -18,153 +19,295 @@ long gpstToUTC(long gpst)
     return gpst + unixUTCMinusGPS;
 }
 
-void calculateGPSSatellitePositions(double t, char* almanacFile, Vector*** results)
-{
-    char string[80], name[30], value[30], *pstr;
-    FILE *pinfile, *poutfile;
-    double e, t0, i, inc, omegadot, sqrta, omega0, kis_omega, m0, nu, omega_e;
-    double n, kozep_anom, exc_anom, exc_anom1, valod_anom, r, v, u1, u2, nagy_omega;
-    double x, y, z, x_ecef, y_ecef, z_ecef;
-    int id, health, week;
+static const double nu = 3.986004418E+14;
+static const double omega_e = 7.2921151467E-05;
 
-    if (!(pinfile = fopen(almanacFile,"rt")))
-    {
-        printf("Can not find input almanac file\n");
-        exit(-1);
-    }
+//splits a YUMA line into the 27 character name field and the value after it
+static int readAlmanacLine(FILE* pinfile, char* name, char* value)
+{
+    char string[80], *pstr;
 
-    if(*results)
+    if (!fgets(string, 80, pinfile))
     {
-        free(*results);
+        return 0;
     }
-    *results = malloc(sizeof(Vector*) * 32);
-    int j;
-    for (j = 0; j < 32; j++)
+    pstr = name;
+    *pstr = '\0';
+    strncat(name,string,27);
+    pstr = value;
+    *pstr = '\0';
+    if (strlen(string) > 27)
     {
-        (*results)[j] = 0;
+        pstr=string;
+        pstr+=27;
+        strcat(value,pstr);
     }
+    return 1;
+}
 
-    /*Állandók megadása:*/
+static void setAlmanacEntryConstants(AlmanacEntry* entry)
+{
+    double a = pow(entry->sqrtA,2);
+    double b = a*sqrt(1-pow(entry->eccentricity,2));
+
+    entry->meanMotion = sqrt(nu/pow(entry->sqrtA,6));
+    entry->nodeAtZero = entry->rightAscension - entry->rateOfRightAscension*entry->referenceTime;
+    entry->nodeRate = entry->rateOfRightAscension - omega_e;
+    entry->aCosPerigee = a*cos(entry->argumentOfPerigee);
+    entry->aSinPerigee = a*sin(entry->argumentOfPerigee);
+    entry->bCosPerigee = b*cos(entry->argumentOfPerigee);
+    entry->bSinPerigee = b*sin(entry->argumentOfPerigee);
+    entry->cosInclination = cos(entry->inclination);
+    entry->sinInclination = sin(entry->inclination);
+}
 
-    nu = 3.986004418E+14;
-    omega_e = 7.2921151467E-05;
+void initGPSAlmanac(GPSAlmanac* almanac)
+{
+    memset(almanac, 0, sizeof(GPSAlmanac));
+}
+
+int loadGPSAlmanac(char* almanacFile, GPSAlmanac* almanac)
+{
+    char name[30], value[80];
+    FILE *pinfile;
+    int i, id, health;
+    AlmanacEntry entry;
+
+    if (!(pinfile = fopen(almanacFile,"rt")))
+    {
+        printf("Can not find input almanac file\n");
+        return 0;
+    }
+    initGPSAlmanac(almanac);
 
     /*Almanac adatok beolvasása:*/
 
-    printf("Calculating GPS satellite positon for t = %.0lf from almanac\n", t);
-    while (!(feof(pinfile)))
+    while (readAlmanacLine(pinfile, name, value))
     {
-        fgets(string, 80, pinfile);
-        pstr = name;
-        *pstr = '\0';
-        strncat(name,string,27);
-        pstr = value;
-        *pstr = '\0';
-        pstr=string;
-        pstr+=27;
-        strcat(value,pstr);
-        if (!(strncmp(name,"**",2)))
+        if (strncmp(name,"**",2))
+        {
+            continue;
+        }
+        memset(&entry, 0, sizeof(AlmanacEntry));
+        id = 0;
+        health = -1;
+        for (i=0; i<13 && readAlmanacLine(pinfile, name, value); i++)
         {
-            for (i=0; i<13; i++)
+            if (!(strncmp(name,"ID",2)))
             {
-                fgets(string, 80, pinfile);
-                pstr = name;
-                *pstr = '\0';
-                strncat(name,string,27);
-                pstr = value;
-                *pstr = '\0';
-                pstr=string;
-                pstr+=27;
-                strcat(value,pstr);
-                if (!(strncmp(name,"ID",2)))
-                {
-                    id = atoi(value);
-                }
-                if (!(strncmp(name,"Hea",3)))
-                {
-                    health = atoi(value);
-                }
-                if (!(strncmp(name, "Ec",2)))
-                {
-                    e = atof(value);
-                }
-                if(!(strncmp(name,"Ti",2)))
-                {
-                    t0 = atof(value);
-                }
-                if(!(strncmp(name,"Or",2)))
-                {
-                    inc = atof(value);
-                }
-                if(!(strncmp(name,"Ra",2)))
-                {
-                    omegadot = atof(value);
-                }
-                if(!(strncmp(name,"SQ",2)))
-                {
-                    sqrta = atof(value);
-                }
-                if(!(strncmp(name,"Ri",2)))
-                {
-                    omega0 = atof(value);
-                }
-                if(!(strncmp(name,"Ar",2)))
-                {
-                    kis_omega = atof(value);
-                }
-                if(!(strncmp(name,"Mea",3)))
-                {
-                    m0 = atof(value);
-                }
-                if(!(strncmp(name,"we",2)))
-                {
-                    week = atoi(value);
-                }
+                id = atoi(value);
             }
-
-            /* Számítások: */
-
-            n = sqrt(nu/pow(sqrta,6));
-            kozep_anom  = m0 + n*(t-t0);
-            exc_anom1 = kozep_anom + e*sin(kozep_anom);
-            while(exc_anom - exc_anom1 > 0.000001 || exc_anom - exc_anom1 < -0.000001)
+            if (!(strncmp(name,"Hea",3)))
+            {
+                health = atoi(value);
+            }
+            if (!(strncmp(name, "Ec",2)))
+            {
+                entry.eccentricity = atof(value);
+            }
+            if(!(strncmp(name,"Ti",2)))
+            {
+                entry.referenceTime = atof(value);
+            }
+            if(!(strncmp(name,"Or",2)))
+            {
+                entry.inclination = atof(value);
+            }
+            if(!(strncmp(name,"Ra",2)))
             {
-                exc_anom = kozep_anom + e*sin(exc_anom1);
-                exc_anom1 = kozep_anom + e*sin(exc_anom);
+                entry.rateOfRightAscension = atof(value);
             }
+            if(!(strncmp(name,"SQ",2)))
+            {
+                entry.sqrtA = atof(value);
+            }
+            if(!(strncmp(name,"Ri",2)))
+            {
+                entry.rightAscension = atof(value);
+            }
+            if(!(strncmp(name,"Ar",2)))
+            {
+                entry.argumentOfPerigee = atof(value);
+            }
+            if(!(strncmp(name,"Mea",3)))
+            {
+                entry.meanAnomaly = atof(value);
+            }
+            if(!(strncmp(name,"we",2)))
+            {
+                entry.week = atoi(value);
+            }
+        }
+        if (id < 1 || id > GPS_SATELLITE_COUNT)
+        {
+            printf("Invalid PRN %d in almanac file %s\n", id, almanacFile);
+            continue;
+        }
+        entry.isValid = (health == 0);
+        setAlmanacEntryConstants(&entry);
+        almanac->entries[id - 1] = entry;
+    }
+    fclose(pinfile);
+    return 1;
+}
 
-            valod_anom=2*atan(sqrt((1+e)/(1-e))*tan(exc_anom/2));
+void initSatellitePositionTable(SatellitePositionTable* table)
+{
+    table->epochCount = 0;
+    table->x = 0;
+    table->y = 0;
+    table->z = 0;
+}
 
-            r = pow(sqrta,2)*(1-e*cos(exc_anom));
-            v = ((n*pow(sqrta,4)))/r*sqrt(1-pow(e*cos(exc_anom),2));
+void deleteSatellitePositionTable(SatellitePositionTable* table)
+{
+    if (table->x)
+    {
+        free(table->x);
+    }
+    if (table->y)
+    {
+        free(table->y);
+    }
+    if (table->z)
+    {
+        free(table->z);
+    }
+    initSatellitePositionTable(table);
+}
 
-            u1 = r*cos(valod_anom);
-            u2 = r*sin(valod_anom);
+Vector getSatellitePositionFromTable(SatellitePositionTable* table, int epoch, int prn)
+{
+    long index = (long)(prn - 1) * table->epochCount + epoch;
+    return createVector(table->x[index], table->y[index], table->z[index]);
+}
 
-            /*Forgatás:*/
+/*
+ * Newton's method on Kepler's equation from E = M. The error is squared by
+ * every step, three steps reach double precision for e < 0.1 (GPS orbits
+ * are below 0.03), so the step count is fixed and the epoch loop has no
+ * data dependent branch. The sine and cosine of the result are updated
+ * from the last step instead of being evaluated again.
+ *
+ * The epochs are processed in blocks, every sine and cosine of a block is
+ * evaluated by one sinCosBatch call, that uses AVX2 if it is available.
+ */
+#define KEPLER_NEWTON_STEPS 3
+#define ALMANAC_EPOCH_BLOCK 256
 
-            nagy_omega = omega0 + omegadot*(t-t0);
+static void evaluateAlmanacEntry(AlmanacEntry* entry, double* times, int count, double* x, double* y, double* z)
+{
+    double meanAnomaly[ALMANAC_EPOCH_BLOCK];
+    double excAnom[ALMANAC_EPOCH_BLOCK];
+    double sinE[ALMANAC_EPOCH_BLOCK];
+    double cosE[ALMANAC_EPOCH_BLOCK];
+    double e = entry->eccentricity;
+    int i, k;
 
-            x = u1*(cos(nagy_omega)*cos(kis_omega)-sin(nagy_omega)*sin(kis_omega)*cos(inc))+u2*(-cos(nagy_omega)*sin(kis_omega)-sin(nagy_omega)*cos(kis_omega)*cos(inc));
+    for (i = 0; i < count; i++)
+    {
+        meanAnomaly[i] = entry->meanAnomaly + entry->meanMotion*(times[i] - entry->referenceTime);
+        excAnom[i] = meanAnomaly[i];
+    }
+    for (k = 0; k < KEPLER_NEWTON_STEPS; k++)
+    {
+        sinCosBatch(count, excAnom, sinE, cosE);
+        for (i = 0; i < count; i++)
+        {
+            double step = (meanAnomaly[i] - excAnom[i] + e*sinE[i]) / (1 - e*cosE[i]);
+            excAnom[i] += step;
+            if (k == KEPLER_NEWTON_STEPS - 1)
+            {
+                double sinLast = sinE[i];
+                sinE[i] += cosE[i]*step;
+                cosE[i] -= sinLast*step;
+            }
+        }
+    }
 
-            y = u1*(sin(nagy_omega)*cos(kis_omega)+cos(nagy_omega)*sin(kis_omega)*cos(inc))+u2*(-sin(nagy_omega)*sin(kis_omega)+cos(nagy_omega)*cos(kis_omega)*cos(inc));
+    //the node angles reuse the buffer of the eccentric anomaly
+    double* node = excAnom;
+    double* sinNode = meanAnomaly;
+    double cosNode[ALMANAC_EPOCH_BLOCK];
+    for (i = 0; i < count; i++)
+    {
+        //position in the orbital plane rotated by the argument of perigee
+        double planeX = entry->aCosPerigee*(cosE[i] - e) - entry->bSinPerigee*sinE[i];
+        double planeY = entry->aSinPerigee*(cosE[i] - e) + entry->bCosPerigee*sinE[i];
+        x[i] = planeX;
+        y[i] = planeY;
+        //longitude of the node in ECEF, the earth rotation is already included
+        node[i] = entry->nodeAtZero + entry->nodeRate*times[i];
+    }
+    sinCosBatch(count, node, sinNode, cosNode);
+    for (i = 0; i < count; i++)
+    {
+        double planeX = x[i];
+        double planeY = y[i];
+        x[i] = planeX*cosNode[i] - planeY*entry->cosInclination*sinNode[i];
+        y[i] = planeX*sinNode[i] + planeY*entry->cosInclination*cosNode[i];
+        z[i] = planeY*entry->sinInclination;
+    }
+}
 
-            z = u1*(sin(kis_omega)*sin(inc))+u2*(cos(kis_omega)*sin(inc));
+Vector calculateGPSSatellitePosition(AlmanacEntry* entry, double t)
+{
+    double x, y, z;
+    evaluateAlmanacEntry(entry, &t, 1, &x, &y, &z);
+    return createVector(x, y, z);
+}
 
-            x_ecef = x*cos(omega_e*t)+y*sin(omega_e*t);
-            y_ecef = -x*sin(omega_e*t)+y*cos(omega_e*t);
-            z_ecef = z;
+void calculateGPSSatellitePositionsBatch(GPSAlmanac* almanac, double* times, int epochCount, SatellitePositionTable* table)
+{
+    long size = (long)epochCount * GPS_SATELLITE_COUNT;
+    int i, j;
 
-            /*Kiírás:*/
+    deleteSatellitePositionTable(table);
+    table->epochCount = epochCount;
+    table->x = calloc(size, sizeof(double));
+    table->y = calloc(size, sizeof(double));
+    table->z = calloc(size, sizeof(double));
 
-            if (health == 0)
-            {
-                (*results)[id-1] = malloc(sizeof(Vector));
-                *(*results)[id-1] = createVector(x_ecef, y_ecef, z_ecef);
-            }
+    for (j = 0; j < GPS_SATELLITE_COUNT; j++)
+    {
+        AlmanacEntry* entry = &(almanac->entries[j]);
+        if (!entry->isValid)
+        {
+            continue;
+        }
+        double* x = table->x + (long)j * epochCount;
+        double* y = table->y + (long)j * epochCount;
+        double* z = table->z + (long)j * epochCount;
+        for (i = 0; i < epochCount; i += ALMANAC_EPOCH_BLOCK)
+        {
+            int count = epochCount - i < ALMANAC_EPOCH_BLOCK ? epochCount - i : ALMANAC_EPOCH_BLOCK;
+            evaluateAlmanacEntry(entry, times + i, count, x + i, y + i, z + i);
         }
     }
-    fclose(pinfile);
+}
+
+void calculateGPSSatellitePositions(double t, GPSAlmanac* almanac, Vector*** results)
+{
+    SatellitePositionTable table;
+    int j;
+
+    if(*results)
+    {
+        free(*results);
+    }
+    *results = malloc(sizeof(Vector*) * GPS_SATELLITE_COUNT);
+    initSatellitePositionTable(&table);
+    calculateGPSSatellitePositionsBatch(almanac, &t, 1, &table);
+    for (j = 0; j < GPS_SATELLITE_COUNT; j++)
+    {
+        (*results)[j] = 0;
+        if (almanac->entries[j].isValid)
+        {
+            (*results)[j] = malloc(sizeof(Vector));
+            *(*results)[j] = getSatellitePositionFromTable(&table, 0, j + 1);
+        }
+    }
+    deleteSatellitePositionTable(&table);
 }
 
 double calculateTimeOfGPSWeek(long gpsTime)
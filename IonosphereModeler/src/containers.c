@@ -3,557 +3,660 @@
 #include <string.h>
 #include <almanac.h>
 #include <containers.h>
+#include <gridBasis.h>
 
 
-GPSSatCoords* createGPSSatCoords(long gpsTime, char* almanacFile)
+void initGPSSatCoords(GPSSatCoords* gpsSatCoords)
 {
-    GPSSatCoords* retVal = malloc(sizeof(GPSSatCoords));
-    memset(retVal, 0, sizeof(GPSSatCoords));
-    retVal->gpsTime = gpsTime;
-    double t = calculateTimeOfGPSWeek(gpsTime);
-    calculateGPSSatellitePositions(t, almanacFile, &(retVal->coordinates));
-    retVal->left = 0;
-    retVal->right = 0;
-    return retVal;
+    memset(gpsSatCoords, 0, sizeof(GPSSatCoords));
 }
 
-int insertGPSSatCoords(long gpsTime, char* almanacFile, GPSSatCoords** gpsSatCoordsTree)
+static int compareGPSTimes(const void* a, const void* b)
 {
-    if (!(*gpsSatCoordsTree))
-    {
-        *gpsSatCoordsTree = createGPSSatCoords(gpsTime, almanacFile);
-        return 1;
-    }
-    if ((*gpsSatCoordsTree)->gpsTime < gpsTime)
-    {
-        return insertGPSSatCoords(gpsTime, almanacFile, &((*gpsSatCoordsTree)->left));
-    }
-    else if ((*gpsSatCoordsTree)->gpsTime > gpsTime)
-    {
-        return insertGPSSatCoords(gpsTime, almanacFile, &((*gpsSatCoordsTree)->right));
-    }
-    return 0;
+    long ta = *((long*)a);
+    long tb = *((long*)b);
+    return (ta > tb) - (ta < tb);
 }
 
-Vector** getGPSSatCoords(long gpsTime, GPSSatCoords* gpsSatCoordsTree)
+//Fibonacci hashing, the high bits of the product are well mixed
+static int getHashBucket(long key, int capacity)
 {
-    if (gpsSatCoordsTree)
-    {
-        if (gpsSatCoordsTree->gpsTime == gpsTime)
-        {
-            return gpsSatCoordsTree->coordinates;
-        }
-        else if (gpsSatCoordsTree->gpsTime < gpsTime)
-        {
-            return getGPSSatCoords(gpsTime, gpsSatCoordsTree->left);
-        }
-        else
-        {
-            return getGPSSatCoords(gpsTime, gpsSatCoordsTree->right);
-        }
-    }
-    return 0;
+    unsigned long hash = (unsigned long)key * 0x9E3779B97F4A7C15UL;
+    return (int)((hash >> 32) & (capacity - 1));
 }
 
-void deleteGPSSatCoordsTree(GPSSatCoords** gpsSatCoordsTree)
+static int getGPSSatCoordsHashBucket(long gpsTime, GPSSatCoords* gpsSatCoords)
 {
-    if (*gpsSatCoordsTree)
+    int bucket = getHashBucket(gpsTime, gpsSatCoords->hashSize);
+    while (gpsSatCoords->hashEpochs[bucket] >= 0 && gpsSatCoords->hashTimes[bucket] != gpsTime)
     {
-        deleteGPSSatCoordsTree(&((*gpsSatCoordsTree)->left));
-        deleteGPSSatCoordsTree(&((*gpsSatCoordsTree)->right));
-        if ((*gpsSatCoordsTree)->coordinates)
-        {
-            int i;
-            for (i = 0; i < 32; i++)
-            {
-                if((*gpsSatCoordsTree)->coordinates[i])
-                {
-                    free((*gpsSatCoordsTree)->coordinates[i]);
-                }
-            }
-            free((*gpsSatCoordsTree)->coordinates);
-        }
-        free(*gpsSatCoordsTree);
-        *gpsSatCoordsTree = 0;
+        bucket = (bucket + 1) & (gpsSatCoords->hashSize - 1);
     }
-    return;
+    return bucket;
 }
 
-
-StationCoord* createStationCoord(char* stationId, Vector coord)
+void createGPSSatCoords(long* gpsTimes, int count, long interval, GPSAlmanac* almanac, GPSSatCoords* gpsSatCoords)
 {
-    StationCoord* retVal = malloc(sizeof(StationCoord));
-    strcpy(retVal->stationId, stationId);
-    retVal->coord = coord;
-    retVal->left = 0;
-    retVal->right = 0;
-    return retVal;
-}
+    int i, j, epochCount = 0;
 
-int insertStationCoord(char* stationId, Vector coord, StationCoord** stationCoordTree)
-{
-    if(!(*stationCoordTree))
+    initGPSSatCoords(gpsSatCoords);
+    if (count <= 0)
     {
-        *stationCoordTree = createStationCoord(stationId, coord);
-        return 1;
+        return;
     }
-    if (strcmp(stationId, (*stationCoordTree)->stationId) < 0)
+
+    //distinct epochs in time order
+    long* epochs = malloc(sizeof(long) * count);
+    memcpy(epochs, gpsTimes, sizeof(long) * count);
+    qsort(epochs, count, sizeof(long), compareGPSTimes);
+    for (i = 0; i < count; i++)
     {
-        return insertStationCoord(stationId, coord, &((*stationCoordTree)->left));
+        if (!epochCount || epochs[epochCount - 1] != epochs[i])
+        {
+            epochs[epochCount++] = epochs[i];
+        }
     }
-    else if (strcmp(stationId, (*stationCoordTree)->stationId) > 0)
+    gpsSatCoords->epochCount = epochCount;
+    gpsSatCoords->startTime = epochs[0];
+
+    //the dense index is used if it is not much larger than the epoch count
+    int irregularCount = epochCount;
+    if (interval > 0)
     {
-        return insertStationCoord(stationId, coord, &((*stationCoordTree)->right));
+        long lastRegular = epochs[0];
+        irregularCount = 0;
+        for (i = 0; i < epochCount; i++)
+        {
+            if ((epochs[i] - epochs[0]) % interval)
+            {
+                irregularCount++;
+            }
+            else
+            {
+                lastRegular = epochs[i];
+            }
+        }
+        long slotCount = (lastRegular - epochs[0]) / interval + 1;
+        if (slotCount <= 4 * (long)epochCount)
+        {
+            gpsSatCoords->interval = interval;
+            gpsSatCoords->slotCount = (int)slotCount;
+            gpsSatCoords->slotEpochs = malloc(sizeof(int) * slotCount);
+            for (i = 0; i < slotCount; i++)
+            {
+                gpsSatCoords->slotEpochs[i] = -1;
+            }
+        }
+        else
+        {
+            irregularCount = epochCount;
+        }
     }
-    return 0;
-}
-
-Vector* getStationCoord(char* stationId, StationCoord* stationCoordTree)
-{
-    if(stationCoordTree)
+    if (irregularCount)
     {
-        if(strcmp(stationCoordTree->stationId, stationId) == 0)
+        gpsSatCoords->hashSize = 16;
+        while (gpsSatCoords->hashSize < 2 * irregularCount)
         {
-            return &(stationCoordTree->coord);
+            gpsSatCoords->hashSize *= 2;
         }
-        else if(strcmp(stationCoordTree->stationId, stationId) > 0)
+        gpsSatCoords->hashTimes = malloc(sizeof(long) * gpsSatCoords->hashSize);
+        gpsSatCoords->hashEpochs = malloc(sizeof(int) * gpsSatCoords->hashSize);
+        for (i = 0; i < gpsSatCoords->hashSize; i++)
         {
-            return getStationCoord(stationId, stationCoordTree->left);
+            gpsSatCoords->hashEpochs[i] = -1;
+        }
+    }
+    for (i = 0; i < epochCount; i++)
+    {
+        long offset = epochs[i] - gpsSatCoords->startTime;
+        if (gpsSatCoords->slotEpochs && !(offset % gpsSatCoords->interval))
+        {
+            gpsSatCoords->slotEpochs[offset / gpsSatCoords->interval] = i;
         }
         else
         {
-            return getStationCoord(stationId, stationCoordTree->right);
+            int bucket = getGPSSatCoordsHashBucket(epochs[i], gpsSatCoords);
+            gpsSatCoords->hashTimes[bucket] = epochs[i];
+            gpsSatCoords->hashEpochs[bucket] = i;
         }
     }
-    return 0;
-}
 
-void deleteStationCoordTree(StationCoord** stationCoordTree)
-{
-    if (*stationCoordTree)
+    //evaluate the almanac for every epoch at once and lay the positions out per epoch
+    double* times = malloc(sizeof(double) * epochCount);
+    for (i = 0; i < epochCount; i++)
     {
-        deleteStationCoordTree(&((*stationCoordTree)->left));
-        deleteStationCoordTree(&((*stationCoordTree)->right));
-        free(*stationCoordTree);
-        *stationCoordTree = 0;
+        times[i] = calculateTimeOfGPSWeek(epochs[i]);
     }
-    return;
-}
-
-void printStationCoordTree(StationCoord* stationCoordTree)
-{
-    if(stationCoordTree)
+    SatellitePositionTable table;
+    initSatellitePositionTable(&table);
+    calculateGPSSatellitePositionsBatch(almanac, times, epochCount, &table);
+    gpsSatCoords->coordinates = malloc(sizeof(Vector) * epochCount * GPS_SATELLITE_COUNT);
+    for (j = 0; j < GPS_SATELLITE_COUNT; j++)
     {
-        printStationCoordTree(stationCoordTree->left);
-        printf("station ID: %s,     X: %lf,    Y: %lf,    Z: %lf\n", stationCoordTree->stationId,
-                                                                     stationCoordTree->coord.x,
-                                                                     stationCoordTree->coord.y,
-                                                                     stationCoordTree->coord.z);
-        printStationCoordTree(stationCoordTree->right);
+        gpsSatCoords->isValid[j] = almanac->entries[j].isValid;
+        for (i = 0; i < epochCount; i++)
+        {
+            //only the coordinates are used by the ray tracing, the length is not computed
+            long index = (long)j * epochCount + i;
+            Vector* coordinate = &(gpsSatCoords->coordinates[(long)i * GPS_SATELLITE_COUNT + j]);
+            coordinate->x = table.x[index];
+            coordinate->y = table.y[index];
+            coordinate->z = table.z[index];
+            coordinate->length = 0;
+        }
     }
-    return;
+    deleteSatellitePositionTable(&table);
+    free(times);
+    free(epochs);
 }
 
-
-void initMeasurement(Measurement* meas)
+Vector* getGPSSatCoords(long gpsTime, int satId, GPSSatCoords* gpsSatCoords)
 {
-    memset(meas, 0, sizeof(Measurement));
-}
+    int epoch = -1;
 
-int insertMeasurementToListEnd(Measurement* meas, Measurement** measListRoot)
-{
-    if (*measListRoot)
+    if (satId < 0 || satId >= GPS_SATELLITE_COUNT || !gpsSatCoords->isValid[satId])
     {
-        return insertMeasurementToListEnd(meas, &((*measListRoot)->next));
+        return 0;
     }
-    else
+    long offset = gpsTime - gpsSatCoords->startTime;
+    if (gpsSatCoords->slotEpochs && offset >= 0 && !(offset % gpsSatCoords->interval) &&
+        offset / gpsSatCoords->interval < gpsSatCoords->slotCount)
     {
-        *measListRoot = meas;
-        return 1;
+        epoch = gpsSatCoords->slotEpochs[offset / gpsSatCoords->interval];
     }
-}
-
-void deleteMeasurementList(Measurement** measListRoot)
-{
-    if(!(*measListRoot))
+    else if (gpsSatCoords->hashSize)
     {
-        return;
+        epoch = gpsSatCoords->hashEpochs[getGPSSatCoordsHashBucket(gpsTime, gpsSatCoords)];
     }
-    else
+    if (epoch < 0)
     {
-        deleteMeasurementList(&((*measListRoot)->next));
-        deleteLineSectorList(&((*measListRoot)->lineSectors));
-        free(*measListRoot);
-        *measListRoot = 0;
+        return 0;
     }
+    return &(gpsSatCoords->coordinates[(long)epoch * GPS_SATELLITE_COUNT + satId]);
 }
 
-void calculateLineSectors(Measurement* meas, GPSSatCoords* gpsSatcoordsRoot, StationCoord* stationCoordsRoot, QuadraticGrid* grid)
+void deleteGPSSatCoords(GPSSatCoords* gpsSatCoords)
 {
-    Vector** gpsSatCoords = getGPSSatCoords(meas->gpsTime, gpsSatcoordsRoot);
-    Vector* satCoord = gpsSatCoords[meas->satId];
-    if(!satCoord)
+    if (gpsSatCoords->slotEpochs)
     {
-        meas->lineSectors = 0;
-        return;
+        free(gpsSatCoords->slotEpochs);
     }
-    Vector* recCoord = getStationCoord(meas->recId, stationCoordsRoot);
-    meas->lineSectors = getLineSectorsFromModel(*satCoord, *recCoord, grid);
+    if (gpsSatCoords->hashTimes)
+    {
+        free(gpsSatCoords->hashTimes);
+    }
+    if (gpsSatCoords->hashEpochs)
+    {
+        free(gpsSatCoords->hashEpochs);
+    }
+    if (gpsSatCoords->coordinates)
+    {
+        free(gpsSatCoords->coordinates);
+    }
+    initGPSSatCoords(gpsSatCoords);
 }
 
 
-StationDCB* createStationDCB(char* stationId, double dcb)
+void initIndexMap(IndexMap* map)
 {
-    StationDCB* stationDCB = malloc(sizeof(StationDCB));
-    memset(stationDCB, 0, sizeof(StationDCB));
-    memcpy(stationDCB->stationId, stationId, 5);
-    stationDCB->dcb = dcb;
-    return stationDCB;
+    memset(map, 0, sizeof(IndexMap));
 }
 
-int insertStationDCB(char* stationId, double dcb, StationDCB** stationDCBRoot)
+static int getIndexMapBucket(long key, IndexMap* map)
 {
-    if(!(*stationDCBRoot))
+    int bucket = getHashBucket(key, map->capacity);
+    while (map->indexes[bucket] >= 0 && map->keys[bucket] != key)
     {
-        *stationDCBRoot = createStationDCB(stationId, dcb);
-        return 1;
+        bucket = (bucket + 1) & (map->capacity - 1);
     }
-    if (strcmp(stationId, (*stationDCBRoot)->stationId) < 0)
-    {
-        return insertStationDCB(stationId, dcb, &((*stationDCBRoot)->left));
-    }
-    else if (strcmp(stationId, (*stationDCBRoot)->stationId) > 0)
-    {
-        return insertStationDCB(stationId, dcb, &((*stationDCBRoot)->right));
-    }
-    return 0;
+    return bucket;
 }
 
-double* getStationDCB(char* stationId, StationDCB* stationDCBRoot)
+int insertIndexMap(long key, IndexMap* map, int* isNew)
 {
-    if(stationDCBRoot)
+    int i;
+    if (isNew)
+    {
+        *isNew = 0;
+    }
+    //keep the load factor below one half
+    if (2 * (map->count + 1) > map->capacity)
     {
-        if(strcmp(stationDCBRoot->stationId, stationId) == 0)
+        long* oldKeys = map->keys;
+        int* oldIndexes = map->indexes;
+        int oldCapacity = map->capacity;
+        map->capacity = oldCapacity ? 2 * oldCapacity : 16;
+        map->keys = malloc(sizeof(long) * map->capacity);
+        map->indexes = malloc(sizeof(int) * map->capacity);
+        for (i = 0; i < map->capacity; i++)
         {
-            return &(stationDCBRoot->dcb);
+            map->indexes[i] = -1;
         }
-        else if(strcmp(stationDCBRoot->stationId, stationId) > 0)
+        for (i = 0; i < oldCapacity; i++)
         {
-            return getStationDCB(stationId, stationDCBRoot->left);
+            if (oldIndexes[i] >= 0)
+            {
+                int bucket = getIndexMapBucket(oldKeys[i], map);
+                map->keys[bucket] = oldKeys[i];
+                map->indexes[bucket] = oldIndexes[i];
+            }
         }
-        else
+        if (oldKeys)
         {
-            return getStationDCB(stationId, stationDCBRoot->right);
+            free(oldKeys);
+            free(oldIndexes);
         }
     }
-    return 0;
+    int bucket = getIndexMapBucket(key, map);
+    if (map->indexes[bucket] < 0)
+    {
+        map->keys[bucket] = key;
+        map->indexes[bucket] = map->count;
+        map->count++;
+        if (isNew)
+        {
+            *isNew = 1;
+        }
+    }
+    return map->indexes[bucket];
 }
 
-void deleteStationDCBTree(StationDCB** stationDCBRoot)
+int getIndexMapIndex(long key, IndexMap* map)
 {
-    if (*stationDCBRoot)
+    if (!map->count)
     {
-        deleteStationDCBTree(&((*stationDCBRoot)->left));
-        deleteStationDCBTree(&((*stationDCBRoot)->right));
-        free(*stationDCBRoot);
-        *stationDCBRoot = 0;
+        return -1;
     }
-    return;
+    return map->indexes[getIndexMapBucket(key, map)];
 }
 
-int doStationDCBPreorderIndexing(StationDCB* stationDCBRoot, int lastIndex)
+void deleteIndexMap(IndexMap* map)
 {
-    if(!stationDCBRoot)
+    if (map->keys)
     {
-        return -1;
+        free(map->keys);
     }
-    int newLastIndex = lastIndex;
-    if(stationDCBRoot->left)
+    if (map->indexes)
     {
-        newLastIndex = doStationDCBPreorderIndexing(stationDCBRoot->left, newLastIndex);
+        free(map->indexes);
     }
-    stationDCBRoot->preorderIndex = newLastIndex;
-    newLastIndex++;
-    if(stationDCBRoot->right)
+    initIndexMap(map);
+}
+
+long getStationKey(char* stationId)
+{
+    long key = 0;
+    int i;
+    for (i = 0; i < 4 && stationId[i]; i++)
     {
-        newLastIndex = doStationDCBPreorderIndexing(stationDCBRoot->right, newLastIndex);
+        key = (key << 8) | (unsigned char)stationId[i];
     }
-    return newLastIndex;
+    return key;
 }
 
-int getStationDCBPreorderIndex(char* stationId, StationDCB* stationDCBRoot)
+//makes room for one more item in the array of a table
+static void* growTableItems(void* items, int* capacity, int count, size_t itemSize)
 {
-    if(stationDCBRoot)
+    if (count < *capacity)
     {
-        if(strcmp(stationDCBRoot->stationId, stationId) == 0)
-        {
-            return stationDCBRoot->preorderIndex;
-        }
-        else if(strcmp(stationDCBRoot->stationId, stationId) > 0)
-        {
-            return getStationDCBPreorderIndex(stationId, stationDCBRoot->left);
-        }
-        else
-        {
-            return getStationDCBPreorderIndex(stationId, stationDCBRoot->right);
-        }
+        return items;
     }
-    return -1;
+    *capacity = *capacity ? 2 * *capacity : 16;
+    return realloc(items, itemSize * *capacity);
+}
+
+
+void initStationCoordTable(StationCoordTable* table)
+{
+    memset(table, 0, sizeof(StationCoordTable));
 }
 
-void printStationDCBPreorder(StationDCB* stationDCBRoot)
+int insertStationCoord(char* stationId, Vector coord, StationCoordTable* table)
 {
-    if(!stationDCBRoot)
+    int isNew;
+    int index = insertIndexMap(getStationKey(stationId), &(table->map), &isNew);
+    if (isNew)
     {
-        return;
+        table->items = growTableItems(table->items, &(table->capacity), index, sizeof(StationCoord));
+        memset(&(table->items[index]), 0, sizeof(StationCoord));
+        strncpy(table->items[index].stationId, stationId, 4);
+        table->items[index].coord = coord;
     }
-    printStationDCBPreorder(stationDCBRoot->left);
-    printf("station dcb variable: %d,    station Id: %s\n", stationDCBRoot->preorderIndex, stationDCBRoot->stationId);
-    printStationDCBPreorder(stationDCBRoot->right);
+    return index;
 }
 
-
-SatDCB* createSatDCB(int satId, double dcb)
+Vector* getStationCoord(char* stationId, StationCoordTable* table)
 {
-    SatDCB* satDCB = malloc(sizeof(SatDCB));
-    memset(satDCB, 0, sizeof(SatDCB));
-    satDCB->satId = satId;
-    satDCB->dcb = dcb;
-    return satDCB;
+    int index = getIndexMapIndex(getStationKey(stationId), &(table->map));
+    return index < 0 ? 0 : &(table->items[index].coord);
 }
 
-int insertSatDCB(int satId, double dcb, SatDCB** satDCBRoot)
+void deleteStationCoordTable(StationCoordTable* table)
 {
-    if(!(*satDCBRoot))
+    deleteIndexMap(&(table->map));
+    if (table->items)
     {
-        *satDCBRoot = createSatDCB(satId, dcb);
-        return 1;
+        free(table->items);
     }
-    if (satId < (*satDCBRoot)->satId)
+    initStationCoordTable(table);
+}
+
+void printStationCoordTable(StationCoordTable* table)
+{
+    int i;
+    for (i = 0; i < table->map.count; i++)
     {
-        return insertSatDCB(satId, dcb, &((*satDCBRoot)->left));
+        printf("station ID: %s,     X: %lf,    Y: %lf,    Z: %lf\n", table->items[i].stationId,
+                                                                     table->items[i].coord.x,
+                                                                     table->items[i].coord.y,
+                                                                     table->items[i].coord.z);
     }
-    else if (satId > (*satDCBRoot)->satId)
+}
+
+
+void initMeasurement(Measurement* meas)
+{
+    memset(meas, 0, sizeof(Measurement));
+}
+
+void initMeasurementList(MeasurementList* measList)
+{
+    memset(measList, 0, sizeof(MeasurementList));
+}
+
+int appendMeasurement(Measurement* meas, MeasurementList* measList)
+{
+    if (measList->count == measList->capacity)
     {
-        return insertSatDCB(satId, dcb, &((*satDCBRoot)->right));
+        measList->capacity = measList->capacity ? 2 * measList->capacity : 1024;
+        measList->items = realloc(measList->items, sizeof(Measurement) * measList->capacity);
     }
-    return 0;
+    measList->items[measList->count] = *meas;
+    measList->count++;
+    return measList->count - 1;
 }
 
-double* getSatDCB(int satId, SatDCB* satDCBRoot)
+int removeUntracedMeasurements(MeasurementList* measList)
 {
-    if(satDCBRoot)
+    int i, kept = 0;
+    for (i = 0; i < measList->count; i++)
     {
-        if(satDCBRoot->satId == satId)
+        Measurement* meas = &(measList->items[i]);
+        if (!meas->lineSectors && !meas->sectors.count)
         {
-            return &(satDCBRoot->dcb);
+            deleteCompactLineSectors(&(meas->sectors));
+            continue;
         }
-        else if(satDCBRoot->satId > satId)
+        if (kept != i)
         {
-            return getSatDCB(satId, satDCBRoot->left);
-        }
-        else
-        {
-            return getSatDCB(satId, satDCBRoot->right);
+            measList->items[kept] = *meas;
         }
+        kept++;
     }
-    return 0;
+    int removed = measList->count - kept;
+    measList->count = kept;
+    return removed;
 }
 
-void deleteSatDCBTree(SatDCB** satDCBRoot)
+void deleteMeasurementList(MeasurementList* measList)
 {
-    if (*satDCBRoot)
+    int i;
+    for (i = 0; i < measList->count; i++)
+    {
+        deleteLineSectorList(&(measList->items[i].lineSectors));
+        deleteCompactLineSectors(&(measList->items[i].sectors));
+    }
+    if (measList->items)
     {
-        deleteSatDCBTree(&((*satDCBRoot)->left));
-        deleteSatDCBTree(&((*satDCBRoot)->right));
-        free(*satDCBRoot);
-        *satDCBRoot = 0;
+        free(measList->items);
     }
-    return;
+    initMeasurementList(measList);
+}
+
+//the cached trace belongs to the current satellite and receiver position
+static int isTraceOfRay(HorizontalTrace* trace, Ray ray)
+{
+    //1 m at the satellite, the direction to about 2 cm at the receiver
+    return vec3Length(vec3Subtract(trace->ray.origin, ray.origin)) < 1 &&
+           vec3Length(vec3Subtract(trace->ray.direction, ray.direction)) < 1e-9;
 }
 
-int doSatDCBPreorderIndexing(SatDCB* satDCBRoot, int lastIndex)
+void calculateLineSectors(Measurement* meas, GPSSatCoords* gpsSatCoords, StationCoordTable* stationCoords, QuadraticGrid* grid, RayCache* rayCache)
 {
-    if(!satDCBRoot)
+    //the coordinates are looked up first, so removed stations and satellites are not served from the cache
+    Vector* satCoord = getGPSSatCoords(meas->gpsTime, meas->satId, gpsSatCoords);
+    Vector* recCoord = getStationCoord(meas->recId, stationCoords);
+    if(!satCoord || !recCoord)
     {
-        return -1;
+        meas->lineSectors = 0;
+        return;
     }
-    int newLastIndex = lastIndex;
-    if(satDCBRoot->left)
+    if (!rayCache)
     {
-        newLastIndex = doSatDCBPreorderIndexing(satDCBRoot->left, newLastIndex);
+        meas->lineSectors = getLineSectorsFromModel(*satCoord, *recCoord, grid);
+        return;
+    }
+    HorizontalTrace* cachedTrace = getRayCacheTrace(rayCache, meas->gpsTime, meas->satId, meas->recId);
+    //a trace of an earlier almanac or station coordinate file is traced again
+    if (cachedTrace && isTraceOfRay(cachedTrace, createRay(vec3FromVector(*satCoord), vec3FromVector(*recCoord))) &&
+        getLineSectorsFromHorizontalTrace(cachedTrace, grid, &(meas->lineSectors)))
+    {
+        rayCache->hitCount++;
+        return;
     }
-    satDCBRoot->preorderIndex = newLastIndex;
-    newLastIndex++;
-    if(satDCBRoot->right)
+    if (cachedTrace)
     {
-        newLastIndex = doSatDCBPreorderIndexing(satDCBRoot->right, newLastIndex);
+        rayCache->retraceCount++;
     }
-    return newLastIndex;
+    else
+    {
+        rayCache->missCount++;
+    }
+    //the trace starts at the upper boundary of this grid, so it covers its layers
+    HorizontalTrace trace;
+    createHorizontalTrace(*satCoord, *recCoord, grid, &trace);
+    getLineSectorsFromHorizontalTrace(&trace, grid, &(meas->lineSectors));
+    insertRayCacheTrace(rayCache, meas->gpsTime, meas->satId, meas->recId, &trace);
 }
 
-int getSatDCBPreorderIndex(int satId, SatDCB* satDCBRoot)
+void calculateLineSectorsBatch(Measurement* measurements, int count, GPSSatCoords* gpsSatCoords, StationCoordTable* stationCoords, QuadraticGrid* grid, RayCache* rayCache)
 {
-    if(satDCBRoot)
+    int i;
+    //the cached traces are looked up one by one
+    if (rayCache)
     {
-        if(satDCBRoot->satId == satId)
+        for (i = 0; i < count; i++)
         {
-            return satDCBRoot->preorderIndex;
+            calculateLineSectors(&(measurements[i]), gpsSatCoords, stationCoords, grid, rayCache);
         }
-        else if(satDCBRoot->satId > satId)
+        return;
+    }
+    Vector* satPos = malloc(sizeof(Vector) * count);
+    Vector* recPos = malloc(sizeof(Vector) * count);
+    int* measIndexes = malloc(sizeof(int) * count);
+    int rayCount = 0;
+    for (i = 0; i < count; i++)
+    {
+        Measurement* meas = &(measurements[i]);
+        Vector* satCoord = getGPSSatCoords(meas->gpsTime, meas->satId, gpsSatCoords);
+        Vector* recCoord = getStationCoord(meas->recId, stationCoords);
+        meas->lineSectors = 0;
+        if (satCoord && recCoord)
         {
-            return getSatDCBPreorderIndex(satId, satDCBRoot->left);
+            satPos[rayCount] = *satCoord;
+            recPos[rayCount] = *recCoord;
+            measIndexes[rayCount] = i;
+            rayCount++;
         }
-        else
+    }
+    if (rayCount)
+    {
+        LineSectorList** results = malloc(sizeof(LineSectorList*) * rayCount);
+        getLineSectorsFromModelBatch(satPos, recPos, rayCount, grid, results);
+        for (i = 0; i < rayCount; i++)
         {
-            return getSatDCBPreorderIndex(satId, satDCBRoot->right);
+            measurements[measIndexes[i]].lineSectors = results[i];
         }
+        free(results);
     }
-    return -1;
+    free(measIndexes);
+    free(recPos);
+    free(satPos);
 }
 
 
-CellParameter* createCellParameter(int cellId, double eDens)
+void initStationDCBTable(StationDCBTable* table)
 {
-    CellParameter* cellParam = malloc(sizeof(CellParameter));
-    memset(cellParam, 0, sizeof(CellParameter));
-    cellParam->cellId = cellId;
-    cellParam->eDensity = eDens;
-    return cellParam;
+    memset(table, 0, sizeof(StationDCBTable));
 }
 
-int insertCellParameter(int cellId, double eDens, CellParameter** cellParamRoot)
+int insertStationDCB(char* stationId, double dcb, StationDCBTable* table)
 {
-    if(!(*cellParamRoot))
+    int isNew;
+    int index = insertIndexMap(getStationKey(stationId), &(table->map), &isNew);
+    if (isNew)
     {
-        *cellParamRoot = createCellParameter(cellId, eDens);
-        return 1;
+        table->items = growTableItems(table->items, &(table->capacity), index, sizeof(StationDCB));
+        memset(&(table->items[index]), 0, sizeof(StationDCB));
+        strncpy(table->items[index].stationId, stationId, 4);
+        table->items[index].dcb = dcb;
     }
-    if (cellId < (*cellParamRoot)->cellId)
-    {
-        return insertCellParameter(cellId, eDens, &((*cellParamRoot)->left));
-    }
-    else if (cellId > (*cellParamRoot)->cellId)
-    {
-        return insertCellParameter(cellId, eDens, &((*cellParamRoot)->right));
-    }
-    return 0;
+    return index;
+}
+
+double* getStationDCB(char* stationId, StationDCBTable* table)
+{
+    int index = getStationDCBIndex(stationId, table);
+    return index < 0 ? 0 : &(table->items[index].dcb);
 }
 
-double* getCellParameter(int cellId, CellParameter* cellParamRoot)
+int getStationDCBIndex(char* stationId, StationDCBTable* table)
 {
-    if(cellParamRoot)
+    return getIndexMapIndex(getStationKey(stationId), &(table->map));
+}
+
+void deleteStationDCBTable(StationDCBTable* table)
+{
+    deleteIndexMap(&(table->map));
+    if (table->items)
     {
-        if(cellParamRoot->cellId == cellId)
-        {
-            return &(cellParamRoot->eDensity);
-        }
-        else if(cellParamRoot->cellId > cellId)
-        {
-            return getCellParameter(cellId, cellParamRoot->left);
-        }
-        else
-        {
-            return getCellParameter(cellId, cellParamRoot->right);
-        }
+        free(table->items);
     }
-    return 0;
+    initStationDCBTable(table);
 }
 
-void deleteCellParameter(CellParameter** cellParamRoot)
+void printStationDCBTable(StationDCBTable* table)
 {
-    if (*cellParamRoot)
+    int i;
+    for (i = 0; i < table->map.count; i++)
     {
-        deleteCellParameter(&((*cellParamRoot)->left));
-        deleteCellParameter(&((*cellParamRoot)->right));
-        free(*cellParamRoot);
-        *cellParamRoot = 0;
+        printf("station dcb variable: %d,    station Id: %s\n", i, table->items[i].stationId);
     }
-    return;
 }
 
-int doCellParameterPreorderIndexing(CellParameter* cellParamRoot, int lastIndex)
+
+void initSatDCBTable(SatDCBTable* table)
+{
+    memset(table, 0, sizeof(SatDCBTable));
+}
+
+int insertSatDCB(int satId, double dcb, SatDCBTable* table)
 {
-    if(!cellParamRoot)
+    int isNew;
+    int index = insertIndexMap(satId, &(table->map), &isNew);
+    if (isNew)
     {
-        return -1;
+        table->items = growTableItems(table->items, &(table->capacity), index, sizeof(SatDCB));
+        table->items[index].satId = satId;
+        table->items[index].dcb = dcb;
     }
-    int newLastIndex = lastIndex;
-    if(cellParamRoot->left)
+    return index;
+}
+
+double* getSatDCB(int satId, SatDCBTable* table)
+{
+    int index = getSatDCBIndex(satId, table);
+    return index < 0 ? 0 : &(table->items[index].dcb);
+}
+
+int getSatDCBIndex(int satId, SatDCBTable* table)
+{
+    return getIndexMapIndex(satId, &(table->map));
+}
+
+void deleteSatDCBTable(SatDCBTable* table)
+{
+    deleteIndexMap(&(table->map));
+    if (table->items)
     {
-        newLastIndex = doCellParameterPreorderIndexing(cellParamRoot->left, newLastIndex);
+        free(table->items);
     }
-    cellParamRoot->preorderIndex = newLastIndex;
-    newLastIndex++;
-    if(cellParamRoot->right)
+    initSatDCBTable(table);
+}
+
+
+void initCellParameterTable(CellParameterTable* table)
+{
+    memset(table, 0, sizeof(CellParameterTable));
+}
+
+int insertCellParameter(int cellId, double eDens, CellParameterTable* table)
+{
+    int isNew;
+    int index = insertIndexMap(cellId, &(table->map), &isNew);
+    if (isNew)
     {
-        newLastIndex = doCellParameterPreorderIndexing(cellParamRoot->right, newLastIndex);
+        table->items = growTableItems(table->items, &(table->capacity), index, sizeof(CellParameter));
+        table->items[index].cellId = cellId;
+        table->items[index].eDensity = eDens;
     }
-    return newLastIndex;
+    return index;
 }
 
-int getCellParameterPreorderIndex(int cellId, CellParameter* cellParamRoot)
+double* getCellParameter(int cellId, CellParameterTable* table)
 {
-    if(cellParamRoot)
+    int index = getCellParameterIndex(cellId, table);
+    return index < 0 ? 0 : &(table->items[index].eDensity);
+}
+
+int getCellParameterIndex(int cellId, CellParameterTable* table)
+{
+    return getIndexMapIndex(cellId, &(table->map));
+}
+
+void deleteCellParameterTable(CellParameterTable* table)
+{
+    deleteIndexMap(&(table->map));
+    if (table->items)
     {
-        if(cellParamRoot->cellId == cellId)
-        {
-            return cellParamRoot->preorderIndex;
-        }
-        else if(cellParamRoot->cellId > cellId)
-        {
-            return getCellParameterPreorderIndex(cellId, cellParamRoot->left);
-        }
-        else
-        {
-            return getCellParameterPreorderIndex(cellId, cellParamRoot->right);
-        }
+        free(table->items);
     }
-    return -1;
+    initCellParameterTable(table);
 }
 
-void printCellParameterPreorder(CellParameter* cellParamRoot)
+void printCellParameterTable(CellParameterTable* table)
 {
-    if(!cellParamRoot)
+    int i;
+    for (i = 0; i < table->map.count; i++)
     {
-        return;
+        printf("cellvariable: %d,    cellId: %d\n", i, table->items[i].cellId);
     }
-    printCellParameterPreorder(cellParamRoot->left);
-    printf("cellvariable: %d,    cellId: %d\n", cellParamRoot->preorderIndex, cellParamRoot->cellId);
-    printCellParameterPreorder(cellParamRoot->right);
 }
 
 
-IonoVariables* createIonoVariables(Measurement* measRoot, QuadraticGrid* grid)
+IonoVariables* createIonoVariables(MeasurementList* measList)
 {
     IonoVariables* retVal = malloc(sizeof(IonoVariables));
     memset(retVal, 0, sizeof(IonoVariables));
-    int measurementCount = 0;
-    while (measRoot)
+    int k;
+    for (k = 0; k < measList->count; k++)
     {
-        if (insertStationDCB(measRoot->recId, 0, &(retVal->stationDCBRoot)))
-        {
-            retVal->stationCount++;
-        }
-        if (insertSatDCB(measRoot->satId, 0, &(retVal->satDCBRoot)))
-        {
-            retVal->satCount++;
-        }
-        LineSectorList* tmplsl = measRoot->lineSectors;
-        while(tmplsl)
-        {
-            int cellId = getSingleCellIDByIndexes(tmplsl->layerId, tmplsl->lateralId, tmplsl->longitudinalId, grid);
-            if(insertCellParameter(cellId, 0, &(retVal->cellParameters)))
-            {
-                retVal->cellCount++;
-            }
-            tmplsl = tmplsl->next;
-        }
-        measurementCount++;
-        measRoot = measRoot->next;
+        Measurement* meas = &(measList->items[k]);
+        insertStationDCB(meas->recId, 0, &(retVal->stationDCBs));
+        insertSatDCB(meas->satId, 0, &(retVal->satDCBs));
     }
-    retVal->corrCount = measurementCount;
-    retVal->corrections = malloc(sizeof(double) * measurementCount);
+    retVal->corrCount = measList->count;
+    retVal->corrections = malloc(sizeof(double) * measList->count);
     return retVal;
 }
 
@@ -561,9 +664,9 @@ void deleteIonoVariables(IonoVariables** ionoVariables)
 {
     if(*ionoVariables)
     {
-        deleteStationDCBTree(&((*ionoVariables)->stationDCBRoot));
-        deleteSatDCBTree(&((*ionoVariables)->satDCBRoot));
-        deleteCellParameter(&((*ionoVariables)->cellParameters));
+        deleteStationDCBTable(&((*ionoVariables)->stationDCBs));
+        deleteSatDCBTable(&((*ionoVariables)->satDCBs));
+        deleteCellParameterTable(&((*ionoVariables)->cellParameters));
         if((*ionoVariables)->corrections)
         {
             free((*ionoVariables)->corrections);
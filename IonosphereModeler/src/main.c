@@ -11,11 +11,14 @@
 #include <observationParser.h>
 #include <rinexCommon.h>
 #include <ionosphereGrid.h>
+#include <adaptiveGrid.h>
+#include <gridFile.h>
+#include <cellCoverage.h>
 #include <matrixOperation.h>
 
 static char doc[] = "Ionosphere modeler program";
 
-static char args_doc[] = "-r RINEXDIR -c RECCOORDFILE -d DCBDIR -a ALMANAC -s STARTTIME -e ENDTIME -i INTERVAL";
+static char args_doc[] = "-r RINEXDIR -c RECCOORDFILE -d DCBDIR -a ALMANAC -s STARTTIME -e ENDTIME -i INTERVAL [-g GRIDSPEC] [-b GRIDFILE] [-k RAYCACHE] [-v COVERAGEREPORT] [-p] [-x] [-l MAXITER] [-t TOLERANCE] [-m DAMPING] [-w WEIGHT] [-z WEIGHT] [-o ORDER]";
 
 static struct argp_option options[] =
 {
@@ -25,7 +28,20 @@ static struct argp_option options[] =
     {"almanac",   'a', "ALMANAC",      0, "The file containing the almanac data."},
     {"starttime", 's', "STARTTIME",    0, "The time from when the measurement will be processed in gps seconds."},
     {"endtime",   'e', "ENDTIME",      0, "The time until the measurement will be processed in gps seconds."},
-    {"interval",  'i', "INTERVAL",     0, "The interval of the sampling of the measurements."}
+    {"interval",  'i', "INTERVAL",     0, "The interval of the sampling of the measurements."},
+    {"grid",      'g', "GRIDSPEC",     0, "The file containing the grid definition (center, cell size, extent, layer heights)."},
+    {"gridfile",  'b', "GRIDFILE",     0, "The file storing the built grid between runs."},
+    {"raycache",  'k', "RAYCACHE",     0, "The file storing the traced line sectors between runs."},
+    {"coverage",  'v', "COVERAGEREPORT", 0, "The file where the ray coverage of the cells is reported."},
+    {"points",    'p', 0,              0, "Keep the entry and exit points of the line sectors (always kept for the trilinear basis)."},
+    {"export",    'x', 0,              0, "Write the alakmatrix to ./alakMatrix as a dense text matrix for debugging."},
+    {"cgls",      'l', "MAXITER",      0, "Solve the adjustment with CGLS in at most MAXITER iterations."},
+    {"tolerance", 't', "TOLERANCE",    0, "CGLS stops when the normal equation residual is reduced by this factor (default 1e-8)."},
+    {"damping",   'm', "DAMPING",      0, "Tikhonov damping of the parameters in CGLS."},
+    {"hsmooth",   'w', "WEIGHT",       0, "Weight of the smoothness regularization between horizontally neighbouring cells."},
+    {"vsmooth",   'z', "WEIGHT",       0, "Weight of the smoothness regularization between vertically neighbouring cells."},
+    {"difforder", 'o', "ORDER",        0, "Smoothness regularization with first (1) or second (2, default) differences."},
+    {0}
 };
 
 struct arguments
@@ -37,6 +53,18 @@ struct arguments
     char* recCoordFile;
     char* dcbDir;
     char* almanacFile;
+    char* gridSpecFile;
+    char* gridFile;
+    char* rayCacheFile;
+    char* coverageReportFile;
+    int isPointRetained;
+    int isDenseExported;
+    int maxIterations;
+    double tolerance;
+    double damping;
+    double horizontalWeight;
+    double verticalWeight;
+    int differenceOrder;
 };
 
 static error_t parse_opt (int key, char *arg, struct argp_state *state)
@@ -64,6 +92,42 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
         case 'i':
             arguments->interval = atol(arg);
             break;
+        case 'g':
+            arguments->gridSpecFile = arg;
+            break;
+        case 'b':
+            arguments->gridFile = arg;
+            break;
+        case 'k':
+            arguments->rayCacheFile = arg;
+            break;
+        case 'v':
+            arguments->coverageReportFile = arg;
+            break;
+        case 'p':
+            arguments->isPointRetained = 1;
+            break;
+        case 'x':
+            arguments->isDenseExported = 1;
+            break;
+        case 'l':
+            arguments->maxIterations = atoi(arg);
+            break;
+        case 't':
+            arguments->tolerance = atof(arg);
+            break;
+        case 'm':
+            arguments->damping = atof(arg);
+            break;
+        case 'w':
+            arguments->horizontalWeight = atof(arg);
+            break;
+        case 'z':
+            arguments->verticalWeight = atof(arg);
+            break;
+        case 'o':
+            arguments->differenceOrder = atoi(arg);
+            break;
 
         case ARGP_KEY_ARG:
             argp_usage (state);
@@ -97,6 +161,18 @@ int main(int argc, char *argv[])
     arguments.recCoordFile = "-";
     arguments.dcbDir = "-";
     arguments.almanacFile = "-";
+    arguments.gridSpecFile = "-";
+    arguments.gridFile = "-";
+    arguments.rayCacheFile = "-";
+    arguments.coverageReportFile = "-";
+    arguments.isPointRetained = 0;
+    arguments.isDenseExported = 0;
+    arguments.maxIterations = 0;
+    arguments.tolerance = 1e-8;
+    arguments.damping = 0;
+    arguments.horizontalWeight = 0;
+    arguments.verticalWeight = 0;
+    arguments.differenceOrder = 2;
 
     argp_parse (&argp, argc, argv, 0, 0, &arguments);
 
@@ -105,7 +181,12 @@ int main(int argc, char *argv[])
         printf("startime cannot be larger than endtime, exiting...\n");
         exit(-1);
     }
-    //Read station coordinates into a binary tree keyed by 4 letter station ID
+    if(arguments.differenceOrder != 1 && arguments.differenceOrder != 2)
+    {
+        printf("the difference order of the regularization must be 1 or 2, exiting...\n");
+        exit(-1);
+    }
+    //Read station coordinates into a table keyed by 4 letter station ID
     char line[100] = {0};
     FILE* statCoordFile = fopen(arguments.recCoordFile, "r");
     if(!statCoordFile)
@@ -113,7 +194,8 @@ int main(int argc, char *argv[])
         printf("could not open receiver coordinate file %s\n", arguments.recCoordFile);
         exit(-1);
     }
-    StationCoord* stationCoordsRoot = 0;
+    StationCoordTable stationCoords;
+    initStationCoordTable(&stationCoords);
     int i;
     for (i = 0; i < 7; i++)
     {
@@ -134,7 +216,7 @@ int main(int argc, char *argv[])
         char flag;
         sscanf(line, "%d%s%lf%lf%lf", &stationNum, stationID, &stationX, &stationY, &stationZ, &flag);
         Vector statVector = createVector(stationX, stationY, stationZ);
-        insertStationCoord(stationID, statVector, &stationCoordsRoot);
+        insertStationCoord(stationID, statVector, &stationCoords);
         memset(line, 0, 100);
     }
     fclose(statCoordFile);
@@ -147,8 +229,8 @@ int main(int argc, char *argv[])
     DIR* rinexDir = opendir(arguments.rinexDir);
 
     struct dirent* fileEntry = 0;
-    Measurement* measListRoot = 0;
-    int measCount = 0;
+    MeasurementList measList;
+    initMeasurementList(&measList);
     while (fileEntry = readdir(rinexDir))
     {
         if (fileEntry->d_type == DT_REG)
@@ -215,7 +297,8 @@ int main(int argc, char *argv[])
                         {
                             assert(0);
                         }
-                        Measurement* meas = malloc(sizeof(Measurement));
+                        Measurement measValue;
+                        Measurement* meas = &measValue;
                         initMeasurement(meas);
                         meas->gpsTime = utcToGPST(observations[i][j].epoch.seconds);
                         meas->satId = i - 1;
@@ -240,11 +323,9 @@ int main(int argc, char *argv[])
                         //satellite does not contain relevant measurements, discarding it
                         if(!meas->C1 || !meas->P2)
                         {
-                            free(meas);
                             continue;
                         }
-                        insertMeasurementToListEnd(meas, &measListRoot);
-                        measCount++;
+                        appendMeasurement(meas, &measList);
                     }
                 }
             }
@@ -272,95 +353,194 @@ int main(int argc, char *argv[])
     }
     closedir(rinexDir);
 
-    Measurement* tmp = measListRoot;
-    GPSSatCoords* gpsSatCoordsTreeRoot = 0;
+    Measurement* tmp = 0;
+    GPSSatCoords gpsSatCoords;
+    GPSAlmanac almanac;
+    if (!loadGPSAlmanac(arguments.almanacFile, &almanac))
+    {
+        exit(-1);
+    }
 
     //Calculate gps sat coords for all relevant epochs
-    int insertStep = 1;
-    while(tmp)
+    long* measTimes = malloc(sizeof(long) * (measList.count + 1));
+    for (i = 0; i < measList.count; i++)
     {
-        printf("insertGPSSatCoords step %d\n", insertStep);
-        insertStep++;
-        insertGPSSatCoords(tmp->gpsTime, arguments.almanacFile, &gpsSatCoordsTreeRoot);
-        tmp = tmp->next;
+        measTimes[i] = measList.items[i].gpsTime;
     }
+    createGPSSatCoords(measTimes, measList.count, arguments.interval, &almanac, &gpsSatCoords);
+    free(measTimes);
     printf("GPS satellite coordinates are calculated.\n");
 
     //Create the grid
-    GeoCoord center = createGeoCoord(50, 15, 1);
+    QuadraticGridSpec gridSpec;
+    initQuadraticGridSpec(&gridSpec);
+    if (strcmp(arguments.gridSpecFile, "-"))
+    {
+        loadQuadraticGridSpec(arguments.gridSpecFile, &gridSpec);
+    }
+    //the neighbors of the regularization are taken from the uniform grid, the refined leaves have none
+    if ((arguments.horizontalWeight > 0 || arguments.verticalWeight > 0) && gridSpec.refinementLevels > 0)
+    {
+        printf("The smoothness regularization is defined on the uniform grid, it can not be used with refinement\n");
+        exit(-1);
+    }
     QuadraticGrid* grid = malloc(sizeof(QuadraticGrid));
-    /* center, Lat size, Lon size, Num Layers, Lat number, Lon number */
-    *grid = createQuadraticGrid(center, 5, 5, 2, 3, 3);
+    initQuadraticGrid(grid);
+    int isGridFileUsed = strcmp(arguments.gridFile, "-");
+    if (isGridFileUsed && loadQuadraticGrid(arguments.gridFile, grid))
+    {
+        validateQuadraticGridSpec(&gridSpec);
+        if (grid->specHash == getQuadraticGridSpecHash(&gridSpec))
+        {
+            printf("Ionosphere grid loaded from %s.\n", arguments.gridFile);
+        }
+        else
+        {
+            printf("Grid file %s was built from a different specification.\n", arguments.gridFile);
+            deleteQuadraticGrid(grid);
+        }
+    }
+    if (!grid->cells)
+    {
+        *grid = createQuadraticGridFromSpec(&gridSpec);
+        if (isGridFileUsed)
+        {
+            saveQuadraticGrid(grid, arguments.gridFile);
+        }
+    }
     printf("Ionospehere grid created.\n");
 
-    //Calculate line sectors
-    tmp = measListRoot;
-    while(tmp)
+    //Open the cache of the previously traced lines
+    RayCache* rayCache = 0;
+    if (strcmp(arguments.rayCacheFile, "-"))
     {
+        rayCache = openRayCache(arguments.rayCacheFile, grid);
+    }
+
+    //Calculate line sectors, they are kept in compact form unless the grid is refined by them
+    int isPointRetained = arguments.isPointRetained || gridSpec.basis == TRILINEAR_NODE_BASIS;
+    for (i = 0; i < measList.count; i++)
+    {
+        tmp = &(measList.items[i]);
+        //the rays are traced in blocks, so the shell intersections run in the batch kernels
+        if (i % LINE_SECTOR_BATCH_SIZE == 0)
+        {
+            int batchSize = measList.count - i < LINE_SECTOR_BATCH_SIZE ? measList.count - i : LINE_SECTOR_BATCH_SIZE;
+            calculateLineSectorsBatch(tmp, batchSize, &gpsSatCoords, &stationCoords, grid, rayCache);
+        }
         printf("calculating linesectors for sat: %d,    rec: %s,    at gps time: %ld\n", tmp->satId+1, tmp->recId, tmp->gpsTime);
-        calculateLineSectors(tmp, gpsSatCoordsTreeRoot, stationCoordsRoot, grid);
         if(!tmp->lineSectors)
         {
             printf(" calculation was unsuccesful\n");
         }
-        tmp = tmp->next;
+        else if (gridSpec.refinementLevels == 0)
+        {
+            compactLineSectors(tmp->lineSectors, isPointRetained, &(tmp->sectors));
+            deleteLineSectorList(&(tmp->lineSectors));
+        }
+    }
+    if (rayCache)
+    {
+        printf("Ray cache: %d hits, %d misses, %d retraced\n", rayCache->hitCount, rayCache->missCount, rayCache->retraceCount);
+        closeRayCache(&rayCache);
     }
 
     //Remove measurements without valid crossing over the model
-    tmp = measListRoot;
-    Measurement* prev = 0;
-    while (tmp)
+    removeUntracedMeasurements(&measList);
+
+    //Refine the grid where the ray density is high
+    int cellCount = grid->layerNum * (grid->northNum + grid->southNum) * (grid->eastNum + grid->westNum);
+    if (gridSpec.refinementLevels > 0)
     {
-        if (tmp == measListRoot)
+        AdaptiveGrid adaptiveGrid = createAdaptiveGrid(grid);
+        int level;
+        for (level = 0; level < gridSpec.refinementLevels; level++)
         {
-            if (!tmp->lineSectors)
+            for (tmp = measList.items; tmp < measList.items + measList.count; tmp++)
             {
-                Measurement* next = tmp->next;
-                free(tmp);
-                tmp = measListRoot = next;
+                LineSectorList* lsl = splitLineSectorsByAdaptiveGrid(tmp->lineSectors, &adaptiveGrid);
+                addAdaptiveGridRayCounts(lsl, &adaptiveGrid);
+                deleteLineSectorList(&lsl);
             }
-            else
+            int changeCount = refineAdaptiveGrid(&adaptiveGrid, gridSpec.splitRayCount, gridSpec.mergeRayCount, gridSpec.refinementLevels);
+            printf("Grid refinement step %d: %d cells changed, %d cells\n", level, changeCount, adaptiveGrid.cellCount);
+            if (!changeCount)
             {
-                prev = tmp;
-                tmp = tmp->next;
+                break;
             }
-            continue;
         }
-        else
+        for (tmp = measList.items; tmp < measList.items + measList.count; tmp++)
         {
-            if (!tmp->lineSectors)
-            {
-                Measurement* next = tmp->next;
-                free(tmp);
-                prev->next = next;
-                tmp = next;
-            }
-            else
-            {
-                prev = tmp;
-                tmp = tmp->next;
-            }
+            LineSectorList* lsl = splitLineSectorsByAdaptiveGrid(tmp->lineSectors, &adaptiveGrid);
+            deleteLineSectorList(&(tmp->lineSectors));
+            compactLineSectors(lsl, isPointRetained, &(tmp->sectors));
+            deleteLineSectorList(&lsl);
         }
+        cellCount = adaptiveGrid.cellCount;
+        deleteAdaptiveGrid(&adaptiveGrid);
     }
 
+    //Coverage of the cells, unobservable cells are merged into their neighbors
+    GridCoverage coverage;
+    initGridCoverage(&coverage, cellCount);
+    for (tmp = measList.items; tmp < measList.items + measList.count; tmp++)
+    {
+        addLineSectorsToCoverage(&coverage, &(tmp->sectors));
+    }
+    if (strcmp(arguments.coverageReportFile, "-") && writeGridCoverageReport(&coverage, arguments.coverageReportFile))
+    {
+        printf("Coverage report written to %s.\n", arguments.coverageReportFile);
+    }
+    if (gridSpec.minRayCount > 0 || gridSpec.minDiversity > 0)
+    {
+        int* cellMapping = malloc(sizeof(int) * cellCount);
+        int mergedCount = mergeUnobservableCells(&coverage, grid, gridSpec.minRayCount, gridSpec.minDiversity, cellMapping);
+        for (tmp = measList.items; tmp < measList.items + measList.count; tmp++)
+        {
+            applyCellMapping(&(tmp->sectors), cellMapping);
+        }
+        printf("%d unobservable cells merged into their neighbors.\n", mergedCount);
+        free(cellMapping);
+    }
+    deleteGridCoverage(&coverage);
+    GridBasis basis = gridSpec.basis;
+    deleteQuadraticGridSpec(&gridSpec);
+
 
     //Alakmatrix
     printf("Creating alakmatrix\n");
     IonoVariables* vars = 0;
-    gsl_matrix* alakMatrix = createAlakMatrix(&vars, measListRoot, grid);
+    SparseMatrix* alakMatrix = createAlakMatrix(&vars, &measList, grid, basis);
     printf("Alakmatrix created\n");
 
-    printf("cellCount: %d,    stationCount: %d,    satCount: %d\n", vars->cellCount, vars->stationCount, vars->satCount);
+    printf("cellCount: %d,    stationCount: %d,    satCount: %d\n", vars->cellParameters.map.count,
+                                                                  vars->stationDCBs.map.count,
+                                                                  vars->satDCBs.map.count);
 
-    printCellParameterPreorder(vars->cellParameters);
-    printStationDCBPreorder(vars->stationDCBRoot);
+    printCellParameterTable(&(vars->cellParameters));
+    printStationDCBTable(&(vars->stationDCBs));
 
-    int paramCount = vars->cellCount;// + vars->stationCount;
+    int paramCount = vars->cellParameters.map.count;// + vars->stationDCBs.map.count;
     int corrCount = vars->corrCount;
 
+    //Smoothness regularization rows appended under the alakmatrix
+    SparseMatrix* regularization = 0;
+    if (arguments.horizontalWeight > 0 || arguments.verticalWeight > 0)
+    {
+        regularization = createRegularizationMatrix(vars, grid, basis, arguments.differenceOrder,
+                                                    arguments.horizontalWeight, arguments.verticalWeight);
+        printf("Number of regularization rows: %d\n", regularization->rowCount);
+        if (!regularization->rowCount)
+        {
+            deleteSparseMatrix(&regularization);
+        }
+    }
+
     printf("Number of measurements: %d\n", corrCount);
     printf("Number of paramaeters: %d\n", paramCount);
-    if(paramCount > corrCount)
+    //CGLS converges to the minimum norm solution of an underdetermined system,
+    //the regularization rows make up for the missing measurements
+    if(paramCount > corrCount && arguments.maxIterations <= 0 && !regularization)
     {
         printf("There are more parameters than measurements, cannot solve problem.");
         exit(-1);
@@ -432,7 +612,7 @@ int main(int argc, char *argv[])
     //Calculate dcb length from time
     for (i = 0; i < 32; i++)
     {
-        double* dcb = getSatDCB(i, vars->satDCBRoot);
+        double* dcb = getSatDCB(i, &(vars->satDCBs));
         if(dcb)
         {
             *dcb = (-p1p2dcb[i]) * 0.299792458;
@@ -443,7 +623,7 @@ int main(int argc, char *argv[])
     {
         if(p1p2recdcb[i].recId[0] != 0)
         {
-            double* dcb = getStationDCB(p1p2recdcb[i].recId, vars->stationDCBRoot);
+            double* dcb = getStationDCB(p1p2recdcb[i].recId, &(vars->stationDCBs));
             if(dcb)
             {
                 *dcb = -p1p2recdcb[i].dcb * 0.299792458;
@@ -451,8 +631,8 @@ int main(int argc, char *argv[])
         }
     }
 
-    gsl_matrix* sulyMatrix = gsl_matrix_alloc(corrCount, corrCount);
-    gsl_matrix_set_identity(sulyMatrix);
+    gsl_vector* sulyVektor = gsl_vector_alloc(corrCount);
+    gsl_vector_set_all(sulyVektor, 1);
 
     gsl_vector* meresVektor = gsl_vector_alloc(corrCount);
     gsl_vector* meresJavVektor = gsl_vector_alloc(corrCount);
@@ -467,14 +647,11 @@ int main(int argc, char *argv[])
         gsl_vector_set(allandok, i, 0);
     }
 
-    tmp = measListRoot;
-    i = 0;
-    while(tmp)
+    for (i = 0; i < measList.count; i++)
     {
+        tmp = &(measList.items[i]);
         gsl_vector_set(meresVektor, i, tmp->C1 - tmp->P2);
-        gsl_vector_set(allandok, i, *(getSatDCB(tmp->satId, vars->satDCBRoot)) + *(getStationDCB(tmp->recId, vars->stationDCBRoot)));
-        i++;
-        tmp = tmp->next;
+        gsl_vector_set(allandok, i, *(getSatDCB(tmp->satId, &(vars->satDCBs))) + *(getStationDCB(tmp->recId, &(vars->stationDCBs))));
     }
 
     for(i = 0; i < paramCount; i++)
@@ -483,25 +660,11 @@ int main(int argc, char *argv[])
         gsl_vector_set(paramJavVektor, i, 0);
     }
 
-    FILE* matrixFile1 = fopen("./alakMatrix", "w");
-    for(i = 0; i < corrCount; i++)
+    printf("Nonzero elements of the alakmatrix: %d\n", alakMatrix->rowStarts[alakMatrix->rowCount]);
+    if (arguments.isDenseExported)
     {
-        int j;
-        for(j = 0; j < paramCount; j++)
-        {
-            printf("A(%d,%d): %le\n", i, j, gsl_matrix_get(alakMatrix, i, j));
-            fprintf(matrixFile1, "%le", gsl_matrix_get(alakMatrix, i, j));
-            if(j == paramCount-1)
-            {
-                fprintf(matrixFile1, "\n");
-            }
-            else
-            {
-                fprintf(matrixFile1, " ");
-            }
-        }
+        exportSparseMatrixDense(alakMatrix, "./alakMatrix");
     }
-    fclose(matrixFile1);
 
     FILE* matrixFile2 = fopen("./paramStartVektor", "w");
     FILE* matrixFile3 = fopen("./paramJavVektor", "w");
@@ -537,10 +700,10 @@ int main(int argc, char *argv[])
     fclose(matrixFile5);
     fclose(matrixFile6);
 /*
-    kiegyenlites(alakMatrix, sulyMatrix,
+    kiegyenlites(alakMatrix, sulyVektor, 0,
                  paramStartVektor, paramJavVektor,
                  meresVektor, meresJavVektor,
-                 allandok, 10);
+                 allandok, 0, 10);
 
     for(i = 0; i < paramCount; i++)
     {
@@ -552,32 +715,62 @@ int main(int argc, char *argv[])
         printf("meres Javitas %d: %lf\n", i, gsl_vector_get(meresJavVektor, i));
     }*/
 
+    if (arguments.maxIterations > 0)
+    {
+        gsl_vector* tisztaTagVektor = gsl_vector_alloc(corrCount);
+        gsl_vector_memcpy(tisztaTagVektor, meresVektor);
+        gsl_vector_add(tisztaTagVektor, allandok);
+
+        printf("Calculating parameters with CGLS\n");
+        solveCGLS(alakMatrix, sulyVektor, tisztaTagVektor,
+                  regularization, arguments.damping,
+                  arguments.tolerance, arguments.maxIterations, paramStartVektor);
+        sparseDgemv(CblasNoTrans, 1, alakMatrix, paramStartVektor, 0, meresJavVektor);
+        gsl_vector_sub(meresJavVektor, tisztaTagVektor);
+        gsl_vector_free(tisztaTagVektor);
+    }
+    else if (regularization)
+    {
+        //the regularized normal matrix is not singular, the direct solution can be used
+        kiegyenlites(alakMatrix, sulyVektor, regularization,
+                     paramStartVektor, paramJavVektor,
+                     meresVektor, meresJavVektor,
+                     allandok, 0, 10);
+    }
+
+    if (arguments.maxIterations > 0 || regularization)
+    {
+        FILE* paramFile = fopen("./param", "w");
+        for(i = 0; i < paramCount; i++)
+        {
+            fprintf(paramFile, "%d %le\n", vars->cellParameters.items[i].cellId, gsl_vector_get(paramStartVektor, i));
+        }
+        fclose(paramFile);
+        FILE* corrFile = fopen("./meresJav", "w");
+        for(i = 0; i < corrCount; i++)
+        {
+            fprintf(corrFile, "%le\n", gsl_vector_get(meresJavVektor, i));
+        }
+        fclose(corrFile);
+    }
+
 
-    tmp = measListRoot;
-    while(tmp)
+    for (tmp = measList.items; tmp < measList.items + measList.count; tmp++)
     {
         printf("gpstime: %ld,    satID: %d,    stationID: %s,    C1: %lf,    P2: %lf\n", tmp->gpsTime,
                                                                                          tmp->satId,
                                                                                          tmp->recId,
                                                                                          tmp->C1,
                                                                                          tmp->P2);
-        LineSectorList *lsl = tmp->lineSectors;
-        int dzs = 0;
-        while(lsl)
+        int dzs;
+        for (dzs = 0; dzs < tmp->sectors.count; dzs++)
         {
-            printf("    Linesector %d:    cell: (%d, %d, %d)    length: %lf\n", dzs,
-                                                                                lsl->layerId,
-                                                                                lsl->lateralId,
-                                                                                lsl->longitudinalId,
-                                                                                lsl->length);
-            lsl = lsl->next;
-            dzs++;
+            printf("    Linesector %d:    cell: %u    length: %f\n", dzs,
+                                                                      tmp->sectors.sectors[dzs].cellId,
+                                                                      tmp->sectors.sectors[dzs].length);
         }
-        tmp = tmp->next;
     }
 
-//    insertGPSSatCoords(1049847916, arguments.almanacFile, &gpsSatCoordsTreeRoot);
-
 /*    Measurement testmeas;
     testmeas.gpsTime = 1049847916;
     testmeas.satId = 2;
@@ -585,8 +778,7 @@ int main(int argc, char *argv[])
     testmeas.C1 = 21155244.152;
     testmeas.P2 = 21155249.400;
     testmeas.lineSectors = 0;
-    testmeas.next = 0;
-    calculateLineSectors(&testmeas, gpsSatCoordsTreeRoot, stationCoordsRoot, grid);
+    calculateLineSectors(&testmeas, &gpsSatCoords, &stationCoords, grid, 0);
 
     printf("Test meas line sectors:\n");
     LineSectorList *testlsl = testmeas.lineSectors;
@@ -603,10 +795,16 @@ int main(int argc, char *argv[])
         dzs++;
     }*/
 
+    deleteGPSSatCoords(&gpsSatCoords);
+
+    deleteStationCoordTable(&stationCoords);
+
+    deleteMeasurementList(&measList);
+
+    deleteSparseMatrix(&alakMatrix);
+    deleteSparseMatrix(&regularization);
+
     //TODO:
-    //delete statCoords
-    //delete gpsSatCoordsTreeRoot
-    //delete measListRoot
     //delete grid
     //delete matrixes and vectors
     return 0;
@@ -1,65 +1,365 @@
 #include <matrixOperation.h>
 #include <assert.h>
+#include <math.h>
 
 
 const double freqC1 = 1575420000;
 const double freqP2 = 1227600000;
 
-gsl_matrix* createAlakMatrix(IonoVariables** vars, Measurement* measRoot, QuadraticGrid* grid)
+void deleteSparseMatrix(SparseMatrix** matrix)
 {
-    if(*vars || !measRoot)
+    if(*matrix)
     {
+        free((*matrix)->rowStarts);
+        free((*matrix)->columns);
+        free((*matrix)->values);
+        free(*matrix);
+        *matrix = 0;
+    }
+}
+
+void sparseDgemv(CBLAS_TRANSPOSE_t transA, double alpha, SparseMatrix* A, gsl_vector* x, double beta, gsl_vector* y)
+{
+    int i, k;
+    if (transA == CblasNoTrans)
+    {
+        for (i = 0; i < A->rowCount; i++)
+        {
+            double sum = 0;
+            for (k = A->rowStarts[i]; k < A->rowStarts[i + 1]; k++)
+            {
+                sum += A->values[k] * gsl_vector_get(x, A->columns[k]);
+            }
+            //like BLAS, y is not read when beta is 0, so it may be uninitialized
+            gsl_vector_set(y, i, beta == 0 ? alpha * sum : alpha * sum + beta * gsl_vector_get(y, i));
+        }
+        return;
+    }
+    if (beta == 0)
+    {
+        gsl_vector_set_zero(y);
+    }
+    else
+    {
+        gsl_vector_scale(y, beta);
+    }
+    for (i = 0; i < A->rowCount; i++)
+    {
+        double xi = alpha * gsl_vector_get(x, i);
+        for (k = A->rowStarts[i]; k < A->rowStarts[i + 1]; k++)
+        {
+            *gsl_vector_ptr(y, A->columns[k]) += A->values[k] * xi;
+        }
+    }
+}
+
+int exportSparseMatrixDense(SparseMatrix* matrix, char* fileName)
+{
+    FILE* matrixFile = fopen(fileName, "w");
+    if (!matrixFile)
+    {
+        printf("could not open matrix file %s\n", fileName);
         return 0;
     }
+    int i, j;
+    for (i = 0; i < matrix->rowCount; i++)
+    {
+        int k = matrix->rowStarts[i];
+        for (j = 0; j < matrix->columnCount; j++)
+        {
+            double value = 0;
+            if (k < matrix->rowStarts[i + 1] && matrix->columns[k] == j)
+            {
+                value = matrix->values[k];
+                k++;
+            }
+            fprintf(matrixFile, "%le", value);
+            fprintf(matrixFile, j == matrix->columnCount - 1 ? "\n" : " ");
+        }
+    }
+    fclose(matrixFile);
+    return 1;
+}
 
-    *vars = createIonoVariables(measRoot, grid);
+//sorts the entries of the last row by column and sums the repeated columns
+static void finishSparseMatrixRow(SparseMatrix* matrix, int row)
+{
+    int start = matrix->rowStarts[row];
+    int end = matrix->rowStarts[row + 1];
+    int i, j;
+    for (i = start + 1; i < end; i++)
+    {
+        int column = matrix->columns[i];
+        double value = matrix->values[i];
+        for (j = i; j > start && matrix->columns[j - 1] > column; j--)
+        {
+            matrix->columns[j] = matrix->columns[j - 1];
+            matrix->values[j] = matrix->values[j - 1];
+        }
+        matrix->columns[j] = column;
+        matrix->values[j] = value;
+    }
+    int last = start - 1;
+    for (i = start; i < end; i++)
+    {
+        if (last >= start && matrix->columns[last] == matrix->columns[i])
+        {
+            matrix->values[last] += matrix->values[i];
+        }
+        else
+        {
+            last++;
+            matrix->columns[last] = matrix->columns[i];
+            matrix->values[last] = matrix->values[i];
+        }
+    }
+    matrix->rowStarts[row + 1] = last + 1;
+}
 
-    doStationDCBPreorderIndexing((*vars)->stationDCBRoot, 0);
-    doSatDCBPreorderIndexing((*vars)->satDCBRoot, 0);
-    doCellParameterPreorderIndexing((*vars)->cellParameters, 0);
+SparseMatrix* createAlakMatrix(IonoVariables** vars, MeasurementList* measList, QuadraticGrid* grid, GridBasis basis)
+{
+    if(*vars || !measList->count)
+    {
+        return 0;
+    }
 
-    int colNum = (*vars)->cellCount;// + (*vars)->stationCount;
-    gsl_matrix* retMatrix = gsl_matrix_alloc ((*vars)->corrCount, colNum);
+    *vars = createIonoVariables(measList);
 
-    int i, j;
-    for (i = 0; i < (*vars)->corrCount; i++)
+    //every sector gives one entry, or one per node for the trilinear basis
+    long entryCapacity = 0;
+    int measNum;
+    for (measNum = 0; measNum < measList->count; measNum++)
+    {
+        entryCapacity += measList->items[measNum].sectors.count;
+    }
+    if (basis == TRILINEAR_NODE_BASIS)
+    {
+        entryCapacity *= 8;
+    }
+
+    SparseMatrix* retMatrix = malloc(sizeof(SparseMatrix));
+    retMatrix->rowCount = (*vars)->corrCount;
+    retMatrix->rowStarts = malloc(sizeof(int) * (retMatrix->rowCount + 1));
+    retMatrix->columns = malloc(sizeof(int) * (entryCapacity + 1));
+    retMatrix->values = malloc(sizeof(double) * (entryCapacity + 1));
+    retMatrix->rowStarts[0] = 0;
+
+    double commonCoeff = 40.3 * (freqP2 * freqP2 - freqC1 * freqC1) / (freqC1 * freqC1 * freqP2 * freqP2);
+    //double commonCoeff = (double)1/200000;
+    //the parameters are registered in the order of their first entry, so the node weights are computed once
+    for (measNum = 0; measNum < measList->count; measNum++)
     {
-        for (j = 0; j < colNum; j++)
+        Measurement* meas = &(measList->items[measNum]);
+        int entryCount = retMatrix->rowStarts[measNum];
+        int j, k;
+        for (k = 0; k < meas->sectors.count; k++)
         {
-            gsl_matrix_set(retMatrix, i, j, 0);
+            if (basis == TRILINEAR_NODE_BASIS)
+            {
+                int nodeIds[8];
+                double weights[8];
+                getCompactLineSectorNodeWeights(&(meas->sectors), k, grid, nodeIds, weights);
+                for (j = 0; j < 8; j++)
+                {
+                    if (weights[j] > 0)
+                    {
+                        retMatrix->columns[entryCount] = insertCellParameter(nodeIds[j], 0, &((*vars)->cellParameters));
+                        retMatrix->values[entryCount] = commonCoeff * weights[j] * 1000000000000;
+                        entryCount++;
+                    }
+                }
+                continue;
+            }
+            double coeff = commonCoeff * meas->sectors.sectors[k].length;
+            int cellId = meas->sectors.sectors[k].cellId;
+            retMatrix->columns[entryCount] = insertCellParameter(cellId, 0, &((*vars)->cellParameters));
+            retMatrix->values[entryCount] = coeff*1000000000000;
+            entryCount++;
         }
+        //int stationIndex = (*vars)->cellParameters.map.count + getStationDCBIndex(meas->recId, &((*vars)->stationDCBs));
+        //stationIndex gets coefficient 1
+        retMatrix->rowStarts[measNum + 1] = entryCount;
+        //merged cells may appear more than once along the ray
+        finishSparseMatrixRow(retMatrix, measNum);
     }
+    retMatrix->columnCount = (*vars)->cellParameters.map.count;// + (*vars)->stationDCBs.map.count;
+    return retMatrix;
+}
 
-    int measNum = 0;
-    while (measRoot)
+
+//adds id to the neighbors if it is not there yet
+static void addNeighborId(int id, int vertical, int* neighborIds, int* isVertical, int* count)
+{
+    int i;
+    for (i = 0; i < *count; i++)
     {
-        double commonCoeff = 40.3 * (freqP2 * freqP2 - freqC1 * freqC1) / (freqC1 * freqC1 * freqP2 * freqP2);
-        //double commonCoeff = (double)1/200000;
-        LineSectorList* tmplsl = measRoot->lineSectors;
-        while (tmplsl)
+        if (neighborIds[i] == id)
         {
-            double coeff = commonCoeff * tmplsl->length;
-            int cellId = getSingleCellIDByIndexes(tmplsl->layerId, tmplsl->lateralId, tmplsl->longitudinalId, grid);
-            int cellIndex = getCellParameterPreorderIndex(cellId, (*vars)->cellParameters);
-            gsl_matrix_set(retMatrix, measNum, cellIndex, coeff*1000000000000);
-            tmplsl = tmplsl-> next;
+            return;
         }
-        //int stationIndex = (*vars)->cellCount + getStationDCBPreorderIndex(measRoot->recId, (*vars)->stationDCBRoot);
-        //gsl_matrix_set(retMatrix, measNum, stationIndex, 1);
-        measRoot = measRoot->next;
-        measNum++;
     }
+    neighborIds[*count] = id;
+    isVertical[*count] = vertical;
+    (*count)++;
+}
+
+/*
+ * Collects the cells (see getLineSectorCellNeighbors()) or nodes adjacent
+ * to the given one. A pole node is adjacent to the whole next ring.
+ * isVertical is set for the neighbors in the next layer. The buffers must
+ * hold 3 * (longitude boundaries) + 6 IDs. Returns the count.
+ */
+static int getGridNeighbors(int id, QuadraticGrid* grid, GridBasis basis, int* neighborIds, int* isVertical)
+{
+    int count = 0;
+    int layer, lat, lon, i;
+    if (basis == TRILINEAR_NODE_BASIS)
+    {
+        int latCount = grid->northNum + grid->southNum + 1;
+        int longCount = grid->eastNum + grid->westNum + 1;
+        layer = id / (latCount * longCount);
+        lat = (id % (latCount * longCount)) / longCount;
+        lon = id % longCount;
+        int step;
+        for (step = -1; step <= 1; step += 2)
+        {
+            if (layer + step >= 0 && layer + step <= grid->layerNum)
+            {
+                addNeighborId(getSingleNodeIDByIndexes(layer + step, lat, lon, grid), 1, neighborIds, isVertical, &count);
+            }
+            if (lat + step < 0 || lat + step >= latCount)
+            {
+                continue;
+            }
+            if (isPoleLatitude(grid->boundaryLatitudes[lat]))
+            {
+                for (i = 0; i < longCount; i++)
+                {
+                    addNeighborId(getSingleNodeIDByIndexes(layer, lat + step, i, grid), 0, neighborIds, isVertical, &count);
+                }
+            }
+            else
+            {
+                addNeighborId(getSingleNodeIDByIndexes(layer, lat + step, lon, grid), 0, neighborIds, isVertical, &count);
+            }
+        }
+        if (!isPoleLatitude(grid->boundaryLatitudes[lat]))
+        {
+            //the last longitude boundary of a grid reaching across the globe is the first one
+            int isWrapping = grid->westNum * grid->longitudeUnit >= M_PI;
+            if (lon > 0)
+            {
+                addNeighborId(getSingleNodeIDByIndexes(layer, lat, lon - 1, grid), 0, neighborIds, isVertical, &count);
+            }
+            else if (isWrapping)
+            {
+                addNeighborId(getSingleNodeIDByIndexes(layer, lat, longCount - 2, grid), 0, neighborIds, isVertical, &count);
+            }
+            if (lon < longCount - 1)
+            {
+                addNeighborId(getSingleNodeIDByIndexes(layer, lat, lon + 1, grid), 0, neighborIds, isVertical, &count);
+            }
+        }
+    }
+    else
+    {
+        return getLineSectorCellNeighbors(id, grid, neighborIds, isVertical);
+    }
+    return count;
+}
+
+SparseMatrix* createRegularizationMatrix(IonoVariables* vars, QuadraticGrid* grid, GridBasis basis,
+                                         int differenceOrder, double horizontalWeight, double verticalWeight)
+{
+    CellParameterTable* parameters = &(vars->cellParameters);
+    int bufferSize = 3 * (grid->eastNum + grid->westNum + 1) + 6;
+    int* neighborIds = malloc(sizeof(int) * bufferSize);
+    int* isVertical = malloc(sizeof(int) * bufferSize);
+
+    SparseMatrix* retMatrix = malloc(sizeof(SparseMatrix));
+    //first differences have one row per neighboring pair, at most 3 per parameter on a regular grid
+    int rowCapacity = differenceOrder == 1 ? 3 * parameters->map.count + 1 : parameters->map.count + 1;
+    retMatrix->rowCount = 0;
+    retMatrix->columnCount = parameters->map.count;
+    retMatrix->rowStarts = malloc(sizeof(int) * rowCapacity);
+    int capacity = 7 * parameters->map.count + 1;
+    retMatrix->columns = malloc(sizeof(int) * capacity);
+    retMatrix->values = malloc(sizeof(double) * capacity);
+    retMatrix->rowStarts[0] = 0;
+
+    int parameter;
+    for (parameter = 0; parameter < parameters->map.count; parameter++)
+    {
+        int neighborCount = getGridNeighbors(parameters->items[parameter].cellId, grid, basis, neighborIds, isVertical);
+        int entryCount = retMatrix->rowStarts[retMatrix->rowCount];
+        if (entryCount + 2 * neighborCount + 1 > capacity)
+        {
+            capacity = 2 * capacity + 2 * neighborCount + 1;
+            retMatrix->columns = realloc(retMatrix->columns, sizeof(int) * capacity);
+            retMatrix->values = realloc(retMatrix->values, sizeof(double) * capacity);
+        }
+        if (retMatrix->rowCount + neighborCount + 2 > rowCapacity)
+        {
+            rowCapacity = 2 * rowCapacity + neighborCount + 2;
+            retMatrix->rowStarts = realloc(retMatrix->rowStarts, sizeof(int) * rowCapacity);
+        }
+        //neighbors without a parameter are not observed, they are left out
+        double diagonal = 0;
+        int diagonalEntry = entryCount;
+        if (differenceOrder != 1)
+        {
+            entryCount++;
+        }
+        int i;
+        for (i = 0; i < neighborCount; i++)
+        {
+            int column = getCellParameterIndex(neighborIds[i], parameters);
+            double weight = isVertical[i] ? verticalWeight : horizontalWeight;
+            if (column < 0 || weight == 0)
+            {
+                continue;
+            }
+            if (differenceOrder == 1)
+            {
+                //every pair once, from its lower column
+                if (column > parameter)
+                {
+                    retMatrix->columns[entryCount] = parameter;
+                    retMatrix->values[entryCount] = weight;
+                    retMatrix->columns[entryCount + 1] = column;
+                    retMatrix->values[entryCount + 1] = -weight;
+                    entryCount += 2;
+                    retMatrix->rowStarts[++retMatrix->rowCount] = entryCount;
+                }
+                continue;
+            }
+            retMatrix->columns[entryCount] = column;
+            retMatrix->values[entryCount] = -weight;
+            entryCount++;
+            diagonal += weight;
+        }
+        if (differenceOrder == 1)
+        {
+            continue;
+        }
+        retMatrix->columns[diagonalEntry] = parameter;
+        retMatrix->values[diagonalEntry] = diagonal;
+        retMatrix->rowStarts[++retMatrix->rowCount] = entryCount;
+        finishSparseMatrixRow(retMatrix, retMatrix->rowCount - 1);
+    }
+    free(neighborIds);
+    free(isVertical);
     return retMatrix;
 }
 
 
-void kiegyenlites(gsl_matrix* alakMatrix, gsl_matrix* sulyMatrix,
+void kiegyenlites(SparseMatrix* alakMatrix, gsl_vector* sulyVektor, SparseMatrix* regularization,
                   gsl_vector* paramStartVektor, gsl_vector* paramJavVektor,
                   gsl_vector* meresVektor, gsl_vector* meresJavVektor,
-                  gsl_vector* allandok, int iterations)
+                  gsl_vector* allandok, gsl_vector* kofaktorVektor, int iterations)
 {
-    int measCount = alakMatrix->size1;
-    int paramCount = alakMatrix->size2;
+    int measCount = alakMatrix->rowCount;
+    int paramCount = alakMatrix->columnCount;
 
     gsl_vector* a0Vektor = gsl_vector_alloc(measCount);
     gsl_vector* tisztaTag_vektor = gsl_vector_alloc(measCount);
@@ -71,91 +371,245 @@ void kiegyenlites(gsl_matrix* alakMatrix, gsl_matrix* sulyMatrix,
         gsl_vector_set(tisztaTag_vektor, i, 0);
     }
 
-    gsl_matrix* ATrxP = gsl_matrix_alloc(paramCount, measCount);
-    gsl_matrix* ATrxPxA = gsl_matrix_alloc(paramCount, paramCount);
-    gsl_matrix* _ATrxPxA_inv = gsl_matrix_alloc(paramCount, paramCount);
-    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1, alakMatrix, sulyMatrix, 0, ATrxP);
-    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1, ATrxP, alakMatrix, 0, ATrxPxA);
-    gsl_matrix* ATrxPxACopy = gsl_matrix_alloc(paramCount, paramCount);
-    gsl_matrix_memcpy (ATrxPxACopy, ATrxPxA);
-/*
-    for(i = 0; i < paramCount; i++)
+    //A^T * P * A from the nonzeros of the rows scaled by their weights
+    gsl_matrix* ATrxPxA = gsl_matrix_calloc(paramCount, paramCount);
+    int k, m;
+    for (i = 0; i < measCount; i++)
     {
-        int j;
-        for(j = 0; j < paramCount; j++)
+        double weight = gsl_vector_get(sulyVektor, i);
+        for (k = alakMatrix->rowStarts[i]; k < alakMatrix->rowStarts[i + 1]; k++)
         {
-            printf("ATrxPxA(%d,%d): %le\n", i, j, gsl_matrix_get(ATrxPxA, i, j));
+            double weightedValue = weight * alakMatrix->values[k];
+            for (m = alakMatrix->rowStarts[i]; m < alakMatrix->rowStarts[i + 1]; m++)
+            {
+                *gsl_matrix_ptr(ATrxPxA, alakMatrix->columns[k], alakMatrix->columns[m]) += weightedValue * alakMatrix->values[m];
+            }
+        }
+    }
+    //+ R^T * R the same way
+    for (i = 0; regularization && i < regularization->rowCount; i++)
+    {
+        for (k = regularization->rowStarts[i]; k < regularization->rowStarts[i + 1]; k++)
+        {
+            for (m = regularization->rowStarts[i]; m < regularization->rowStarts[i + 1]; m++)
+            {
+                *gsl_matrix_ptr(ATrxPxA, regularization->columns[k], regularization->columns[m]) += regularization->values[k] * regularization->values[m];
+            }
         }
     }
-*/
-    int s;
-    gsl_permutation * p = gsl_permutation_alloc(paramCount);
-    gsl_linalg_LU_decomp (ATrxPxA, p, &s);
-    gsl_linalg_LU_invert(ATrxPxA, p, _ATrxPxA_inv);
-
-    gsl_matrix* eccseg = gsl_matrix_alloc(paramCount, paramCount);
-    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1, ATrxPxACopy, _ATrxPxA_inv, 0, eccseg);
 /*
     for(i = 0; i < paramCount; i++)
     {
         int j;
         for(j = 0; j < paramCount; j++)
         {
-            printf("_ATrxPxA_inv(%d,%d): %le\n", i, j, gsl_matrix_get(_ATrxPxA_inv, i, j));
+            printf("ATrxPxA(%d,%d): %le\n", i, j, gsl_matrix_get(ATrxPxA, i, j));
         }
     }
 */
-    for(i = 0; i < paramCount; i++)
+    //the normal matrix is symmetric positive definite, it is factorized once
+    //and the factor is reused in every iteration
+    gsl_error_handler_t* errorHandler = gsl_set_error_handler_off();
+    int status = gsl_linalg_cholesky_decomp1(ATrxPxA);
+    gsl_set_error_handler(errorHandler);
+    if (status != GSL_SUCCESS)
     {
-        int j;
-        for(j = 0; j < paramCount; j++)
+        printf("The normal matrix is not positive definite, some parameters are not determined by the measurements (see the regularization options)\n");
+        exit(-1);
+    }
+
+    //diagonal of (A^T * P * A)^-1 = L^-T * L^-1, the i-th element is the
+    //squared norm of L^-1 * e_i, which is zero above the i-th row
+    if (kofaktorVektor)
+    {
+        double* column = (double*)malloc(paramCount * sizeof(double));
+        int r, c;
+        for (i = 0; i < paramCount; i++)
         {
-            printf("eccseg(%d,%d): %le\n", i, j, gsl_matrix_get(eccseg, i, j));
+            column[i] = 1 / gsl_matrix_get(ATrxPxA, i, i);
+            double kofaktor = column[i] * column[i];
+            for (r = i + 1; r < paramCount; r++)
+            {
+                double sum = 0;
+                for (c = i; c < r; c++)
+                {
+                    sum += gsl_matrix_get(ATrxPxA, r, c) * column[c];
+                }
+                column[r] = -sum / gsl_matrix_get(ATrxPxA, r, r);
+                kofaktor += column[r] * column[r];
+            }
+            gsl_vector_set(kofaktorVektor, i, kofaktor);
         }
+        free(column);
     }
 
-    gsl_matrix_free(eccseg);
-
     printf("Calculating parameters\n");
+    gsl_vector* ATrxPxl = gsl_vector_alloc(paramCount);
+    gsl_vector* Pxl = gsl_vector_alloc(measCount);
+    gsl_vector* Axparam_vektor = gsl_vector_alloc(measCount);
+    gsl_vector* regularizedParams = regularization ? gsl_vector_calloc(regularization->rowCount) : 0;
     for(i = 0; i < iterations; i++)
     {
         printf("    Iteration %d\n", i);
 
-        gsl_blas_dgemv(CblasNoTrans, 1, alakMatrix, paramStartVektor, 0, a0Vektor);
+        sparseDgemv(CblasNoTrans, 1, alakMatrix, paramStartVektor, 0, a0Vektor);
 
         gsl_vector_memcpy(tisztaTag_vektor, meresVektor);
         gsl_vector_sub(meresVektor, a0Vektor);
         gsl_vector_add(meresVektor, allandok);
         gsl_vector_swap(tisztaTag_vektor, meresVektor);
-        int j;
 /*
+        int j;
         for (j = 0; j < measCount; j++)
         {
             printf("tisztatagvektor(%d): %le\n", j, gsl_vector_get(tisztaTag_vektor, j));
         }
 */
-        gsl_vector* ATrxPxl = gsl_vector_alloc(paramCount);
-        gsl_blas_dgemv(CblasNoTrans, 1, ATrxP, tisztaTag_vektor, 0, ATrxPxl);
+        gsl_vector_memcpy(Pxl, tisztaTag_vektor);
+        gsl_vector_mul(Pxl, sulyVektor);
+        sparseDgemv(CblasTrans, 1, alakMatrix, Pxl, 0, ATrxPxl);
+        //- R^T * R * x, the regularization pulls the whole parameter vector, not only the correction
+        if (regularization)
+        {
+            sparseDgemv(CblasNoTrans, 1, regularization, paramStartVektor, 0, regularizedParams);
+            sparseDgemv(CblasTrans, -1, regularization, regularizedParams, 1, ATrxPxl);
+        }
 
-        gsl_blas_dgemv(CblasNoTrans, 1, _ATrxPxA_inv, ATrxPxl, 0, paramJavVektor);
-        gsl_vector* Axparam_vektor = gsl_vector_alloc(measCount);
-        gsl_blas_dgemv(CblasNoTrans, 1, alakMatrix, paramJavVektor, 0, Axparam_vektor);
+        gsl_linalg_cholesky_solve(ATrxPxA, ATrxPxl, paramJavVektor);
+        sparseDgemv(CblasNoTrans, 1, alakMatrix, paramJavVektor, 0, Axparam_vektor);
         gsl_vector_memcpy(meresJavVektor, Axparam_vektor);
         gsl_vector_sub(Axparam_vektor, tisztaTag_vektor);
         gsl_vector_swap(meresJavVektor, Axparam_vektor);
 
-        gsl_vector_free(Axparam_vektor);
-        gsl_vector_free(ATrxPxl);
-
         gsl_vector_add(paramStartVektor, paramJavVektor);
     }
 
+    gsl_vector_free(Axparam_vektor);
+    if (regularizedParams)
+    {
+        gsl_vector_free(regularizedParams);
+    }
+    gsl_vector_free(Pxl);
+    gsl_vector_free(ATrxPxl);
     gsl_vector_free(a0Vektor);
     gsl_vector_free(tisztaTag_vektor);
 
-    gsl_matrix_free(ATrxP);
     gsl_matrix_free(ATrxPxA);
-    gsl_matrix_free(_ATrxPxA_inv);
+}
+
+//A^T * P * r + R^T * regResidual - damping^2 * x, the residual of the normal equations
+static void calculateNormalResidual(SparseMatrix* alakMatrix, gsl_vector* sulyVektor, gsl_vector* residual,
+                                    SparseMatrix* regularization, gsl_vector* regResidual, double damping,
+                                    gsl_vector* paramVektor, gsl_vector* weightedResidual, gsl_vector* normalResidual)
+{
+    gsl_vector_memcpy(weightedResidual, residual);
+    gsl_vector_mul(weightedResidual, sulyVektor);
+    sparseDgemv(CblasTrans, 1, alakMatrix, weightedResidual, 0, normalResidual);
+    if (regularization)
+    {
+        sparseDgemv(CblasTrans, 1, regularization, regResidual, 1, normalResidual);
+    }
+    if (damping > 0)
+    {
+        gsl_blas_daxpy(-damping * damping, paramVektor, normalResidual);
+    }
+}
+
+int solveCGLS(SparseMatrix* alakMatrix, gsl_vector* sulyVektor, gsl_vector* tisztaTagVektor,
+              SparseMatrix* regularization, double damping,
+              double tolerance, int maxIterations, gsl_vector* paramVektor)
+{
+    int measCount = alakMatrix->rowCount;
+    int paramCount = alakMatrix->columnCount;
+
+    //residuals of the measurements (l - A * x) and of the regularization rows (-R * x)
+    gsl_vector* residual = gsl_vector_alloc(measCount);
+    gsl_vector_memcpy(residual, tisztaTagVektor);
+    sparseDgemv(CblasNoTrans, -1, alakMatrix, paramVektor, 1, residual);
+    gsl_vector* regResidual = 0;
+    gsl_vector* regDirection = 0;
+    if (regularization)
+    {
+        regResidual = gsl_vector_calloc(regularization->rowCount);
+        regDirection = gsl_vector_calloc(regularization->rowCount);
+        sparseDgemv(CblasNoTrans, -1, regularization, paramVektor, 0, regResidual);
+    }
+
+    gsl_vector* weighted = gsl_vector_calloc(measCount);
+    gsl_vector* measDirection = gsl_vector_calloc(measCount);
+    gsl_vector* normalResidual = gsl_vector_calloc(paramCount);
+    gsl_vector* direction = gsl_vector_alloc(paramCount);
 
-    gsl_permutation_free(p);
+    //the tolerance is relative to the residual at x = 0 (A^T * P * l), so a
+    //good start value does not make the stopping criterion stricter
+    double stopGamma;
+    gsl_vector_memcpy(weighted, tisztaTagVektor);
+    gsl_vector_mul(weighted, sulyVektor);
+    sparseDgemv(CblasTrans, 1, alakMatrix, weighted, 0, normalResidual);
+    gsl_blas_ddot(normalResidual, normalResidual, &stopGamma);
+    stopGamma *= tolerance * tolerance;
+
+    calculateNormalResidual(alakMatrix, sulyVektor, residual, regularization, regResidual, damping,
+                            paramVektor, weighted, normalResidual);
+    gsl_vector_memcpy(direction, normalResidual);
+    double gamma;
+    gsl_blas_ddot(normalResidual, normalResidual, &gamma);
+
+    int iteration = 0;
+    while (iteration < maxIterations && gamma > stopGamma && gamma > 0)
+    {
+        //squared (weighted) norm of the image of the search direction
+        double delta;
+        sparseDgemv(CblasNoTrans, 1, alakMatrix, direction, 0, measDirection);
+        gsl_vector_memcpy(weighted, measDirection);
+        gsl_vector_mul(weighted, sulyVektor);
+        gsl_blas_ddot(weighted, measDirection, &delta);
+        if (regularization)
+        {
+            double regDelta;
+            sparseDgemv(CblasNoTrans, 1, regularization, direction, 0, regDirection);
+            gsl_blas_ddot(regDirection, regDirection, &regDelta);
+            delta += regDelta;
+        }
+        if (damping > 0)
+        {
+            double directionNorm = gsl_blas_dnrm2(direction);
+            delta += damping * damping * directionNorm * directionNorm;
+        }
+        if (!(delta > 0))
+        {
+            break;
+        }
+
+        double alpha = gamma / delta;
+        gsl_blas_daxpy(alpha, direction, paramVektor);
+        gsl_blas_daxpy(-alpha, measDirection, residual);
+        if (regularization)
+        {
+            gsl_blas_daxpy(-alpha, regDirection, regResidual);
+        }
+
+        calculateNormalResidual(alakMatrix, sulyVektor, residual, regularization, regResidual, damping,
+                                paramVektor, weighted, normalResidual);
+        double newGamma;
+        gsl_blas_ddot(normalResidual, normalResidual, &newGamma);
+        gsl_vector_scale(direction, newGamma / gamma);
+        gsl_vector_add(direction, normalResidual);
+        gamma = newGamma;
+        iteration++;
+    }
+    printf("CGLS stopped after %d iterations, normal equation residual: %le (limit %le)\n",
+           iteration, sqrt(gamma), sqrt(stopGamma));
+
+    gsl_vector_free(residual);
+    gsl_vector_free(weighted);
+    gsl_vector_free(measDirection);
+    gsl_vector_free(normalResidual);
+    gsl_vector_free(direction);
+    if (regularization)
+    {
+        gsl_vector_free(regResidual);
+        gsl_vector_free(regDirection);
+    }
+    return iteration;
 }
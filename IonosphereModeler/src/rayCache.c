@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <rayCache.h>
+
+static const char rayCacheMagic[8] = {'I', 'O', 'N', 'O', 'R', 'A', 'Y', 'C'};
+static const int rayCacheVersion = 3;
+
+typedef struct RayCacheFileHeader
+{
+    char magic[8];
+    int version;
+    int reserved;
+    unsigned long long horizontalHash;
+}RayCacheFileHeader;
+
+//followed by crossingCount HorizontalCrossing records
+typedef struct RayCacheRecord
+{
+    long gpsTime;
+    int satId;
+    int crossingCount;
+    char recId[8];
+    Ray ray;
+    double startDistance;
+    int leavesGrid;
+    int reserved;
+}RayCacheRecord;
+
+unsigned long hashRayCacheKey(long gpsTime, int satId, char* recId)
+{
+    unsigned long hash = (unsigned long)gpsTime * 2654435761UL + (unsigned long)satId * 40503UL;
+    int i;
+    for (i = 0; i < 4 && recId[i]; i++)
+    {
+        hash = hash * 31 + (unsigned char)recId[i];
+    }
+    return hash;
+}
+
+RayCacheEntry* findRayCacheEntry(RayCache* rayCache, long gpsTime, int satId, char* recId)
+{
+    unsigned long index = hashRayCacheKey(gpsTime, satId, recId) % rayCache->capacity;
+    while (rayCache->entries[index].isUsed)
+    {
+        RayCacheEntry* entry = &(rayCache->entries[index]);
+        if (entry->gpsTime == gpsTime && entry->satId == satId && !strncmp(entry->recId, recId, 4))
+        {
+            return entry;
+        }
+        index = (index + 1) % rayCache->capacity;
+    }
+    //first free slot of the probe sequence
+    return &(rayCache->entries[index]);
+}
+
+void growRayCache(RayCache* rayCache)
+{
+    RayCacheEntry* oldEntries = rayCache->entries;
+    int oldCapacity = rayCache->capacity;
+    rayCache->capacity = oldCapacity ? oldCapacity * 2 : 1024;
+    rayCache->entries = calloc(rayCache->capacity, sizeof(RayCacheEntry));
+    int i;
+    for (i = 0; i < oldCapacity; i++)
+    {
+        if (oldEntries[i].isUsed)
+        {
+            *findRayCacheEntry(rayCache, oldEntries[i].gpsTime, oldEntries[i].satId, oldEntries[i].recId) = oldEntries[i];
+        }
+    }
+    if (oldEntries)
+    {
+        free(oldEntries);
+    }
+}
+
+//stores the trace in memory, its crossings are owned by the cache afterwards
+void storeRayCacheEntry(RayCache* rayCache, long gpsTime, int satId, char* recId, HorizontalTrace* trace)
+{
+    if (2 * (rayCache->count + 1) > rayCache->capacity)
+    {
+        growRayCache(rayCache);
+    }
+    RayCacheEntry* entry = findRayCacheEntry(rayCache, gpsTime, satId, recId);
+    if (entry->isUsed)
+    {
+        deleteHorizontalTrace(&(entry->trace));
+    }
+    else
+    {
+        rayCache->count++;
+    }
+    entry->gpsTime = gpsTime;
+    entry->satId = satId;
+    memset(entry->recId, 0, 5);
+    strncpy(entry->recId, recId, 4);
+    entry->isUsed = 1;
+    entry->trace = *trace;
+}
+
+//reads the records of the file, returns the offset after the last complete record
+long loadRayCacheRecords(RayCache* rayCache)
+{
+    long validOffset = ftell(rayCache->file);
+    RayCacheRecord record;
+    while (fread(&record, sizeof(RayCacheRecord), 1, rayCache->file) == 1)
+    {
+        HorizontalTrace trace;
+        initHorizontalTrace(&trace);
+        trace.ray = record.ray;
+        trace.horizontalHash = rayCache->horizontalHash;
+        trace.startDistance = record.startDistance;
+        trace.leavesGrid = record.leavesGrid;
+        trace.crossingCount = record.crossingCount;
+        if (record.crossingCount)
+        {
+            trace.crossings = malloc(sizeof(HorizontalCrossing) * record.crossingCount);
+            //interrupted write at the end of the file
+            if (fread(trace.crossings, sizeof(HorizontalCrossing), record.crossingCount, rayCache->file) != record.crossingCount)
+            {
+                deleteHorizontalTrace(&trace);
+                break;
+            }
+        }
+        storeRayCacheEntry(rayCache, record.gpsTime, record.satId, record.recId, &trace);
+        validOffset = ftell(rayCache->file);
+    }
+    return validOffset;
+}
+
+RayCache* openRayCache(char* cacheFile, QuadraticGrid* grid)
+{
+    RayCache* rayCache = malloc(sizeof(RayCache));
+    memset(rayCache, 0, sizeof(RayCache));
+    rayCache->horizontalHash = getQuadraticGridHorizontalHash(grid);
+    growRayCache(rayCache);
+
+    rayCache->file = fopen(cacheFile, "r+b");
+    if (rayCache->file)
+    {
+        RayCacheFileHeader header;
+        if (fread(&header, sizeof(RayCacheFileHeader), 1, rayCache->file) == 1 &&
+            !memcmp(header.magic, rayCacheMagic, 8) &&
+            header.version == rayCacheVersion &&
+            header.horizontalHash == rayCache->horizontalHash)
+        {
+            long validOffset = loadRayCacheRecords(rayCache);
+            fflush(rayCache->file);
+            if (ftruncate(fileno(rayCache->file), validOffset))
+            {
+                printf("could not truncate ray cache file %s\n", cacheFile);
+            }
+            fseek(rayCache->file, validOffset, SEEK_SET);
+            printf("Ray cache %s: %d rays loaded\n", cacheFile, rayCache->count);
+            return rayCache;
+        }
+        printf("Ray cache %s was created for different grid boundaries, it is rebuilt\n", cacheFile);
+        fclose(rayCache->file);
+    }
+    rayCache->file = fopen(cacheFile, "w+b");
+    if (!rayCache->file)
+    {
+        printf("could not open ray cache file %s, caching is disabled\n", cacheFile);
+        return rayCache;
+    }
+    RayCacheFileHeader header;
+    memset(&header, 0, sizeof(RayCacheFileHeader));
+    memcpy(header.magic, rayCacheMagic, 8);
+    header.version = rayCacheVersion;
+    header.horizontalHash = rayCache->horizontalHash;
+    fwrite(&header, sizeof(RayCacheFileHeader), 1, rayCache->file);
+    return rayCache;
+}
+
+HorizontalTrace* getRayCacheTrace(RayCache* rayCache, long gpsTime, int satId, char* recId)
+{
+    RayCacheEntry* entry = findRayCacheEntry(rayCache, gpsTime, satId, recId);
+    if (!entry->isUsed)
+    {
+        return 0;
+    }
+    return &(entry->trace);
+}
+
+void insertRayCacheTrace(RayCache* rayCache, long gpsTime, int satId, char* recId, HorizontalTrace* trace)
+{
+    //a replaced trace is appended as well, the last record is loaded
+    storeRayCacheEntry(rayCache, gpsTime, satId, recId, trace);
+    if (!rayCache->file)
+    {
+        return;
+    }
+    RayCacheRecord record;
+    memset(&record, 0, sizeof(RayCacheRecord));
+    record.gpsTime = gpsTime;
+    record.satId = satId;
+    strncpy(record.recId, recId, 4);
+    record.crossingCount = trace->crossingCount;
+    record.ray = trace->ray;
+    record.startDistance = trace->startDistance;
+    record.leavesGrid = trace->leavesGrid;
+    fwrite(&record, sizeof(RayCacheRecord), 1, rayCache->file);
+    if (trace->crossingCount)
+    {
+        fwrite(trace->crossings, sizeof(HorizontalCrossing), trace->crossingCount, rayCache->file);
+    }
+}
+
+void closeRayCache(RayCache** rayCache)
+{
+    if (!(*rayCache))
+    {
+        return;
+    }
+    if ((*rayCache)->file)
+    {
+        fclose((*rayCache)->file);
+    }
+    int i;
+    for (i = 0; i < (*rayCache)->capacity; i++)
+    {
+        if ((*rayCache)->entries[i].isUsed)
+        {
+            deleteHorizontalTrace(&((*rayCache)->entries[i].trace));
+        }
+    }
+    free((*rayCache)->entries);
+    free(*rayCache);
+    *rayCache = 0;
+}
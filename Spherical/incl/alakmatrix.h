@@ -49,6 +49,14 @@ public:
     ~Alakmatrix();
 
 private:
+    //geodetic coordinates of the integration points of the current row and their distance, see calcSections()
+    vector<double>       sectionLatitudes;
+    vector<double>       sectionLongitudes;
+    vector<double>       sectionHeights;
+    double               sectionLength;
+
+    void calcSections(unsigned int rowIndex);
+
     void calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned int n, unsigned int m);
 
     void calcDCBCoeffs(unsigned int rowIndex);
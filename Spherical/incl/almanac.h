@@ -2,14 +2,53 @@
 #define ALMANAC_H
 
 #include "alakmatrix.h"
+#include <vector>
+
+#define GPS_SATELLITE_COUNT 32
 
 extern const long unixUTCMinusGPS;
 
 long utcToGPST(long utc);
 long gpstToUTC(long gpst);
 
-//result must be full zero array
-void calculateGPSSatellitePositions(double t, char* almanacFile, sat_coord_t& sat_coords);
+//Keplerian elements of one PRN from a YUMA almanac
+struct AlmanacEntry
+{
+    bool   isValid;                 //the PRN is in the file and healthy
+    int    week;
+    double eccentricity;
+    double referenceTime;           //time of applicability [s of week]
+    double inclination;
+    double rateOfRightAscension;
+    double sqrtA;
+    double rightAscension;          //at the start of the week
+    double argumentOfPerigee;
+    double meanAnomaly;             //at the reference time
+
+    //constants of the position evaluation, set by the loader
+    double meanMotion;
+    double nodeAtZero;              //longitude of the node in ECEF at t = 0
+    double nodeRate;                //rate of right ascension minus earth rotation
+    double aCosPerigee, aSinPerigee;
+    double bCosPerigee, bSinPerigee;
+    double cosInclination, sinInclination;
+};
+
+//The almanac parsed once, indexed by PRN - 1
+struct GPSAlmanac
+{
+    AlmanacEntry entries[GPS_SATELLITE_COUNT];
+};
+
+//returns false if the file can not be read
+bool loadGPSAlmanac(const char* almanacFile, GPSAlmanac& almanac);
+//ECEF position of one satellite at t seconds of the GPS week
+void calculateGPSSatellitePosition(const AlmanacEntry& entry, double t, double& x, double& y, double& z);
+//ECEF positions of one PRN at a list of epochs
+void calculateGPSSatellitePositions(const AlmanacEntry& entry, const vector<long>& times, vector<double>& x, vector<double>& y, vector<double>& z);
+//adds the positions of the valid PRNs at every epoch to sat_coords
+void calculateGPSSatellitePositions(const vector<long>& times, const GPSAlmanac& almanac, sat_coord_t& sat_coords);
+void calculateGPSSatellitePositions(double t, const GPSAlmanac& almanac, sat_coord_t& sat_coords);
 double calculateTimeOfGPSWeek(long gpsTime);
 
 
@@ -1,5 +1,6 @@
 #include "alakmatrix.h"
 #include "almanac.h"
+#include <geodeticConversion.h>
 
 #include <eigen3/Eigen/Geometry>
 #include <iostream>
@@ -70,15 +71,38 @@ double Alakmatrix::calcLegendrePolynomial(unsigned int n, unsigned int m, double
             sqrt(((2.0 * (double)n + 1.0) * ((double)n + (double)m - 1.0) * ((double)n - (double)m - 1.0)) / ((2.0 * (double)n - 3.0) * ((double)n + (double)m) * ((double)n - (double)m))) * calcLegendrePolynomial(n-2, m, angle);
 }
 
-// k = 0..K-1, n = 0..N, m=0..n
-void Alakmatrix::calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned int n, unsigned int m)
+//the integration points are the midpoints of the equal sections of the ray, they are converted at once
+void Alakmatrix::calcSections(unsigned int rowIndex)
 {
-    //std::cout << "k = " << k << "    n = " << n << "    m = " << m << std::endl;
-    //get receiver-satellite vector data
     Measurement& currMeas = measurements[rowIndex];
     Vector3d orientation = satCoords[currMeas.satId][calculateTimeOfGPSWeek(currMeas.gpsTime)] - recCoords[currMeas.recId];
     double distance = orientation.norm();
     orientation.normalize();
+    sectionLength = distance / sectorCount;
+
+    GeographicalVector& recCoord = recCoords[currMeas.recId];
+    vector<double> x(sectorCount), y(sectorCount), z(sectorCount);
+    for (unsigned int i = 0; i < sectorCount; i++)
+    {
+        double sectionDistance = (i + 0.5) * sectionLength;
+        x[i] = recCoord.x + orientation[0] * sectionDistance;
+        y[i] = recCoord.y + orientation[1] * sectionDistance;
+        z[i] = recCoord.z + orientation[2] * sectionDistance;
+    }
+    sectionLatitudes.resize(sectorCount);
+    sectionLongitudes.resize(sectorCount);
+    sectionHeights.resize(sectorCount);
+    if (sectorCount)
+    {
+        ecefToGeodeticBatch(sectorCount, &x[0], &y[0], &z[0], recCoord.a, recCoord.e,
+                            &sectionLatitudes[0], &sectionLongitudes[0], &sectionHeights[0]);
+    }
+}
+
+// k = 0..K-1, n = 0..N, m=0..n
+void Alakmatrix::calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned int n, unsigned int m)
+{
+    //std::cout << "k = " << k << "    n = " << n << "    m = " << m << std::endl;
     //get vertical profile
     map<unsigned int, double>& currVertProf = verticalProfiles[k];
     //get position in the matrix
@@ -88,14 +112,13 @@ void Alakmatrix::calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned i
                              k * (N + 1) * N / 2 + (n + 1) * n / 2 + m -
                              k * N - (n + 1);
     //get integration interval
-    double dS = distance / sectorCount;
+    double dS = sectionLength;
 
     //integral sums
     double integralA = 0;
     double integralB = 0;
 
-    GeographicalVector sectionMid = recCoords[currMeas.recId] + orientation * 0.5 * dS;
-    //integrate
+    //integrate, the points are calculated by calcSections()
 
     for (unsigned int i = 0; i < sectorCount; i++)
     {
@@ -109,7 +132,7 @@ void Alakmatrix::calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned i
         for (endIt; endIt != currVertProf.end(); endIt++)
         {
             //we have found it
-            if (sectionMid.h < endIt->first)
+            if (sectionHeights[i] < endIt->first)
             {
                 upperBoundIt = endIt;
                 break;
@@ -127,7 +150,6 @@ void Alakmatrix::calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned i
             {
                 std::cout<<"15os sor also legkor"<<std::endl;
             }*/
-            sectionMid = sectionMid + orientation * dS;
             continue;
         }
         //over the highest data (outer space), add 0 to sum
@@ -135,35 +157,33 @@ void Alakmatrix::calcSumCoeffs(unsigned int rowIndex, unsigned int k, unsigned i
         {
             /*if (rowIndex == 15)
             {
-                std::cout<<"sectionMid.h: " << sectionMid.h <<std::endl;
+                std::cout<<"sectionHeights[i]: " << sectionHeights[i] <<std::endl;
             }*/
-            sectionMid = sectionMid + orientation * dS;
             continue;
         }
 
         //calculate the vertical profile value
         double partialProfileGrad = (upperBoundIt->second - lowerBoundIt->second) / (upperBoundIt->first - lowerBoundIt->first);
-        double profileValue = lowerBoundIt->second + (sectionMid.h - lowerBoundIt->first) * partialProfileGrad;
+        double profileValue = lowerBoundIt->second + (sectionHeights[i] - lowerBoundIt->first) * partialProfileGrad;
 
         if (k == 0)
         {
-            //std::cout << "lowerBoundIt->second: " << lowerBoundIt->second <<  "    sectionMid.h:" << sectionMid.h << "    lowerBoundIt->first: " << lowerBoundIt->first << "    partialProfileGrad: " << partialProfileGrad << std::endl;
+            //std::cout << "lowerBoundIt->second: " << lowerBoundIt->second <<  "    sectionHeights[i]:" << sectionHeights[i] << "    lowerBoundIt->first: " << lowerBoundIt->first << "    partialProfileGrad: " << partialProfileGrad << std::endl;
             //std::cout << "lower bound: " << lowerBoundIt->first << "    upperbound: " << upperBoundIt->first << "    lowerProfValue: " << lowerBoundIt->second << "    upperProfValue: " << upperBoundIt->second << "    profileValue: " << profileValue << std::endl;
         }
 
         //calculate legendre polynomial
-        double Pnm = calcLegendrePolynomial(n, m, sectionMid.fi);
+        double Pnm = calcLegendrePolynomial(n, m, sectionLatitudes[i]);
 
         //add rectangle to integral sum
-        integralA += cos(m * sectionMid.lambda) * Pnm * profileValue * dS;
+        integralA += cos(m * sectionLongitudes[i]) * Pnm * profileValue * dS;
         if (m != 0)
         {
-            integralB += sin(m * sectionMid.lambda) * Pnm * profileValue * dS;
+            integralB += sin(m * sectionLongitudes[i]) * Pnm * profileValue * dS;
         }
-        sectionMid = sectionMid + orientation * dS;
         /*if(k == 0 && n == 0 && m == 0)
         {
-            std::cout << "n: " << n << "    m: " << m << "    lambda: " << sectionMid.lambda << "    Pnm: " << Pnm << "    sectionMid.h: " << sectionMid.h << "    profileValue: " << profileValue << "    dS: " << dS << std::endl;
+            std::cout << "n: " << n << "    m: " << m << "    lambda: " << sectionLongitudes[i] << "    Pnm: " << Pnm << "    sectionHeights[i]: " << sectionHeights[i] << "    profileValue: " << profileValue << "    dS: " << dS << std::endl;
             std::cout << "integral b: " << integralB << endl;
         }*/
     }
@@ -219,6 +239,7 @@ void Alakmatrix::calcDCBCoeffs(unsigned int rowIndex)
 
 void Alakmatrix::calcRow(unsigned int rowIndex)
 {
+    calcSections(rowIndex);
     for (unsigned int k = 0; k < K; k++)
     {
         for (unsigned int n = 0; n < N; n++)
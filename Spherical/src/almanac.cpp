@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <vectorMath.h>
 #include <almanac.h>
 
 #include <iostream>
@@ -19,142 +20,236 @@ long gpstToUTC(long gpst)
     return gpst + unixUTCMinusGPS;
 }
 
-void calculateGPSSatellitePositions(double t, char* almanacFile, sat_coord_t& results)
+static const double nu = 3.986004418E+14;
+static const double omega_e = 7.2921151467E-05;
+
+//splits a YUMA line into the 27 character name field and the value after it
+static bool readAlmanacLine(FILE* pinfile, char* name, char* value)
 {
-    char string[80], name[30], value[30], *pstr;
+    char string[80], *pstr;
+
+    if (!fgets(string, 80, pinfile))
+    {
+        return false;
+    }
+    pstr = name;
+    *pstr = '\0';
+    strncat(name,string,27);
+    pstr = value;
+    *pstr = '\0';
+    if (strlen(string) > 27)
+    {
+        pstr=string;
+        pstr+=27;
+        strcat(value,pstr);
+    }
+    return true;
+}
+
+static void setAlmanacEntryConstants(AlmanacEntry& entry)
+{
+    double a = pow(entry.sqrtA,2);
+    double b = a*sqrt(1-pow(entry.eccentricity,2));
+
+    entry.meanMotion = sqrt(nu/pow(entry.sqrtA,6));
+    entry.nodeAtZero = entry.rightAscension - entry.rateOfRightAscension*entry.referenceTime;
+    entry.nodeRate = entry.rateOfRightAscension - omega_e;
+    entry.aCosPerigee = a*cos(entry.argumentOfPerigee);
+    entry.aSinPerigee = a*sin(entry.argumentOfPerigee);
+    entry.bCosPerigee = b*cos(entry.argumentOfPerigee);
+    entry.bSinPerigee = b*sin(entry.argumentOfPerigee);
+    entry.cosInclination = cos(entry.inclination);
+    entry.sinInclination = sin(entry.inclination);
+}
+
+bool loadGPSAlmanac(const char* almanacFile, GPSAlmanac& almanac)
+{
+    char name[30], value[80];
     FILE *pinfile;
-    double e, t0, i, inc, omegadot, sqrta, omega0, kis_omega, m0, nu, omega_e;
-    double n, kozep_anom, exc_anom, exc_anom1, valod_anom, r, v, u1, u2, nagy_omega;
-    double x, y, z, x_ecef, y_ecef, z_ecef;
-    int id, health, week;
+    int i, id, health;
 
     if (!(pinfile = fopen(almanacFile,"rt")))
     {
         printf("Can not find input almanac file\n");
-        exit(-1);
+        return false;
     }
-
-    /*Állandók megadása:*/
-
-    nu = 3.986004418E+14;
-    omega_e = 7.2921151467E-05;
+    memset(&almanac, 0, sizeof(GPSAlmanac));
 
     /*Almanac adatok beolvasása:*/
 
-    printf("Calculating GPS satellite positon for t = %.0lf from almanac\n", t);
-    while (!(feof(pinfile)))
+    while (readAlmanacLine(pinfile, name, value))
     {
-        fgets(string, 80, pinfile);
-        pstr = name;
-        *pstr = '\0';
-        strncat(name,string,27);
-        pstr = value;
-        *pstr = '\0';
-        pstr=string;
-        pstr+=27;
-        strcat(value,pstr);
-        if (!(strncmp(name,"**",2)))
+        if (strncmp(name,"**",2))
         {
-            for (i=0; i<13; i++)
+            continue;
+        }
+        AlmanacEntry entry;
+        memset(&entry, 0, sizeof(AlmanacEntry));
+        id = 0;
+        health = -1;
+        for (i=0; i<13 && readAlmanacLine(pinfile, name, value); i++)
+        {
+            if (!(strncmp(name,"ID",2)))
             {
-                fgets(string, 80, pinfile);
-                pstr = name;
-                *pstr = '\0';
-                strncat(name,string,27);
-                pstr = value;
-                *pstr = '\0';
-                pstr=string;
-                pstr+=27;
-                strcat(value,pstr);
-                if (!(strncmp(name,"ID",2)))
-                {
-                    id = atoi(value);
-                }
-                if (!(strncmp(name,"Hea",3)))
-                {
-                    health = atoi(value);
-                }
-                if (!(strncmp(name, "Ec",2)))
-                {
-                    e = atof(value);
-                }
-                if(!(strncmp(name,"Ti",2)))
-                {
-                    t0 = atof(value);
-                }
-                if(!(strncmp(name,"Or",2)))
-                {
-                    inc = atof(value);
-                }
-                if(!(strncmp(name,"Ra",2)))
-                {
-                    omegadot = atof(value);
-                }
-                if(!(strncmp(name,"SQ",2)))
-                {
-                    sqrta = atof(value);
-                }
-                if(!(strncmp(name,"Ri",2)))
-                {
-                    omega0 = atof(value);
-                }
-                if(!(strncmp(name,"Ar",2)))
-                {
-                    kis_omega = atof(value);
-                }
-                if(!(strncmp(name,"Mea",3)))
-                {
-                    m0 = atof(value);
-                }
-                if(!(strncmp(name,"we",2)))
-                {
-                    week = atoi(value);
-                }
+                id = atoi(value);
             }
-
-            /* Számítások: */
-
-            n = sqrt(nu/pow(sqrta,6));
-            kozep_anom  = m0 + n*(t-t0);
-            exc_anom1 = kozep_anom + e*sin(kozep_anom);
-            while(exc_anom - exc_anom1 > 0.000001 || exc_anom - exc_anom1 < -0.000001)
+            if (!(strncmp(name,"Hea",3)))
             {
-                exc_anom = kozep_anom + e*sin(exc_anom1);
-                exc_anom1 = kozep_anom + e*sin(exc_anom);
+                health = atoi(value);
             }
+            if (!(strncmp(name, "Ec",2)))
+            {
+                entry.eccentricity = atof(value);
+            }
+            if(!(strncmp(name,"Ti",2)))
+            {
+                entry.referenceTime = atof(value);
+            }
+            if(!(strncmp(name,"Or",2)))
+            {
+                entry.inclination = atof(value);
+            }
+            if(!(strncmp(name,"Ra",2)))
+            {
+                entry.rateOfRightAscension = atof(value);
+            }
+            if(!(strncmp(name,"SQ",2)))
+            {
+                entry.sqrtA = atof(value);
+            }
+            if(!(strncmp(name,"Ri",2)))
+            {
+                entry.rightAscension = atof(value);
+            }
+            if(!(strncmp(name,"Ar",2)))
+            {
+                entry.argumentOfPerigee = atof(value);
+            }
+            if(!(strncmp(name,"Mea",3)))
+            {
+                entry.meanAnomaly = atof(value);
+            }
+            if(!(strncmp(name,"we",2)))
+            {
+                entry.week = atoi(value);
+            }
+        }
+        if (id < 1 || id > GPS_SATELLITE_COUNT)
+        {
+            printf("Invalid PRN %d in almanac file %s\n", id, almanacFile);
+            continue;
+        }
+        entry.isValid = (health == 0);
+        setAlmanacEntryConstants(entry);
+        almanac.entries[id - 1] = entry;
+    }
+    fclose(pinfile);
+    return true;
+}
 
-            valod_anom=2*atan(sqrt((1+e)/(1-e))*tan(exc_anom/2));
-
-            r = pow(sqrta,2)*(1-e*cos(exc_anom));
-            v = ((n*pow(sqrta,4)))/r*sqrt(1-pow(e*cos(exc_anom),2));
-
-            u1 = r*cos(valod_anom);
-            u2 = r*sin(valod_anom);
-
-            /*Forgatás:*/
+/*
+ * Newton's method on Kepler's equation from E = M. The error is squared by
+ * every step, three steps reach double precision for e < 0.1 (GPS orbits
+ * are below 0.03), so the step count is fixed and the epoch loop has no
+ * data dependent branch. The sine and cosine of the result are updated
+ * from the last step instead of being evaluated again.
+ */
+static const int keplerNewtonSteps = 3;
 
-            nagy_omega = omega0 + omegadot*(t-t0);
+//every sine and cosine of the epochs is evaluated by one sinCosBatch call, that uses AVX2 if it is available
+static void evaluateAlmanacEntry(const AlmanacEntry& entry, const vector<double>& times, vector<double>& x, vector<double>& y, vector<double>& z)
+{
+    int count = times.size();
+    double e = entry.eccentricity;
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    if (count == 0)
+    {
+        return;
+    }
+    vector<double> meanAnomaly(count), excAnom(count), sinE(count), cosE(count);
 
-            x = u1*(cos(nagy_omega)*cos(kis_omega)-sin(nagy_omega)*sin(kis_omega)*cos(inc))+u2*(-cos(nagy_omega)*sin(kis_omega)-sin(nagy_omega)*cos(kis_omega)*cos(inc));
+    for (int i = 0; i < count; i++)
+    {
+        meanAnomaly[i] = entry.meanAnomaly + entry.meanMotion*(times[i] - entry.referenceTime);
+        excAnom[i] = meanAnomaly[i];
+    }
+    for (int k = 0; k < keplerNewtonSteps; k++)
+    {
+        sinCosBatch(count, &excAnom[0], &sinE[0], &cosE[0]);
+        for (int i = 0; i < count; i++)
+        {
+            double step = (meanAnomaly[i] - excAnom[i] + e*sinE[i]) / (1 - e*cosE[i]);
+            excAnom[i] += step;
+            if (k == keplerNewtonSteps - 1)
+            {
+                double sinLast = sinE[i];
+                sinE[i] += cosE[i]*step;
+                cosE[i] -= sinLast*step;
+            }
+        }
+    }
 
-            y = u1*(sin(nagy_omega)*cos(kis_omega)+cos(nagy_omega)*sin(kis_omega)*cos(inc))+u2*(-sin(nagy_omega)*sin(kis_omega)+cos(nagy_omega)*cos(kis_omega)*cos(inc));
+    //the node angles reuse the buffers of the anomalies
+    vector<double>& node = excAnom;
+    vector<double>& sinNode = meanAnomaly;
+    vector<double> cosNode(count);
+    for (int i = 0; i < count; i++)
+    {
+        //position in the orbital plane rotated by the argument of perigee
+        x[i] = entry.aCosPerigee*(cosE[i] - e) - entry.bSinPerigee*sinE[i];
+        y[i] = entry.aSinPerigee*(cosE[i] - e) + entry.bCosPerigee*sinE[i];
+        //longitude of the node in ECEF, the earth rotation is already included
+        node[i] = entry.nodeAtZero + entry.nodeRate*times[i];
+    }
+    sinCosBatch(count, &node[0], &sinNode[0], &cosNode[0]);
+    for (int i = 0; i < count; i++)
+    {
+        double planeX = x[i];
+        double planeY = y[i];
+        x[i] = planeX*cosNode[i] - planeY*entry.cosInclination*sinNode[i];
+        y[i] = planeX*sinNode[i] + planeY*entry.cosInclination*cosNode[i];
+        z[i] = planeY*entry.sinInclination;
+    }
+}
 
-            z = u1*(sin(kis_omega)*sin(inc))+u2*(cos(kis_omega)*sin(inc));
+void calculateGPSSatellitePosition(const AlmanacEntry& entry, double t, double& x_ecef, double& y_ecef, double& z_ecef)
+{
+    vector<double> x, y, z;
+    evaluateAlmanacEntry(entry, vector<double>(1, t), x, y, z);
+    x_ecef = x[0];
+    y_ecef = y[0];
+    z_ecef = z[0];
+}
 
-            x_ecef = x*cos(omega_e*t)+y*sin(omega_e*t);
-            y_ecef = -x*sin(omega_e*t)+y*cos(omega_e*t);
-            z_ecef = z;
+void calculateGPSSatellitePositions(const AlmanacEntry& entry, const vector<long>& times, vector<double>& x, vector<double>& y, vector<double>& z)
+{
+    evaluateAlmanacEntry(entry, vector<double>(times.begin(), times.end()), x, y, z);
+}
 
-            /*Kiírás:*/
+void calculateGPSSatellitePositions(const vector<long>& times, const GPSAlmanac& almanac, sat_coord_t& results)
+{
+    vector<double> x, y, z;
 
-            if (health == 0)
-            {
-                map<long, GeographicalVector>& satmap = results[id-1];
-                satmap[t] = GeographicalVector(x_ecef, y_ecef, z_ecef, Alakmatrix::a, Alakmatrix::e);
-            }
+    for (int j = 0; j < GPS_SATELLITE_COUNT; j++)
+    {
+        if (!almanac.entries[j].isValid)
+        {
+            continue;
+        }
+        calculateGPSSatellitePositions(almanac.entries[j], times, x, y, z);
+        map<long, GeographicalVector>& satmap = results[j];
+        for (size_t i = 0; i < times.size(); i++)
+        {
+            satmap[times[i]] = GeographicalVector(x[i], y[i], z[i], Alakmatrix::a, Alakmatrix::e);
         }
     }
-    fclose(pinfile);
+}
+
+void calculateGPSSatellitePositions(double t, const GPSAlmanac& almanac, sat_coord_t& results)
+{
+    calculateGPSSatellitePositions(vector<long>(1, (long)t), almanac, results);
 }
 
 double calculateTimeOfGPSWeek(long gpsTime)
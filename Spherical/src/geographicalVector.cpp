@@ -1,6 +1,7 @@
 #include <eigen3/Eigen/Core>
 #include <math.h>
 #include "geographicalVector.h"
+#include <geodeticConversion.h>
 #include <assert.h>
 #include <iostream>
 
@@ -85,7 +86,7 @@ void GeographicalVector::init(double firstCoord, double secondCoord, double thir
 {
     this->a = a;
     this->e = e;
-    b = sqrt((1 - pow(e, 2)) * pow(a, 2));
+    b = a * sqrt(1 - e * e);
 
     if (isDescartes)
     {
@@ -93,21 +94,8 @@ void GeographicalVector::init(double firstCoord, double secondCoord, double thir
         y = secondCoord;
         z = thirdCoord;
 
-        lambda = atan2(y,  x);
-
-        double p = sqrt(pow(x, 2) + pow(y, 2));
-
-        double finull = atan(z/ (p * (1 - pow(e, 2))));
-        double Nnull = pow(a, 2) / sqrt(pow(a * cos(finull), 2) + pow(b * sin(finull), 2));
-        h = p / cos(finull) - Nnull;
-        fi = atan(z  / (p * (1 - pow(e, 2) * Nnull / (Nnull + h))));
-        while (abs(finull - fi) > 0.00001)
-        {
-            finull = fi;
-            Nnull = pow(a, 2) / sqrt(pow(a * cos(finull), 2) + pow(b * sin(finull), 2));
-            h = p / cos(finull) - Nnull;
-            fi = atan(z  / (p * (1 - pow(e, 2) * Nnull / (Nnull + h))));
-        }
+        //closed form, no iteration needed
+        ecefToGeodetic(x, y, z, a, e, &fi, &lambda, &h);
     }
     else
     {
@@ -115,10 +103,8 @@ void GeographicalVector::init(double firstCoord, double secondCoord, double thir
         lambda = secondCoord;
         h = thirdCoord;
 
-        N = a / (1 - pow(e, 2) * pow(sin(fi), 2));
-
-        x = (N + h) * cos(fi) * cos(lambda);
-        y = (N + h) * cos(fi) * sin(lambda);
-        z = ((1 - pow(e, 2)) * N + h) * sin(fi);
+        geodeticToECEF(fi, lambda, h, a, e, &x, &y, &z);
     }
-}
\ No newline at end of file
+    double sinFi = sin(fi);
+    N = a / sqrt(1 - e * e * sinFi * sinFi);
+}
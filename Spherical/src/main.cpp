@@ -18,6 +18,7 @@ extern "C"
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <set>
 
 
 static char doc[] = "Ionosphere modeler program";
@@ -381,14 +382,19 @@ int main(int argc, char *argv[])
 
     //Calculate gps sat coords for all relevant epochs
     sat_coord_t gpsSatCoords;
-    int insertStep = 1;
+    GPSAlmanac almanac;
+    if (!loadGPSAlmanac(arguments.almanacFile, almanac))
+    {
+        exit(-1);
+    }
+    set<long> epochSet;
     for (measurement_vector_t::iterator it = filteredMeasurements.begin(); it != filteredMeasurements.end(); it++)
     {
-        printf("insertGPSSatCoords step %d\n", insertStep);
-        insertStep++;
-        double t = calculateTimeOfGPSWeek(it->gpsTime);
-        calculateGPSSatellitePositions(t, arguments.almanacFile, gpsSatCoords);
+        epochSet.insert((long)calculateTimeOfGPSWeek(it->gpsTime));
     }
+    vector<long> epochs(epochSet.begin(), epochSet.end());
+    printf("Calculating GPS satellite positions for %d epochs from almanac\n", (int)epochs.size());
+    calculateGPSSatellitePositions(epochs, almanac, gpsSatCoords);
     printf("GPS satellite coordinates are calculated.\n");
     //remove unnecessary gps coordinates
     for (sat_coord_t::iterator it1 = gpsSatCoords.begin(); it1 != gpsSatCoords.end();)
@@ -458,8 +464,8 @@ int main(int argc, char *argv[])
     }
     fb.close();
 
-    //weights matrix
-    BigNumMatrix weights(filteredMeasurements.size(), filteredMeasurements.size());
+    //weights, only the diagonal of the weight matrix is stored
+    BigNumMatrix weights(filteredMeasurements.size(), 1);
     for (int i = 0; i < filteredMeasurements.size(); i++)
     {
         Vector3d recSat = gpsSatCoords[filteredMeasurements[i].satId][calculateTimeOfGPSWeek(filteredMeasurements[i].gpsTime)] -
@@ -468,7 +474,7 @@ int main(int argc, char *argv[])
         double cosZenit = (recSat[0] * recVec[0] + recSat[1] * recVec[1] + recSat[2] * recVec[2]) /
                           sqrt(recSat[0] * recSat[0] + recSat[1] * recSat[1] + recSat[2] * recSat[2]) /
                           sqrt(recVec[0] * recVec[0] + recVec[1] * recVec[1] + recVec[2] * recVec[2]);
-        weights(i, i) = mpf_class(cosZenit*cosZenit, 128);
+        weights(i, 0) = mpf_class(cosZenit*cosZenit, 128);
     }
 
     //Read DCB values from dcb file
@@ -720,7 +726,16 @@ int main(int argc, char *argv[])
 
     /*
     cout << "Calculating normal matrix" << endl;
-    BigNumMatrix normalMatrix = bnAlakmatrix.transpose() * weights * bnAlakmatrix;
+    //P * A, every row of the alakmatrix is scaled by its weight
+    BigNumMatrix weightedAlakmatrix(bnAlakmatrix);
+    for (unsigned int row = 0; row < weightedAlakmatrix.getRowNum(); row++)
+    {
+        for (unsigned int col = 0; col < weightedAlakmatrix.getColNum(); col++)
+        {
+            weightedAlakmatrix(row, col) *= weights(row, 0);
+        }
+    }
+    BigNumMatrix normalMatrix = bnAlakmatrix.transpose() * weightedAlakmatrix;
     cout << "Normal matrix created" << endl;
     normalMatrix.roundToZero();
     fb.open ("./normalmat", ios::out);
@@ -746,7 +761,7 @@ int main(int argc, char *argv[])
     {
         BigNumMatrix a0 = bnAlakmatrix * paramStart;
         BigNumMatrix ttv = measVec - a0 - constants;
-        BigNumMatrix paramJav = inverse * bnAlakmatrix.transpose() * weights * ttv;
+        BigNumMatrix paramJav = inverse * weightedAlakmatrix.transpose() * ttv;
         meresJav = bnAlakmatrix * paramJav - ttv;
         fb.open ("./paramJav", ios::out);
         os.flush();